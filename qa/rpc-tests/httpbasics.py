@@ -22,7 +22,7 @@ except ImportError:
 
 class HTTPBasicsTest (BitcoinTestFramework):        
     def setup_nodes(self):
-        return start_nodes(4, self.options.tmpdir, extra_args=[['-rpckeepalive=1'], ['-rpckeepalive=0'], [], []])
+        return start_nodes(4, self.options.tmpdir, extra_args=[['-rpckeepalive=1', '-rpcthreads=2'], ['-rpckeepalive=0'], [], []])
 
     def run_test(self):        
         
@@ -74,6 +74,23 @@ class HTTPBasicsTest (BitcoinTestFramework):
         assert_equal('"error":null' in out1, True)
         assert_equal(conn.sock!=None, False) #now the connection must be closed after the response        
         
+        #idle keep-alive connections must not hold on to the two rpc worker threads of node0
+        headers = {"Authorization": "Basic " + base64.b64encode(authpair)}
+        idleconns = []
+        for i in range(8):
+            conn = httplib.HTTPConnection(url.hostname, url.port)
+            conn.connect()
+            conn.request('POST', '/', '{"method": "getbestblockhash"}', headers)
+            out1 = conn.getresponse().read();
+            assert_equal('"error":null' in out1, True)
+            idleconns.append(conn)
+        rpcinfo = self.nodes[0].getrpcinfo()
+        assert_equal(rpcinfo['threads'], 2)
+        assert_equal(rpcinfo['queued'], 0)
+        assert_equal(rpcinfo['connections'] >= 8, True)
+        for conn in idleconns:
+            conn.close()
+
         #node1 (2nd node) is running with disabled keep-alive option
         urlNode1 = urlparse.urlparse(self.nodes[1].url)
         authpair = urlNode1.username + ':' + urlNode1.password
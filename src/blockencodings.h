@@ -0,0 +1,193 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <ios>
+#include <limits>
+#include <memory>
+#include <vector>
+
+class CTxMemPool;
+
+/** The transactions of a compact block that the receiver could not find in its mempool, by index in the block */
+class BlockTransactionsRequest {
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> indexes;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        uint64_t nCount = indexes.size();
+        READWRITE(COMPACTSIZE(nCount));
+        // Indexes are sent as the difference to the previous one, minus one
+        if (ser_action.ForRead()) {
+            indexes.clear();
+            uint64_t nOffset = 0;
+            while (indexes.size() < nCount) {
+                uint64_t nIndex = 0;
+                READWRITE(COMPACTSIZE(nIndex));
+                nIndex += nOffset;
+                if (nIndex > std::numeric_limits<uint16_t>::max())
+                    throw std::ios_base::failure("BlockTransactionsRequest index overflowed 16 bits");
+                indexes.push_back(nIndex);
+                nOffset = nIndex + 1;
+            }
+        } else {
+            for (size_t i = 0; i < indexes.size(); i++) {
+                uint64_t nIndex = indexes[i] - (i == 0 ? 0 : indexes[i - 1] + 1);
+                READWRITE(COMPACTSIZE(nIndex));
+            }
+        }
+    }
+};
+
+/** The answer to a BlockTransactionsRequest */
+class BlockTransactions {
+public:
+    uint256 blockhash;
+    std::vector<CTransaction> txn;
+
+    BlockTransactions() {}
+    BlockTransactions(const BlockTransactionsRequest& req) : blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent along with a compact block, index is the difference to the previous prefilled one, minus one */
+struct PrefilledTransaction {
+    uint16_t index;
+    CTransaction tx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        uint64_t nIndex = index;
+        READWRITE(COMPACTSIZE(nIndex));
+        if (nIndex > std::numeric_limits<uint16_t>::max())
+            throw std::ios_base::failure("PrefilledTransaction index overflowed 16 bits");
+        index = nIndex;
+        READWRITE(tx);
+    }
+};
+
+typedef enum ReadStatus_t
+{
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, // Invalid object, the peer misbehaved
+    READ_STATUS_FAILED, // Failed to process object, e.g. a short id collision, fall back to the full block
+} ReadStatus;
+
+/**
+ * A block announced by its header and a 6 byte short id of each transaction, which the receiver
+ * looks up in its mempool. The coinbase and, for MN-PoS blocks, the coinstake are sent in full,
+ * as is the block signature and stake pointer of MN-PoS blocks.
+ */
+class CBlockHeaderAndShortTxIDs {
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+    static const int SHORTTXIDS_LENGTH = 6;
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    CBlockHeader header;
+    bool fProofOfStake;
+    std::vector<unsigned char> vchBlockSig;
+    StakePointer stakePointer;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() : fProofOfStake(false) {}
+
+    CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(header);
+        READWRITE(nonce);
+
+        uint64_t nCount = shorttxids.size();
+        READWRITE(COMPACTSIZE(nCount));
+        if (ser_action.ForRead()) {
+            shorttxids.clear();
+            while (shorttxids.size() < nCount) {
+                uint32_t lsb = 0;
+                uint16_t msb = 0;
+                READWRITE(lsb);
+                READWRITE(msb);
+                shorttxids.push_back((uint64_t(msb) << 32) | uint64_t(lsb));
+            }
+        } else {
+            for (size_t i = 0; i < shorttxids.size(); i++) {
+                uint32_t lsb = shorttxids[i] & 0xffffffff;
+                uint16_t msb = (shorttxids[i] >> 32) & 0xffff;
+                READWRITE(lsb);
+                READWRITE(msb);
+            }
+        }
+
+        READWRITE(prefilledtxn);
+
+        READWRITE(fProofOfStake);
+        if (fProofOfStake) {
+            READWRITE(vchBlockSig);
+            READWRITE(stakePointer);
+        }
+
+        if (ser_action.ForRead())
+            FillShortTxIDSelector();
+    }
+};
+
+/** A compact block being put together from the mempool and, if needed, a BlockTransactions message */
+class PartiallyDownloadedBlock {
+protected:
+    std::vector<std::shared_ptr<const CTransaction> > txn_available;
+    size_t prefilled_count = 0, mempool_count = 0;
+    CTxMemPool* pool;
+public:
+    CBlockHeader header;
+    bool fProofOfStake;
+    std::vector<unsigned char> vchBlockSig;
+    StakePointer stakePointer;
+
+    PartiallyDownloadedBlock(CTxMemPool* poolIn) : pool(poolIn), fProofOfStake(false) {}
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
+    bool IsTxAvailable(size_t index) const;
+    /** Put the block together, vtx_missing holds the transactions that were not available in the order of the block */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransaction>& vtx_missing);
+    size_t GetMempoolCount() const { return mempool_count; }
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
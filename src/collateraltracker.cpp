@@ -0,0 +1,131 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "collateraltracker.h"
+#include "legacysigner.h"
+#include "txmempool.h"
+
+/** Masternode and Systemnode collaterals */
+CCollateralTracker collateralTracker;
+
+bool CCollateralTracker::IsSpentOnChain(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_main);
+
+    // an unconfirmed collateral is not in the UTXO set yet
+    if (mempool.exists(outpoint.hash))
+        return false;
+
+    const CCoins* coins = pcoinsTip->AccessCoins(outpoint.hash);
+    return !coins || !coins->IsAvailable(outpoint.n);
+}
+
+bool CCollateralTracker::IsSpent(const CTxIn& vin, int nCollateral, bool& fSpentRet)
+{
+    {
+        LOCK(cs);
+        std::map<COutPoint, CCollateral>::const_iterator it = mapCollaterals.find(vin.prevout);
+        if (it != mapCollaterals.end() && it->second.fChecked) {
+            fSpentRet = it->second.fSpent;
+            return true;
+        }
+    }
+
+    CValidationState state;
+    CMutableTransaction tx = CMutableTransaction();
+    CTxOut vout = CTxOut((nCollateral - 0.01)*COIN, legacySigner.collateralPubKey);
+    tx.vin.push_back(vin);
+    tx.vout.push_back(vout);
+
+    TRY_LOCK(cs_main, lockMain);
+    if(!lockMain) return false;
+
+    fSpentRet = !AcceptableInputs(mempool, state, CTransaction(tx), false, NULL);
+
+    // Only a collateral that is gone from the UTXO set is definitely spent. Any other failure, like
+    // a spend in the mempool that may still be dropped, is looked at again on the next call.
+    if (fSpentRet && !IsSpentOnChain(vin.prevout))
+        return true;
+
+    // store the result while holding cs_main, so no notification can be missed in between
+    LOCK(cs);
+    CCollateral& collateral = mapCollaterals[vin.prevout];
+    collateral.fChecked = true;
+    collateral.fSpent = fSpentRet;
+    if (fSpentRet) collateral.nHeight = -1;
+
+    return true;
+}
+
+int CCollateralTracker::GetHeight(const CTxIn& vin)
+{
+    {
+        LOCK(cs);
+        std::map<COutPoint, CCollateral>::const_iterator it = mapCollaterals.find(vin.prevout);
+        if (it != mapCollaterals.end() && it->second.nHeight >= 0)
+            return it->second.nHeight;
+    }
+
+    int nHeight = GetInputHeight(vin);
+
+    // only remember confirmed collaterals, the others might still change
+    if (nHeight < 0 || nHeight == (int)MEMPOOL_HEIGHT)
+        return nHeight;
+
+    LOCK(cs);
+    std::map<COutPoint, CCollateral>::iterator it = mapCollaterals.find(vin.prevout);
+    if (it == mapCollaterals.end())
+        it = mapCollaterals.insert(std::make_pair(vin.prevout, CCollateral())).first;
+    if (!it->second.fChecked || !it->second.fSpent)
+        it->second.nHeight = nHeight;
+
+    return nHeight;
+}
+
+void CCollateralTracker::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    LOCK(cs);
+
+    if (mapCollaterals.empty()) return;
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+        std::map<COutPoint, CCollateral>::iterator it = mapCollaterals.find(txin.prevout);
+        if (it == mapCollaterals.end()) continue;
+
+        if (pblock) {
+            it->second.nHeight = -1;
+            it->second.fChecked = true;
+            it->second.fSpent = true;
+        } else {
+            // spent in the mempool, removed from the mempool or disconnected: look it up again
+            it->second = CCollateral();
+        }
+    }
+
+    // the collateral transaction itself was connected or disconnected
+    const uint256 hash = tx.GetHash();
+    std::map<COutPoint, CCollateral>::iterator it = mapCollaterals.lower_bound(COutPoint(hash, 0));
+    while (it != mapCollaterals.end() && it->first.hash == hash) {
+        it->second = CCollateral();
+        ++it;
+    }
+}
+
+void CCollateralTracker::Forget(const COutPoint& outpoint)
+{
+    LOCK(cs);
+    mapCollaterals.erase(outpoint);
+}
+
+void CCollateralTracker::Clear()
+{
+    LOCK(cs);
+    mapCollaterals.clear();
+}
+
+int CCollateralTracker::size() const
+{
+    LOCK(cs);
+    return mapCollaterals.size();
+}
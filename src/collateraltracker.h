@@ -0,0 +1,56 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COLLATERALTRACKER_H
+#define COLLATERALTRACKER_H
+
+#include "main.h"
+#include "sync.h"
+
+class CCollateralTracker;
+extern CCollateralTracker collateralTracker;
+
+//
+// CCollateralTracker : Remembers the confirmation height and the spent state of Masternode and
+// Systemnode collaterals. Every collateral is looked up in the UTXO set once, afterwards its state
+// is only updated from block and mempool notifications.
+//
+
+class CCollateralTracker : public CValidationInterface
+{
+private:
+    struct CCollateral
+    {
+        int nHeight;    // confirmation height, -1 if it has to be looked up (always for spent ones)
+        bool fChecked;  // fSpent is known
+        bool fSpent;
+
+        CCollateral() : nHeight(-1), fChecked(false), fSpent(false) {}
+    };
+
+    // critical section to protect the inner data structures
+    mutable CCriticalSection cs;
+
+    std::map<COutPoint, CCollateral> mapCollaterals;
+
+    /// Whether a collateral is missing from the UTXO set, as opposed to being rejected for another reason
+    static bool IsSpentOnChain(const COutPoint& outpoint);
+
+protected:
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
+public:
+    /// Get the spent state of a collateral, returns false if it could not be determined right now
+    bool IsSpent(const CTxIn& vin, int nCollateral, bool& fSpentRet);
+    /// Get the height at which a collateral was confirmed, same as GetInputHeight()
+    int GetHeight(const CTxIn& vin);
+
+    /// Stop tracking a collateral
+    void Forget(const COutPoint& outpoint);
+    void Clear();
+
+    int size() const;
+};
+
+#endif
@@ -6,8 +6,29 @@
 
 #include "crypto/common.h"
 
+#include <assert.h>
 #include <string.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__))
+#define USE_X86_SHA256
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+void TransformMidstate_4way(unsigned char* out, const uint32_t* midstates, const unsigned char* in);
+}
+
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+void TransformMidstate_8way(unsigned char* out, const uint32_t* midstates, const unsigned char* in);
+}
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -127,7 +148,156 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+/** Perform a number of SHA-256 transformations, processing consecutive 64-byte chunks. */
+void TransformBlocks(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        Transform(s, chunk);
+        chunk += 64;
+    }
+}
+
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+typedef void (*TransformDMidstateType)(unsigned char*, const uint32_t*, const unsigned char*);
+
+/** Double SHA-256 of one 64-byte input on top of a single buffer transform. */
+template<TransformType tr>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+/** Double SHA-256 of one message from its state before the padded last block in, on top of a single buffer transform. */
+template<TransformType tr>
+void TransformDMidstateWrapper(unsigned char* out, const uint32_t* midstate, const unsigned char* in)
+{
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    uint32_t s[8];
+    memcpy(s, midstate, sizeof(s));
+    tr(s, in, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+TransformType Transform = sha256::TransformBlocks;
+TransformD64Type TransformD64 = TransformD64Wrapper<sha256::TransformBlocks>;
+TransformD64Type TransformD64_4way = NULL;
+TransformD64Type TransformD64_8way = NULL;
+TransformDMidstateType TransformDMidstate = TransformDMidstateWrapper<sha256::TransformBlocks>;
+TransformDMidstateType TransformDMidstate_4way = NULL;
+TransformDMidstateType TransformDMidstate_8way = NULL;
+
+/** Check the selected implementations against the portable one on a fixed set of 8 inputs. */
+bool SelfTest()
+{
+    unsigned char in[64 * 8], out[32 * 8], expected[32 * 8];
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = (unsigned char)(i * 7 + (i >> 6));
+    for (int i = 0; i < 8; i++)
+        TransformD64Wrapper<sha256::TransformBlocks>(expected + 32 * i, in + 64 * i);
+
+    for (int i = 0; i < 8; i++)
+        TransformD64(out + 32 * i, in + 64 * i);
+    if (memcmp(out, expected, sizeof(out)))
+        return false;
+
+    // Several blocks at once through the single buffer transform
+    uint32_t s1[8], s2[8];
+    sha256::Initialize(s1);
+    sha256::Initialize(s2);
+    sha256::TransformBlocks(s1, in, 8);
+    Transform(s2, in, 8);
+    if (memcmp(s1, s2, sizeof(s1)))
+        return false;
+
+    if (TransformD64_4way) {
+        TransformD64_4way(out, in);
+        TransformD64_4way(out + 128, in + 256);
+        if (memcmp(out, expected, sizeof(out)))
+            return false;
+    }
+    if (TransformD64_8way) {
+        TransformD64_8way(out, in);
+        if (memcmp(out, expected, sizeof(out)))
+            return false;
+    }
+
+    // The same hashes from the states after the inputs, finished with their padding blocks
+    unsigned char padding[64 * 8] = {};
+    for (int i = 0; i < 8; i++) {
+        padding[64 * i] = 0x80;
+        padding[64 * i + 62] = 2;
+    }
+    uint32_t midstates[8 * 8];
+    for (int i = 0; i < 8; i++) {
+        sha256::Initialize(midstates + 8 * i);
+        sha256::TransformBlocks(midstates + 8 * i, in + 64 * i, 1);
+    }
+    for (int i = 0; i < 8; i++)
+        TransformDMidstate(out + 32 * i, midstates + 8 * i, padding + 64 * i);
+    if (memcmp(out, expected, sizeof(out)))
+        return false;
+    if (TransformDMidstate_4way) {
+        TransformDMidstate_4way(out, midstates, padding);
+        TransformDMidstate_4way(out + 128, midstates + 32, padding + 256);
+        if (memcmp(out, expected, sizeof(out)))
+            return false;
+    }
+    if (TransformDMidstate_8way) {
+        TransformDMidstate_8way(out, midstates, padding);
+        if (memcmp(out, expected, sizeof(out)))
+            return false;
+    }
+    return true;
+}
+
+#if defined(USE_X86_SHA256)
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+}
+
+/** Check whether the OS saves the YMM registers, so AVX can be used. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__ ("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
 } // namespace
 
 
@@ -147,14 +317,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
+        size_t blocks = (end - data) / 64;
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        Transform(s, data, blocks);
+        bytes += 64 * blocks;
+        data += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -181,9 +352,110 @@ void CSHA256::Finalize(unsigned char hash[OUTPUT_SIZE])
     WriteBE32(hash + 28, s[7]);
 }
 
+void CSHA256::GetMidstate(uint32_t state[8]) const
+{
+    assert(bytes % 64 == 0);
+    memcpy(state, s, sizeof(s));
+}
+
 CSHA256& CSHA256::Reset()
 {
     bytes = 0;
     sha256::Initialize(s);
     return *this;
 }
+
+std::string SHA256AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_X86_SHA256)
+    uint32_t eax, ebx, ecx, edx;
+    bool have_sse4 = false, have_avx2 = false, have_shani = false;
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    uint32_t nMaxLeaf = eax;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    have_sse4 = (ecx >> 19) & 1;
+    bool have_xsave = (ecx >> 27) & 1;
+    bool have_avx = (ecx >> 28) & 1;
+    if (have_sse4 && nMaxLeaf >= 7) {
+        cpuid(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = ((ebx >> 5) & 1) && have_xsave && have_avx && AVXEnabled();
+        have_shani = (ebx >> 29) & 1;
+    }
+
+    if (have_shani) {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        TransformDMidstate = TransformDMidstateWrapper<sha256_shani::Transform>;
+        ret = "shani(1way)";
+    }
+    if (have_sse4) {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformDMidstate_4way = sha256d64_sse41::TransformMidstate_4way;
+        ret += ",sse41(4way)";
+    }
+    if (have_avx2) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformDMidstate_8way = sha256d64_avx2::TransformMidstate_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
+
+void SHA256DMidstate(unsigned char* out, const uint32_t* midstates, const unsigned char* in, size_t blocks)
+{
+    if (TransformDMidstate_8way) {
+        while (blocks >= 8) {
+            TransformDMidstate_8way(out, midstates, in);
+            out += 256;
+            midstates += 64;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformDMidstate_4way) {
+        while (blocks >= 4) {
+            TransformDMidstate_4way(out, midstates, in);
+            out += 128;
+            midstates += 32;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformDMidstate(out, midstates, in);
+        out += 32;
+        midstates += 8;
+        in += 64;
+        --blocks;
+    }
+}
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -23,6 +24,28 @@ public:
     CSHA256& Write(const unsigned char* data, size_t len);
     void Finalize(unsigned char hash[OUTPUT_SIZE]);
     CSHA256& Reset();
+    //! The state words after the data written so far, which must be a multiple of 64 bytes long
+    void GetMidstate(uint32_t state[8]) const;
 };
 
+/** Autodetect the best available SHA256 implementation.
+ *  Returns the name of the implementation.
+ */
+std::string SHA256AutoDetect();
+
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Compute multiple double-SHA256's of messages that only need their last block hashed.
+ *  output:    pointer to a blocks*32 byte output buffer
+ *  midstates: pointer to blocks*8 state words, each from CSHA256::GetMidstate after all but the last block
+ *  input:     pointer to a blocks*64 byte input buffer, the last block of each message with its padding
+ *  blocks:    the number of hashes to compute.
+ */
+void SHA256DMidstate(unsigned char* output, const uint32_t* midstates, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -16,6 +16,7 @@
 #include "auxpow.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "miner.h"
@@ -27,6 +28,7 @@
 #include "ui_interface.h"
 #include "util.h"
 #include "activemasternode.h"
+#include "collateraltracker.h"
 #include "activesystemnode.h"
 #include "masternode-budget.h"
 #include "masternode-payments.h"
@@ -303,6 +305,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += "  -?                     " + _("This help message") + "\n";
     strUsage += "  -alertnotify=<cmd>     " + _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)") + "\n";
     strUsage += "  -alerts                " + strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS);
+    strUsage += "  -blockmsgcachesize=<n> " + strprintf(_("Keep the last <n> blocks requested by peers ready to send, 0 reads every block from disk (default: %u)"), DEFAULT_BLOCK_MESSAGE_CACHE_SIZE) + "\n";
     strUsage += "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n";
     strUsage += "  -checkblocks=<n>       " + strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), 288) + "\n";
     strUsage += "  -checklevel=<n>        " + strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), 3) + "\n";
@@ -314,11 +317,15 @@ std::string HelpMessage(HelpMessageMode mode)
 #endif
     }
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
+    strUsage += "  -dbbackgroundflush     " + strprintf(_("Write the UTXO cache to disk from a background thread, memory use can reach twice -dbcache (default: %u)"), DEFAULT_DB_BACKGROUND_FLUSH) + "\n";
     strUsage += "  -dbcache=<n>           " + strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache) + "\n";
+    strUsage += "  -headersfirst          " + strprintf(_("Sync the block headers first and download the blocks from all peers in parallel during initial sync (default: %u)"), DEFAULT_HEADERS_FIRST) + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + " " + _("on startup") + "\n";
     strUsage += "  -maxreorg=<n>          " + strprintf(_("Set the Maximum reorg depth (default: %u)"), Params(CBaseChainParams::MAIN).MaxReorganizationDepth()) + "\n";
     strUsage += "  -maxorphantx=<n>       " + strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS) + "\n";
     strUsage += "  -par=<n>               " + strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -parmempool=<n>        " + strprintf(_("Set the number of script verification threads for transactions entering the memory pool (%u to %d, 0 = auto, <0 = leave that many cores free, default: same as -par)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -parsigner=<n>         " + strprintf(_("Set the number of threads verifying the signatures of masternode messages (%u to %d, 0 = auto, <0 = leave that many cores free, default: same as -par)"), -(int)boost::thread::hardware_concurrency(), MAX_SCRIPTCHECK_THREADS) + "\n";
 #ifndef WIN32
     strUsage += "  -pid=<file>            " + strprintf(_("Specify pid file (default: %s)"), "crownd.pid") + "\n";
 #endif
@@ -343,12 +350,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += "  -maxconnections=<n>    " + strprintf(_("Maintain at most <n> connections to peers (default: %u)"), 125) + "\n";
     strUsage += "  -maxreceivebuffer=<n>  " + strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), 5000) + "\n";
     strUsage += "  -maxsendbuffer=<n>     " + strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), 1000) + "\n";
+    strUsage += "  -msghandlerthreads=<n> " + strprintf(_("Process the messages of different peers on up to <n> threads (1 to %d, default: %d)"), MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS) + "\n";
     strUsage += "  -onion=<ip:port>       " + strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy") + "\n";
     strUsage += "  -onlynet=<net>         " + _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)") + "\n";
     strUsage += "  -permitbaremultisig    " + strprintf(_("Relay non-P2SH multisig (default: %u)"), 1) + "\n";
     strUsage += "  -port=<port>           " + strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), 9340, 19340) + "\n";
     strUsage += "  -proxy=<ip:port>       " + _("Connect through SOCKS5 proxy") + "\n";
     strUsage += "  -seednode=<ip>         " + _("Connect to a node to retrieve peer addresses, and disconnect") + "\n";
+#ifdef HAVE_SYS_EPOLL_H
+    strUsage += "  -socketevents=<mode>   " + strprintf(_("Wait for socket events with <mode>, 'select' or 'epoll', epoll is not limited to %u connections (default: %s)"), FD_SETSIZE, DEFAULT_SOCKETEVENTS) + "\n";
+#endif
     strUsage += "  -timeout=<n>           " + strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT) + "\n";
 #ifdef USE_UPNP
 #if USE_UPNP
@@ -417,6 +428,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += "  -limitfreerelay=<n>    " + strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), 15) + "\n";
         strUsage += "  -relaypriority         " + strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), 1) + "\n";
         strUsage += "  -maxsigcachesize=<n>   " + strprintf(_("Limit size of signature cache to <n> MiB entries (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE) + "\n";
+        strUsage += "  -maxmnsigcachesize=<n> " + strprintf(_("Limit size of the masternode message signature cache to <n> MiB entries (default: %u)"), DEFAULT_MAX_LEGACYSIGNER_CACHE_SIZE) + "\n";
     }
     strUsage += "  -minrelaytxfee=<amt>   " + strprintf(_("Fees (in CRW/Kb) smaller than this are considered zero fee for relaying (default: %s)"), FormatMoney(::minRelayTxFee.GetFeePerK())) + "\n";
     strUsage += "  -printtoconsole        " + strprintf(_("Send trace/debug info to console instead of debug.log file (default: %u)"), 0) + "\n";
@@ -468,11 +480,14 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += "  -rpcpassword=<pw>      " + _("Password for JSON-RPC connections") + "\n";
     strUsage += "  -rpcport=<port>        " + strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), 9341, 19341) + "\n";
     strUsage += "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times") + "\n";
-    strUsage += "  -rpcthreads=<n>        " + strprintf(_("Set the number of threads to service RPC calls (default: %d)"), 4) + "\n";
+    strUsage += "  -rpcthreads=<n>        " + strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_RPC_THREADS) + "\n";
+    strUsage += "  -rpcworkqueue=<n>      " + strprintf(_("Set the depth of the work queue to service RPC calls (default: %d)"), DEFAULT_RPC_WORK_QUEUE) + "\n";
+    strUsage += "  -rpcservertimeout=<n>  " + strprintf(_("Timeout in seconds for RPC clients to send a request, idle connections are closed after it (default: %d)"), DEFAULT_RPC_SERVER_TIMEOUT) + "\n";
     strUsage += "  -rpckeepalive          " + strprintf(_("RPC support for HTTP persistent connections (default: %d)"), 1) + "\n";
 
     strUsage += "\n" + _("Platform options:") + "\n";
     strUsage += "  -platformoptram=<n>            " + strprintf(_("Optimize the platform server RAM usage (but respond much slower) or optimize speed (server latency) (0-1, default: %u)"), 0) + "\n";
+    strUsage += "  -nftindexcachesize=<n>         " + strprintf(_("Number of NFT index records cached in memory with -platformoptram, 0 reads every record from disk (default: %u)"), Platform::DEFAULT_NFT_INDEX_CACHE_SIZE) + "\n";
 
     strUsage += "\n" + _("RPC SSL options: (see the Bitcoin Wiki for SSL setup instructions)") + "\n";
     strUsage += "  -rpcssl                                  " + _("Use OpenSSL (https) for JSON-RPC connections") + "\n";
@@ -800,10 +815,24 @@ bool AppInit2(boost::thread_group& threadGroup)
             LogPrintf("AppInit2 : parameter interaction: -enableinstantx=false -> setting -nInstantXDepth=0\n");
     }
 
+    std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEvents == "epoll") {
+#ifdef HAVE_SYS_EPOLL_H
+        fSocketEventsEpoll = true;
+#else
+        return InitError(_("-socketevents=epoll is not supported on this platform."));
+#endif
+    } else if (strSocketEvents != "select") {
+        return InitError(strprintf(_("Unknown socket events mode -socketevents=%s."), strSocketEvents));
+    }
+
     // Make sure enough file descriptors are available
     int nBind = std::max((int)mapArgs.count("-bind") + (int)mapArgs.count("-whitebind"), 1);
     nMaxConnections = GetArg("-maxconnections", 125);
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    // select() can't wait for descriptors beyond FD_SETSIZE
+    if (!fSocketEventsEpoll)
+        nMaxConnections = std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS));
+    nMaxConnections = std::max(nMaxConnections, 0);
     int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -845,6 +874,9 @@ bool AppInit2(boost::thread_group& threadGroup)
     fCheckBlockIndex = GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
     Checkpoints::fEnabled = GetBoolArg("-checkpoints", true);
 
+    SetBlockMessageCacheSize(std::max((int64_t)0, GetArg("-blockmsgcachesize", (int64_t)DEFAULT_BLOCK_MESSAGE_CACHE_SIZE)));
+    fHeadersFirst = GetBoolArg("-headersfirst", DEFAULT_HEADERS_FIRST);
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -854,6 +886,22 @@ bool AppInit2(boost::thread_group& threadGroup)
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nMempoolScriptCheckThreads = GetArg("-parmempool", GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS));
+    if (nMempoolScriptCheckThreads <= 0)
+        nMempoolScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nMempoolScriptCheckThreads <= 1)
+        nMempoolScriptCheckThreads = 0;
+    else if (nMempoolScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nMempoolScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+
+    nLegacySignerThreads = GetArg("-parsigner", GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS));
+    if (nLegacySignerThreads <= 0)
+        nLegacySignerThreads += boost::thread::hardware_concurrency();
+    if (nLegacySignerThreads <= 1)
+        nLegacySignerThreads = 0;
+    else if (nLegacySignerThreads > MAX_SCRIPTCHECK_THREADS)
+        nLegacySignerThreads = MAX_SCRIPTCHECK_THREADS;
+
     fServer = GetBoolArg("-server", false);
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 #ifdef ENABLE_WALLET
@@ -930,6 +978,9 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -979,6 +1030,16 @@ bool AppInit2(boost::thread_group& threadGroup)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    LogPrintf("Using %u threads for mempool script verification\n", nMempoolScriptCheckThreads);
+    if (nMempoolScriptCheckThreads) {
+        for (int i=0; i<nMempoolScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadMempoolScriptCheck);
+    }
+
+    // Unlike the script checks the message handler does not verify itself, so all of them are workers
+    for (int i=0; i<nLegacySignerThreads; i++)
+        threadGroup.create_thread(&ThreadLegacySignerQueue);
+
     if (mapArgs.count("-sporkkey")) // spork priv key
     {
         if (!sporkManager.SetPrivKey(GetArg("-sporkkey", "")))
@@ -1259,6 +1320,7 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     bool platformOptRam = GetBoolArg("-platformoptram", false);
     Platform::PlatformOpt opt = platformOptRam ? Platform::PlatformOpt::OptRam : Platform::PlatformOpt::OptSpeed;
+    std::size_t nNftIndexCacheSize = std::max((int64_t)0, GetArg("-nftindexcachesize", (int64_t)Platform::DEFAULT_NFT_INDEX_CACHE_SIZE));
 
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
@@ -1295,7 +1357,7 @@ bool AppInit2(boost::thread_group& threadGroup)
                 delete pblocktree;
                 Platform::PlatformDb::DestroyInstance();
 
-                Platform::PlatformDb::CreateInstance(nPlatformDbCache, opt, false, fReindex);
+                Platform::PlatformDb::CreateInstance(nPlatformDbCache, opt, false, fReindex, nNftIndexCacheSize);
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
@@ -1304,6 +1366,13 @@ bool AppInit2(boost::thread_group& threadGroup)
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
 
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+                if (GetBoolArg("-dbbackgroundflush", DEFAULT_DB_BACKGROUND_FLUSH))
+                    pcoinsdbview->StartBackgroundFlush();
+
                 if (!LoadBlockIndex()) {
                     strLoadError = _("Error loading block database");
                     break;
@@ -1323,6 +1392,10 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
 
+                // Databases written by older versions have no NFT owner index yet
+                if (!Platform::PlatformDb::Instance().IsNftOwnerIndexBuilt())
+                    Platform::PlatformDb::Instance().BuildNftOwnerIndex();
+
                 // Check for changed -txindex state
                 if (fTxIndex != GetBoolArg("-txindex", true)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
@@ -1338,6 +1411,11 @@ bool AppInit2(boost::thread_group& threadGroup)
                     break;
                 }
                 fVerifying = false;
+
+                if (!LoadPaymentIndex()) {
+                    strLoadError = _("Error loading the payment index");
+                    break;
+                }
             } catch(std::exception &e) {
                 if (fDebug) LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1545,6 +1623,8 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     // ********************************************************* Step 10: setup Budgets
 
+    RegisterValidationInterface(&collateralTracker);
+
     if (!LoadData())
         return false;
 
@@ -6,6 +6,8 @@
 #include "legacysigner.h"
 #include "main.h"
 #include "init.h"
+#include "memusage.h"
+#include "random.h"
 #include "util.h"
 #include "masternodeman.h"
 #include "script/sign.h"
@@ -17,15 +19,106 @@
 #include <boost/lexical_cast.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <boost/assign/list_of.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/unordered_map.hpp>
 #include <openssl/rand.h>
 
 using namespace std;
 using namespace boost;
 
+namespace {
+
+class CLegacySignatureCacheHasher
+{
+public:
+    size_t operator()(const uint256& key) const {
+        return key.GetCheapHash();
+    }
+};
+
+/**
+ * Cache of verified Masternode message signatures, like script/sigcache.cpp for transactions.
+ * The same broadcasts, pings and votes are received from several peers and verified again
+ * when the managers clean up, which costs a public key recovery each time.
+ */
+class CLegacySignatureCache
+{
+private:
+    //! Entries are SHA256(nonce || message hash || signature), mapped to the id of the recovered key
+    uint256 nonce;
+    typedef boost::unordered_map<uint256, CKeyID, CLegacySignatureCacheHasher> map_type;
+    map_type mapValid;
+    mutable boost::shared_mutex cs_sigcache;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+public:
+    CLegacySignatureCache() : nHits(0), nMisses(0)
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig) const
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry, CKeyID& keyID)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        map_type::const_iterator it = mapValid.find(entry);
+        if (it == mapValid.end()) {
+            nMisses++;
+            return false;
+        }
+        nHits++;
+        keyID = it->second;
+        return true;
+    }
+
+    void Set(const uint256& entry, const CKeyID& keyID)
+    {
+        size_t nMaxCacheSize = GetArg("-maxmnsigcachesize", DEFAULT_MAX_LEGACYSIGNER_CACHE_SIZE) * ((size_t) 1 << 20);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        while (memusage::DynamicUsage(mapValid) > nMaxCacheSize)
+        {
+            map_type::size_type s = GetRand(mapValid.bucket_count());
+            map_type::local_iterator it = mapValid.begin(s);
+            if (it != mapValid.end(s)) {
+                mapValid.erase(it->first);
+            }
+        }
+
+        mapValid.insert(std::make_pair(entry, keyID));
+    }
+
+    CLegacySignerCacheStats GetStats() const
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        CLegacySignerCacheStats stats;
+        stats.nEntries = mapValid.size();
+        stats.nUsage = memusage::DynamicUsage(mapValid);
+        stats.nHits = nHits;
+        stats.nMisses = nMisses;
+        return stats;
+    }
+};
+
+CLegacySignatureCache signatureCache;
+
+}
+
 // A helper object for signing messages from Masternodes
 CLegacySigner legacySigner;
 
+// Verifies the signatures of incoming Masternode messages
+CLegacySignerQueue legacySignerQueue;
+int nLegacySignerThreads = 0;
+
 // Keep track of the active Masternode
 CActiveMasternode activeMasternode;
 
@@ -91,16 +184,28 @@ bool CLegacySigner::VerifyMessage(CPubKey pubkey, const vector<unsigned char>& v
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    uint256 hash = ss.GetHash();
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
-        errorMessage = _("Error recovering public key.");
-        return false;
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, hash, vchSig);
+
+    CKeyID keyID;
+    if (!signatureCache.Get(entry, keyID)) {
+        CPubKey pubkey2;
+        if (!pubkey2.RecoverCompact(hash, vchSig)) {
+            errorMessage = _("Error recovering public key.");
+            return false;
+        }
+        keyID = pubkey2.GetID();
+
+        // Only successful verifications are cached, so peers can't fill it with garbage
+        if (keyID == pubkey.GetID())
+            signatureCache.Set(entry, keyID);
     }
 
-    if (pubkey2.GetID() != pubkey.GetID()) {
+    if (keyID != pubkey.GetID()) {
         errorMessage = strprintf("keys don't match - input: %s, recovered: %s, message: %s, sig: %s\n",
-                    pubkey.GetID().ToString(), pubkey2.GetID().ToString(), strMessage,
+                    pubkey.GetID().ToString(), keyID.ToString(), strMessage,
                     EncodeBase64(&vchSig[0], vchSig.size()));
         return false;
     }
@@ -108,6 +213,121 @@ bool CLegacySigner::VerifyMessage(CPubKey pubkey, const vector<unsigned char>& v
     return true;
 }
 
+CLegacySignerCacheStats CLegacySigner::GetCacheStats() const
+{
+    return signatureCache.GetStats();
+}
+
+bool CLegacySignerQueue::Verify(const std::vector<CSignedMessage>& vMessages)
+{
+    std::string errorMessage;
+    BOOST_FOREACH(const CSignedMessage& message, vMessages) {
+        if(!legacySigner.VerifyMessage(message.pubkey, message.vchSig, message.strMessage, errorMessage))
+            return false;
+    }
+    return true;
+}
+
+void CLegacySignerQueue::Push(CNode* pfrom, const std::vector<CSignedMessage>& vMessages, const Handler& handler)
+{
+    std::shared_ptr<CEntry> entry(new CEntry());
+    entry->pfrom = pfrom;
+    entry->vMessages = vMessages;
+    entry->handler = handler;
+    entry->nState = 0;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if(nWorkers == 0) {
+            lock.unlock();
+            handler(pfrom, Verify(vMessages));
+            return;
+        }
+
+        {
+            LOCK(cs_vNodes);
+            pfrom->AddRef();
+        }
+        queuePending.push_back(entry);
+        if(queueUnverified.size() < MAX_LEGACYSIGNER_QUEUE_SIZE) {
+            queueUnverified.push_back(entry);
+            condWorker.notify_one();
+            return;
+        }
+    }
+
+    // The workers are falling behind, verify it here and let ProcessVerified keep the order
+    bool fValid = Verify(vMessages);
+    boost::unique_lock<boost::mutex> lock(mutex);
+    entry->nState = fValid ? 1 : -1;
+}
+
+int CLegacySignerQueue::ProcessVerified()
+{
+    std::vector<std::shared_ptr<CEntry> > vVerified;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while(!queuePending.empty() && queuePending.front()->nState != 0) {
+            vVerified.push_back(queuePending.front());
+            queuePending.pop_front();
+        }
+    }
+
+    BOOST_FOREACH(const std::shared_ptr<CEntry>& entry, vVerified) {
+        {
+            // the handlers finish what the message handlers started
+            LOCK(cs_extensionMessages);
+            entry->handler(entry->pfrom, entry->nState > 0);
+        }
+        LOCK(cs_vNodes);
+        entry->pfrom->Release();
+    }
+
+    return vVerified.size();
+}
+
+size_t CLegacySignerQueue::size()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queuePending.size();
+}
+
+void CLegacySignerQueue::Thread()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWorkers++;
+    }
+
+    try {
+        while(true) {
+            std::shared_ptr<CEntry> entry;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while(queueUnverified.empty())
+                    condWorker.wait(lock);
+                entry = queueUnverified.front();
+                queueUnverified.pop_front();
+            }
+
+            bool fValid = Verify(entry->vMessages);
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            entry->nState = fValid ? 1 : -1;
+        }
+    } catch(const boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        nWorkers--;
+        throw;
+    }
+}
+
+void ThreadLegacySignerQueue()
+{
+    RenameThread("crown-sigverify");
+    legacySignerQueue.Thread();
+}
+
 //TODO: Rename/move to core
 void ThreadCheckLegacySigner()
 {
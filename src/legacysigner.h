@@ -17,6 +17,13 @@
 #include "systemnode-payments.h"
 #include "systemnode-sync.h"
 
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CTxIn;
 class CLegacySigner;
 class CMasterNodeVote;
@@ -28,10 +35,29 @@ class CActiveMasternode;
 #define MASTERNODE_REJECTED                    0
 #define MASTERNODE_RESET                       -1
 
+/** Messages waiting for a worker before the message handler verifies them itself */
+static const unsigned int MAX_LEGACYSIGNER_QUEUE_SIZE = 10000;
+/** Default for -maxmnsigcachesize, the size of the cache of verified Masternode message signatures in MiB */
+static const unsigned int DEFAULT_MAX_LEGACYSIGNER_CACHE_SIZE = 10;
+
+class CLegacySignerQueue;
+
 extern CLegacySigner legacySigner;
+extern CLegacySignerQueue legacySignerQueue;
+extern int nLegacySignerThreads;
 extern std::string strMasterNodePrivKey;
 extern CActiveMasternode activeMasternode;
 
+/** Usage of the cache of verified Masternode message signatures
+ */
+struct CLegacySignerCacheStats
+{
+    size_t nEntries;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+};
+
 /** Helper object for signing and checking signatures
  */
 class CLegacySigner
@@ -47,8 +73,9 @@ public:
     bool SetKey(std::string strSecret, std::string& errorMessage, CKey& key, CPubKey& pubkey);
     /// Sign the message, returns true if successful
     bool SignMessage(std::string strMessage, std::string& errorMessage, std::vector<unsigned char>& vchSig, CKey key);
-    /// Verify the message, returns true if succcessful
+    /// Verify the message, returns true if succcessful. Successful verifications are cached.
     bool VerifyMessage(CPubKey pubkey, const std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
+    CLegacySignerCacheStats GetCacheStats() const;
     // where collateral should be made out to
     CScript collateralPubKey;
     CMasternode* pSubmittedToMasternode;
@@ -68,6 +95,67 @@ public:
     static bool VerifyHash(const uint256& hash, const CKeyID& keyID, const std::vector<unsigned char>& vchSig, std::string& strErrorRet);
 };
 
+/** A message signed by a Masternode, as checked by CLegacySigner::VerifyMessage
+ */
+struct CSignedMessage
+{
+    CPubKey pubkey;
+    std::vector<unsigned char> vchSig;
+    std::string strMessage;
+
+    CSignedMessage(const CPubKey& pubkeyIn, const std::vector<unsigned char>& vchSigIn, const std::string& strMessageIn)
+        : pubkey(pubkeyIn), vchSig(vchSigIn), strMessage(strMessageIn) {}
+};
+
+/** Verifies the signatures of Masternode network messages on worker threads
+ *
+ * The message handler pushes the signed parts of a message together with a handler that applies it.
+ * ProcessVerified() later runs the handlers of the verified messages on the message handler thread,
+ * in the order they were pushed, under cs_extensionMessages and the lock of the owning manager just like
+ * the message processing itself. Without worker threads a message is verified and handled right away.
+ */
+class CLegacySignerQueue
+{
+public:
+    typedef std::function<void (CNode* pfrom, bool fValid)> Handler;
+
+private:
+    struct CEntry
+    {
+        CNode* pfrom;
+        std::vector<CSignedMessage> vMessages;
+        Handler handler;
+        int nState; // 0 = not verified yet, 1 = valid, -1 = invalid
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    // entries no worker picked up yet
+    std::deque<std::shared_ptr<CEntry> > queueUnverified;
+    // entries whose handler did not run yet, in the order they were pushed
+    std::deque<std::shared_ptr<CEntry> > queuePending;
+    int nWorkers;
+
+    static bool Verify(const std::vector<CSignedMessage>& vMessages);
+
+public:
+    CLegacySignerQueue() : nWorkers(0) {}
+
+    /// Verify all the signed parts of a message, then call handler with pfrom and the outcome
+    void Push(CNode* pfrom, const std::vector<CSignedMessage>& vMessages, const Handler& handler);
+    void Push(CNode* pfrom, const CSignedMessage& message, const Handler& handler)
+    {
+        Push(pfrom, std::vector<CSignedMessage>(1, message), handler);
+    }
+    /// Run the handlers of the messages verified so far, returns how many were handled
+    int ProcessVerified();
+    /// Number of messages whose handler did not run yet
+    size_t size();
+    /// Worker thread, runs until interrupted
+    void Thread();
+};
+
 void ThreadCheckLegacySigner();
+void ThreadLegacySignerQueue();
 
 #endif
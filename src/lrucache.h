@@ -0,0 +1,84 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LRUCACHE_H
+#define BITCOIN_LRUCACHE_H
+
+#include <list>
+#include <map>
+#include <utility>
+
+/** STL-like map container that only keeps the N most recently used elements. A maximum size of 0 keeps nothing. */
+template <typename K, typename V>
+class lrucache
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const key_type, mapped_type> value_type;
+    typedef typename std::list<value_type>::size_type size_type;
+
+protected:
+    // Most recently used element first
+    std::list<value_type> items;
+    typedef typename std::list<value_type>::iterator iterator;
+    std::map<K, iterator> index;
+    size_type nMaxSize;
+
+    void trim()
+    {
+        while (items.size() > nMaxSize) {
+            index.erase(items.back().first);
+            items.pop_back();
+        }
+    }
+
+public:
+    lrucache(size_type nMaxSizeIn = 0) { nMaxSize = nMaxSizeIn; }
+    size_type size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+    size_type count(const key_type& k) const { return index.count(k); }
+    /** Copy the element into v and mark it as most recently used */
+    bool get(const key_type& k, mapped_type& v)
+    {
+        typename std::map<K, iterator>::iterator it = index.find(k);
+        if (it == index.end())
+            return false;
+        items.splice(items.begin(), items, it->second);
+        v = it->second->second;
+        return true;
+    }
+    /** Insert or replace an element, evicting the least recently used one when full */
+    void insert(const key_type& k, const mapped_type& v)
+    {
+        erase(k);
+        if (nMaxSize == 0)
+            return;
+        items.push_front(value_type(k, v));
+        index.insert(std::make_pair(k, items.begin()));
+        trim();
+    }
+    void erase(const key_type& k)
+    {
+        typename std::map<K, iterator>::iterator it = index.find(k);
+        if (it == index.end())
+            return;
+        items.erase(it->second);
+        index.erase(it);
+    }
+    void clear()
+    {
+        items.clear();
+        index.clear();
+    }
+    size_type max_size() const { return nMaxSize; }
+    size_type max_size(size_type s)
+    {
+        nMaxSize = s;
+        trim();
+        return nMaxSize;
+    }
+};
+
+#endif // BITCOIN_LRUCACHE_H
@@ -11,11 +11,13 @@
 #include "addrman.h"
 #include "alert.h"
 #include "auxpow.h"
+#include "blockencodings.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "init.h"
 #include "instantx.h"
+#include "lrucache.h"
 #include "masternodeman.h"
 #include "masternode-payments.h"
 #include "masternode-budget.h"
@@ -41,6 +43,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
 #include <mn-pos/blockwitness.h>
+#include <mn-pos/paymentindex.h>
 #include <mn-pos/prooftracker.h>
 #include <mn-pos/stakevalidation.h>
 #include <mn-pos/stakepointer.h>
@@ -62,17 +65,20 @@ BlockMap mapBlockIndex;
 CChain chainActive;
 std::map<PointerHash, uint256> mapUsedStakePointers;
 ProofTracker* g_proofTracker = new ProofTracker();
+PaymentIndex* g_paymentIndex = new PaymentIndex();
 CBlockIndex *pindexBestHeader = NULL;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nMempoolScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fVerifying = false;
 bool fTxIndex = true;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
+bool fHeadersFirst = DEFAULT_HEADERS_FIRST;
 size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 int nLastStakeAttempt = 0;
@@ -175,6 +181,13 @@ namespace {
     /** Number of preferable block download peers. */
     int nPreferredDownload = 0;
 
+    /** Peers we asked to announce new blocks as compact blocks, least recently useful first. Protected by cs_main. */
+    list<NodeId> lNodesAnnouncingHeaderAndIDs;
+
+    /** Blocks connected to the active chain and bytes of block data received, for getsyncinfo. Protected by cs_main. */
+    CRollingRate rateBlocksConnected(SYNC_RATE_WINDOW);
+    CRollingRate rateBlockBytes(SYNC_RATE_WINDOW);
+
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
@@ -291,6 +304,12 @@ struct CNodeState {
     int nBlocksInFlightValidHeaders;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! The compact block from this peer that is waiting for the transactions we asked for with getblocktxn.
+    std::shared_ptr<PartiallyDownloadedBlock> partialBlock;
+    uint256 hashPartialBlock;
+    //! Blocks and bytes of block data received from this peer.
+    uint64_t nBlocksReceived;
+    uint64_t nBlockBytesReceived;
 
     CNodeState() {
         fCurrentlyConnected = false;
@@ -304,6 +323,8 @@ struct CNodeState {
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
         fPreferredDownload = false;
+        nBlocksReceived = 0;
+        nBlockBytesReceived = 0;
     }
 };
 
@@ -365,10 +386,19 @@ void FinalizeNode(NodeId nodeid) {
         mapBlocksInFlight.erase(entry.hash);
     EraseOrphansFor(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
+    lNodesAnnouncingHeaderAndIDs.remove(nodeid);
 
     mapNodeState.erase(nodeid);
 }
 
+// Requires cs_main.
+void RecordBlockBytes(NodeId nodeid, unsigned int nBytes) {
+    CNodeState *state = State(nodeid);
+    assert(state != NULL);
+    state->nBlockBytesReceived += nBytes;
+    rateBlockBytes.Add(GetTime(), nBytes);
+}
+
 // Requires cs_main.
 void MarkBlockAsReceived(const uint256& hash) {
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
@@ -488,6 +518,9 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    // A MN-PoS block is only accepted once the block its stake pointer comes from, at least MaxReorganizationDepth
+    // blocks back, is in the active chain. Don't run further ahead of the tip than that.
+    nWindowEnd = std::min(nWindowEnd, std::max(Params().PoSStartHeight(), chainActive.Height() + Params().MaxReorganizationDepth()));
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -549,9 +582,58 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.nBlocksReceived = state->nBlocksReceived;
+    stats.nBlockBytesReceived = state->nBlockBytesReceived;
+    stats.nStallingSince = state->nStallingSince;
     return true;
 }
 
+void GetBlockDownloadStats(CBlockDownloadStats& stats) {
+    LOCK(cs_main);
+    stats.nBlocksInFlight = mapBlocksInFlight.size();
+    stats.nPeersDownloading = 0;
+    stats.nPeersStalling = 0;
+    BOOST_FOREACH(const PAIRTYPE(NodeId, CNodeState)& item, mapNodeState) {
+        stats.nPeersDownloading += item.second.nBlocksInFlight > 0;
+        stats.nPeersStalling += item.second.nStallingSince != 0;
+    }
+    int64_t nNow = GetTime();
+    stats.dBlocksPerSec = rateBlocksConnected.GetRate(nNow);
+    stats.dBytesPerSec = rateBlockBytes.GetRate(nNow);
+}
+
+CRollingRate::CRollingRate(int64_t nWindowIn) : nWindow(nWindowIn), nStart(0), nSum(0)
+{
+}
+
+void CRollingRate::Expire(int64_t nNow)
+{
+    while (!vSamples.empty() && vSamples.front().first <= nNow - nWindow) {
+        nSum -= vSamples.front().second;
+        vSamples.pop_front();
+    }
+}
+
+void CRollingRate::Add(int64_t nTime, uint64_t nValue)
+{
+    if (nStart == 0)
+        nStart = nTime;
+    if (!vSamples.empty() && vSamples.back().first == nTime)
+        vSamples.back().second += nValue;
+    else
+        vSamples.push_back(std::make_pair(nTime, nValue));
+    nSum += nValue;
+    Expire(nTime);
+}
+
+double CRollingRate::GetRate(int64_t nNow)
+{
+    Expire(nNow);
+    if (nStart == 0)
+        return 0;
+    return (double)nSum / std::max(std::min(nWindow, nNow - nStart), (int64_t)1);
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
@@ -1066,6 +1148,38 @@ CAmount GetMinRelayFee(const CTransaction& tx, unsigned int nBytes, bool fAllowF
     return nMinFee;
 }
 
+static CCheckQueue<CScriptCheck> mempoolscriptcheckqueue(128);
+
+void ThreadMempoolScriptCheck() {
+    RenameThread("crown-mpscriptch");
+    mempoolscriptcheckqueue.Thread();
+}
+
+/**
+ * Same as CheckInputs() with script checks, but the signatures of multi-input transactions are
+ * verified by the mempool script checking threads. All callers hold cs_main, so the queue only
+ * ever has one master.
+ */
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, unsigned int flags)
+{
+    if (!nMempoolScriptCheckThreads || tx.vin.size() < 2)
+        return CheckInputs(tx, state, view, true, flags, true);
+
+    {
+        CCheckQueueControl<CScriptCheck> control(&mempoolscriptcheckqueue);
+        std::vector<CScriptCheck> vChecks;
+        if (!CheckInputs(tx, state, view, true, flags, true, &vChecks))
+            return false;
+        control.Add(vChecks);
+        if (control.Wait())
+            return true;
+    }
+
+    // A script failed: check serially to find out which flag was violated and
+    // reject the transaction with the appropriate reason and DoS score
+    return CheckInputs(tx, state, view, true, flags, true);
+}
+
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees)
@@ -1236,7 +1350,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true))
+        if (!CheckInputsParallel(tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS))
         {
             return error("AcceptToMemoryPool: : ConnectInputs failed %s", hash.ToString());
         }
@@ -1250,7 +1364,7 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        if (!CheckInputsParallel(tx, state, view, MANDATORY_SCRIPT_VERIFY_FLAGS))
         {
             return error("AcceptToMemoryPool: : BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s", hash.ToString());
         }
@@ -1656,6 +1770,111 @@ bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex)
     return ReadBlockOrHeader(block, pindex);
 }
 
+bool ReadRawBlockFromDisk(std::vector<char>& vBlock, const CBlockIndex* pindex)
+{
+    vBlock.clear();
+    CDiskBlockPos pos = pindex->GetBlockPos();
+    // The block is preceded by the network magic and its size, see WriteBlockToDisk
+    unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nPos < nHeaderSize)
+        return error("%s : Invalid block position for %s", __func__, pindex->GetBlockHash().ToString());
+    pos.nPos -= nHeaderSize;
+
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        CMessageHeader::MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s : Block magic mismatch for %s", __func__, pindex->GetBlockHash().ToString());
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+            return error("%s : Invalid block size %u for %s", __func__, nSize, pindex->GetBlockHash().ToString());
+        vBlock.resize(nSize);
+        filein.read(&vBlock[0], nSize);
+    }
+    catch (std::exception &e) {
+        vBlock.clear();
+        return error("%s : I/O error - %s", __func__, e.what());
+    }
+
+    // The block hash only covers the 80 byte header, which is cheap enough to check every time
+    if (Hash(vBlock.begin(), vBlock.begin() + 80) != pindex->GetBlockHash()) {
+        vBlock.clear();
+        return error("%s : GetHash() doesn't match index", __func__);
+    }
+    return true;
+}
+
+namespace {
+    /** Recently requested blocks as ready to send "block" messages, so a block asked for by many peers
+     *  is read from disk and checksummed once */
+    CCriticalSection cs_blockMessages;
+    lrucache<uint256, std::shared_ptr<const CSerializeData> > cacheBlockMessages(DEFAULT_BLOCK_MESSAGE_CACHE_SIZE);
+}
+
+bool GetBlockMessage(const CBlockIndex* pindex, std::shared_ptr<const CSerializeData>& pmessage)
+{
+    {
+        LOCK(cs_blockMessages);
+        if (cacheBlockMessages.get(pindex->GetBlockHash(), pmessage))
+            return true;
+    }
+
+    std::vector<char> vBlock;
+    if (!ReadRawBlockFromDisk(vBlock, pindex))
+        return false;
+    std::shared_ptr<CSerializeData> pnew = std::make_shared<CSerializeData>();
+    CNode::SerializeMessage("block", vBlock, *pnew);
+    pmessage = pnew;
+
+    LOCK(cs_blockMessages);
+    cacheBlockMessages.insert(pindex->GetBlockHash(), pmessage);
+    return true;
+}
+
+void SetBlockMessageCacheSize(unsigned int nSize)
+{
+    LOCK(cs_blockMessages);
+    cacheBlockMessages.max_size(nSize);
+}
+
+/** The payment index keeps the stake pointers that are still valid, and enough blocks before them to undo a reorganization */
+static int PaymentIndexStart(int nHeight)
+{
+    return std::max(1, nHeight - Params().ValidStakePointerDuration() - Params().MaxReorganizationDepth());
+}
+
+bool LoadPaymentIndex()
+{
+    LOCK(cs_main);
+    g_paymentIndex->Clear();
+    if (chainActive.Tip() == NULL)
+        return true;
+    for (CBlockIndex* pindex = chainActive[PaymentIndexStart(chainActive.Height())]; pindex; pindex = chainActive.Next(pindex)) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            g_paymentIndex->Clear();
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        g_paymentIndex->AddBlock(block, pindex->nHeight);
+    }
+    LogPrintf("%s: loaded %u payments up to height %d\n", __func__, g_paymentIndex->GetPaymentCount(), g_paymentIndex->GetHeight());
+    return true;
+}
+
+bool GetStakePayments(const CScript& payee, unsigned int nPos, int nMinHeight, std::vector<StakePayment>& vPayments)
+{
+    LOCK(cs_main);
+    if (g_paymentIndex->GetHeight() != chainActive.Height())
+        return error("%s: the payment index is at height %d, not at the tip %d", __func__, g_paymentIndex->GetHeight(), chainActive.Height());
+
+    vPayments = g_paymentIndex->GetPayments(payee, nPos, nMinHeight);
+    return true;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -2561,7 +2780,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
         // overwrite one. Still, use a conservative safety factor of 2.
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
-        // Flush the chainstate (which may refer to block index entries).
+        // Flush the chainstate (which may refer to block index entries). With -dbbackgroundflush this
+        // only hands the cache over, LevelDB is written by the flusher thread.
         if (!pcoinsTip->Flush())
             return state.Abort("Failed to write to coin database");
         nLastFlush = nNow;
@@ -2663,6 +2883,8 @@ bool static DisconnectTip(CValidationState &state) {
     mempool.check(pcoinsTip);
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev);
+    if (g_paymentIndex->GetHeight() == pindexDelete->nHeight)
+        g_paymentIndex->RemoveBlock(pindexDelete->nHeight);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
     BOOST_FOREACH(const CTransaction &tx, block.vtx) {
@@ -2728,6 +2950,12 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pindexNew, const CB
     mempool.check(pcoinsTip);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
+    rateBlocksConnected.Add(GetTime(), 1);
+    // Keep the payment index at the tip, LoadPaymentIndex filled it at startup
+    if (g_paymentIndex->GetHeight() == pindexNew->nHeight - 1) {
+        g_paymentIndex->AddBlock(*pblock, pindexNew->nHeight);
+        g_paymentIndex->EraseBeforeHeight(PaymentIndexStart(pindexNew->nHeight));
+    }
     // Tell wallet about transactions that went from mempool
     // to conflicted:
     BOOST_FOREACH(const CTransaction &tx, txConflicted) {
@@ -3000,11 +3228,26 @@ bool ActivateBestChain(CValidationState &state, const CBlock *pblock) {
             uint256 hashNewTip = pindexNewTip->GetBlockHash();
             // Relay inventory, but don't relay old inventory during initial block download.
             int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
+            // Peers that asked for it get the new block as a compact block straight away, saving them the getdata round trip
+            bool fCompact = pblock && pblock->GetHash() == hashNewTip;
+            std::unique_ptr<CBlockHeaderAndShortTxIDs> pcmpctblock;
             {
                 LOCK(cs_vNodes);
                 BOOST_FOREACH(CNode* pnode, vNodes)
-                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                        pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                    if (chainActive.Height() > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate)) {
+                        if (fCompact && pnode->fPreferHeaderAndIDs) {
+                            bool fKnown;
+                            {
+                                LOCK(pnode->cs_inventory);
+                                fKnown = !pnode->setInventoryKnown.insert(CInv(MSG_BLOCK, hashNewTip)).second;
+                            }
+                            if (!pcmpctblock)
+                                pcmpctblock.reset(new CBlockHeaderAndShortTxIDs(*pblock));
+                            if (!fKnown)
+                                pnode->PushMessage("cmpctblock", *pcmpctblock);
+                        } else
+                            pnode->PushInventory(CInv(MSG_BLOCK, hashNewTip));
+                    }
             }
             // Notify external listeners about the new tip.
             uiInterface.NotifyBlockTip(hashNewTip);
@@ -3719,6 +3962,12 @@ bool ProcessNewBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDis
 
     if(!fLiteMode){
         if (masternodeSync.RequestedMasternodeAssets > MASTERNODE_SYNC_LIST) {
+            const CBlockIndex* pindexTip;
+            {
+                LOCK(cs_main);
+                pindexTip = chainActive.Tip();
+            }
+            mnodeman.UpdatedBlockTip(pindexTip);
             masternodePayments.ProcessBlock(GetHeight()+10);
             budget.NewBlock();
         }
@@ -4519,7 +4768,7 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 bool send = false;
                 BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
@@ -4540,14 +4789,35 @@ void static ProcessGetData(CNode* pfrom)
                 }
                 if (send)
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
+                    {
+                        // Send the block as it is stored on disk, without deserializing it again
+                        std::shared_ptr<const CSerializeData> pmessage;
+                        if (!GetBlockMessage((*mi).second, pmessage))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushSerializedMessage(*pmessage);
+                    }
+                    else if (inv.type == MSG_CMPCT_BLOCK)
+                    {
+                        // A peer catching up on older blocks is better served by the full blocks
+                        if (chainActive.Height() - mi->second->nHeight <= MAX_CMPCTBLOCK_DEPTH) {
+                            CBlock block;
+                            if (!ReadBlockFromDisk(block, (*mi).second))
+                                assert(!"cannot load block from disk");
+                            pfrom->PushMessage("cmpctblock", CBlockHeaderAndShortTxIDs(block));
+                        } else {
+                            std::shared_ptr<const CSerializeData> pmessage;
+                            if (!GetBlockMessage((*mi).second, pmessage))
+                                assert(!"cannot load block from disk");
+                            pfrom->PushSerializedMessage(*pmessage);
+                        }
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
                         {
@@ -4781,6 +5051,147 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+/** Ask pfrom to announce new blocks as compact blocks, it just gave us a new tip. Requires cs_main. */
+static void MaybeSetPeerAsAnnouncingHeaderAndIDs(CNode* pfrom)
+{
+    if (!pfrom->fSupportsCompactBlocks)
+        return;
+    list<NodeId>::iterator it = std::find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), pfrom->GetId());
+    if (it != lNodesAnnouncingHeaderAndIDs.end()) {
+        lNodesAnnouncingHeaderAndIDs.splice(lNodesAnnouncingHeaderAndIDs.end(), lNodesAnnouncingHeaderAndIDs, it);
+        return;
+    }
+    if (lNodesAnnouncingHeaderAndIDs.size() >= MAX_CMPCTBLOCK_ANNOUNCING_PEERS) {
+        // Go back to inv announcements with the peer that was useful the longest time ago
+        NodeId nodeid = lNodesAnnouncingHeaderAndIDs.front();
+        lNodesAnnouncingHeaderAndIDs.pop_front();
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes) {
+            if (pnode->GetId() == nodeid) {
+                pnode->PushMessage("sendcmpct", false, (uint64_t)1);
+                break;
+            }
+        }
+    }
+    pfrom->PushMessage("sendcmpct", true, (uint64_t)1);
+    lNodesAnnouncingHeaderAndIDs.push_back(pfrom->GetId());
+}
+
+/** Ask pfrom for the blocks up to hashStop, by their headers in headers-first mode */
+static void PushSyncRequest(CNode* pfrom, const uint256& hashStop)
+{
+    if (fHeadersFirst) {
+        LOCK(cs_main);
+        pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), hashStop);
+    } else
+        pfrom->PushMessage("getblocks", chainActive.GetLocator(), hashStop);
+}
+
+/**
+ * Whether a header from the network is a MN-PoS header from the PoS start height on. Its stake can only be
+ * checked with the whole block, so it must not go into the block index ahead of the block. Requires cs_main.
+ */
+static bool IsProofOfStakeHeader(const CBlockHeader& header)
+{
+    BlockMap::iterator miPrev = mapBlockIndex.find(header.hashPrevBlock);
+    return miPrev != mapBlockIndex.end() && header.nVersion.IsProofOfStake() && miPrev->second->nHeight + 1 >= Params().PoSStartHeight();
+}
+
+/**
+ * Check the proof of work of a header from the network before AcceptBlockHeader adds it to the block index.
+ * MN-PoS headers from the PoS start height on pass, their stake can only be checked with the whole block.
+ * Requires cs_main.
+ */
+static bool CheckHeaderProofOfWork(const CBlockHeader& header)
+{
+    BlockMap::iterator miPrev = mapBlockIndex.find(header.hashPrevBlock);
+    // AcceptBlockHeader turns it down without adding it
+    if (miPrev == mapBlockIndex.end())
+        return true;
+    if (header.nVersion.IsProofOfStake() && miPrev->second->nHeight + 1 >= Params().PoSStartHeight())
+        return true;
+    return CheckProofOfWork(header);
+}
+
+/** Process a block received from pfrom, in a "block" message or put together from a compact block */
+static void ProcessReceivedBlock(CNode* pfrom, CBlock& block, std::pair<unsigned int, uint256>& pairHighBlock)
+{
+    auto hashBlock = block.GetHash();
+    CInv inv(MSG_BLOCK, hashBlock);
+
+    bool inChain = mapBlockIndex.count(hashBlock) && chainActive.Contains(mapBlockIndex.at(hashBlock));
+
+    // Blocks we asked for by their header are stored even if their parent hasn't arrived yet, headers-first
+    // sync downloads the window from many peers in parallel so they come in out of order
+    bool fRequestedByHeader;
+    {
+        LOCK(cs_main);
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+        fRequestedByHeader = itInFlight != mapBlocksInFlight.end() && itInFlight->second.second->fValidatedHeaders;
+        State(pfrom->GetId())->nBlocksReceived++;
+    }
+
+    //When syncing with a peer, it will send this node its current chain tip after its round of 500 blocks of inventory
+    //This is to signal that it is ready to send the next round of inventory, but needs to be prompted to do so
+    bool fSentGetBlocks = false;
+    if (pfrom->fSyncingWith && !mapBlockIndex.count(block.hashPrevBlock) && hashBlock == pairHighBlock.second) {
+        //Signal sent from peer that they are ready for the next getblocks
+        pfrom->PushMessage("getblocks", chainActive.GetLocator(), inv.hash);
+        fSentGetBlocks = true;
+    } else if (block.nTime > pairHighBlock.first) {
+        pairHighBlock = std::make_pair(block.nTime, block.GetHash());
+    }
+
+    //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
+    if (!inChain && (fRequestedByHeader || (mapBlockIndex.count(block.hashPrevBlock) && mapBlockIndex.at(block.hashPrevBlock)->nChainTx))) {
+        pfrom->AddInventoryKnown(inv);
+        CValidationState state;
+        ProcessNewBlock(state, pfrom, &block);
+        int nDoS;
+        if (state.IsInvalid(nDoS)) {
+            pfrom->PushMessage("reject", std::string("block"), state.GetRejectCode(),
+                    state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
+            if (nDoS > 0) {
+                TRY_LOCK(cs_main, lockMain);
+                if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
+            }
+        }
+        if (state.IsSuspicious()) {
+            //Tell the peer we consider this block suspicious
+            pfrom->PushMessage("reject", std::string("block"), 0, std::string("block-suspicious"), inv.hash);
+        }
+        if (state.IsValid() && !IsInitialBlockDownload()) {
+            LOCK(cs_main);
+            if (chainActive.Tip()->GetBlockHash() == hashBlock)
+                MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom);
+        }
+    } else {
+        //ask to sync up to this block
+        if (!fSentGetBlocks)
+            PushSyncRequest(pfrom, inv.hash);
+    }
+}
+
+/** Process a block put together from a compact block, or fall back to the full block if that failed */
+static bool ProcessCompactBlockResult(CNode* pfrom, CBlock& block, ReadStatus status, std::pair<unsigned int, uint256>& pairHighBlock)
+{
+    uint256 hashBlock = block.GetHash();
+    if (status == READ_STATUS_INVALID) {
+        LOCK(cs_main);
+        MarkBlockAsReceived(hashBlock);
+        Misbehaving(pfrom->GetId(), 100);
+        return error("Peer %d sent us an invalid compact block", pfrom->id);
+    } else if (status == READ_STATUS_FAILED) {
+        // Short id collision with a mempool transaction, the block is still in flight so just ask for it
+        pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hashBlock)));
+        return true;
+    }
+    ProcessReceivedBlock(pfrom, block, pairHighBlock);
+    return true;
+}
+
+CCriticalSection cs_extensionMessages;
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     static std::pair<unsigned int, uint256> pairHighBlock;
@@ -4936,6 +5347,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     {
         pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
 
+        // Offer to receive compact blocks, they are requested with getdata until the peer proves useful
+        if (pfrom->nVersion >= COMPACT_BLOCKS_VERSION)
+            pfrom->PushMessage("sendcmpct", false, (uint64_t)1);
+
         // Mark this node as currently connected, so we update its timestamp later.
         if (pfrom->fNetworkNode) {
             LOCK(cs_main);
@@ -4977,9 +5392,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
                     // at a time so the setAddrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
+                    static const uint256 hashSalt = GetRandHash();
                     uint64_t hashAddr = addr.GetHash();
                     uint256 hashRand = ArithToUint256(UintToArith256(hashSalt) ^ (hashAddr<<32) ^ ((GetTime()+hashAddr)/(24*60*60)));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
@@ -5031,6 +5444,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
             boost::this_thread::interruption_point();
             pfrom->AddInventoryKnown(inv);
+            if (inv.type == MSG_BLOCK)
+                UpdateBlockAvailability(pfrom->GetId(), inv.hash);
 
             bool fAlreadyHave = AlreadyHave(inv);
             LogPrint("net", "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
@@ -5043,7 +5458,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
                 if (askFor) {
                     if (inv.type == MSG_BLOCK) {
-                        if (IsInitialBlockDownload() && pfrom->fSyncingWith && inv.hash == pairHighBlock.second) {
+                        if (fHeadersFirst && IsInitialBlockDownload() && !pfrom->fSyncingWith) {
+                            // Get the header, the block is then downloaded along with the rest of the window
+                            PushSyncRequest(pfrom, inv.hash);
+                        } else if (IsInitialBlockDownload() && pfrom->fSyncingWith && inv.hash == pairHighBlock.second) {
                             //This situation only happens when a getblocks round ends and a new block has not been added to
                             //the mainchain (that is being synced from the fully synced peer), and so they send the same inv
                             //twice
@@ -5295,110 +5713,266 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (strCommand == "headers" && !fImporting && !fReindex) // Ignore headers received while importing
     {
-//        std::vector<CBlockHeader> headers;
-//
-//        // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
-//        unsigned int nCount = ReadCompactSize(vRecv);
-//        if (nCount > MAX_HEADERS_RESULTS) {
-//            Misbehaving(pfrom->GetId(), 20);
-//            return error("headers message size = %u", nCount);
-//        }
-//        headers.resize(nCount);
-//        for (unsigned int n = 0; n < nCount; n++) {
-//            vRecv >> headers[n];
-//            ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
-//        }
-//
-//        LOCK(cs_main);
-//
-//        if (nCount == 0) {
-//            // Nothing interesting. Stop asking this peers for more headers.
-//            return true;
-//        }
-//
-//        // If we already know the last header in the message, then it contains
-//        // no new information for us.  In this case, we do not request
-//        // more headers later.  This prevents multiple chains of redundant
-//        // getheader requests from running in parallel if triggered by incoming
-//        // blocks while the node is still in initial headers sync.
-//        const bool hasNewHeaders = (mapBlockIndex.count(headers.back().GetHash()) == 0);
-//
-//        CBlockIndex *pindexLast = NULL;
-//        BOOST_FOREACH(const CBlockHeader& header, headers) {
-//            CValidationState state;
-//            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
-//                Misbehaving(pfrom->GetId(), 20);
-//                return error("non-continuous headers sequence");
-//            }
-//            if (!AcceptBlockHeader(header, state, &pindexLast)) {
-//                int nDoS;
-//                if (state.IsInvalid(nDoS)) {
-//                    if (nDoS > 0)
-//                        Misbehaving(pfrom->GetId(), nDoS);
-//                    std::string strError = "invalid header received " + header.GetHash().ToString();
-//                    return error(strError.c_str());
-//                }
-//            }
-//        }
-//
-//        if (pindexLast)
-//            UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
-//
-//        if (nCount == MAX_HEADERS_RESULTS && pindexLast && hasNewHeaders) {
-//            // Headers message had its maximum size; the peer may have more headers.
-//            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
-//            // from there instead.
-//            LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
-//            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256());
-//        }
-//
-//        CheckBlockIndex();
+        // Headers are only asked for in headers-first mode, others don't go into the block index
+        if (!fHeadersFirst) {
+            LogPrint("net", "ignoring headers from peer=%d, not in headers-first mode\n", pfrom->id);
+            return true;
+        }
+
+        std::vector<CBlockHeader> headers;
+
+        // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
+        unsigned int nCount = ReadCompactSize(vRecv);
+        if (nCount > MAX_HEADERS_RESULTS) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20);
+            return error("headers message size = %u", nCount);
+        }
+        headers.resize(nCount);
+        for (unsigned int n = 0; n < nCount; n++) {
+            vRecv >> headers[n];
+            ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+        }
+
+        LOCK(cs_main);
+
+        if (nCount == 0) {
+            // Nothing interesting. Stop asking this peers for more headers.
+            return true;
+        }
+
+        // If we already know the last header in the message, then it contains
+        // no new information for us.  In this case, we do not request
+        // more headers later.  This prevents multiple chains of redundant
+        // getheader requests from running in parallel if triggered by incoming
+        // blocks while the node is still in initial headers sync.
+        const bool hasNewHeaders = (mapBlockIndex.count(headers.back().GetHash()) == 0);
+
+        CBlockIndex *pindexLast = NULL;
+        const CBlockIndex *pindexProofOfStakePrev = NULL;
+        BOOST_FOREACH(const CBlockHeader& header, headers) {
+            CValidationState state;
+            if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
+                Misbehaving(pfrom->GetId(), 20);
+                return error("non-continuous headers sequence");
+            }
+            // Headers-first sync ends where the MN-PoS blocks start, those are synced block by block
+            if (IsProofOfStakeHeader(header) && !mapBlockIndex.count(header.GetHash())) {
+                pindexProofOfStakePrev = mapBlockIndex[header.hashPrevBlock];
+                break;
+            }
+            if (!CheckHeaderProofOfWork(header)) {
+                Misbehaving(pfrom->GetId(), 50);
+                return error("invalid proof of work in header %s", header.GetHash().ToString());
+            }
+            if (!AcceptBlockHeader(header, header.nVersion.IsProofOfStake(), state, &pindexLast)) {
+                int nDoS;
+                if (state.IsInvalid(nDoS)) {
+                    if (nDoS > 0)
+                        Misbehaving(pfrom->GetId(), nDoS);
+                    std::string strError = "invalid header received " + header.GetHash().ToString();
+                    return error(strError.c_str());
+                }
+            }
+        }
+
+        if (pindexLast)
+            UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
+
+        if (pindexProofOfStakePrev) {
+            // Once the blocks before it are connected, get the MN-PoS blocks from this peer with getblocks,
+            // until then the next sync request ends up here again
+            if (chainActive.Contains(pindexProofOfStakePrev)) {
+                LogPrint("net", "headers reached the MN-PoS blocks at %d, getblocks to peer=%d\n", pindexProofOfStakePrev->nHeight + 1, pfrom->id);
+                pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256());
+                pfrom->fSyncingWith = true;
+            }
+        } else if (nCount == MAX_HEADERS_RESULTS && pindexLast && hasNewHeaders) {
+            // Headers message had its maximum size; the peer may have more headers.
+            // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
+            // from there instead.
+            LogPrint("net", "more getheaders (%d) to end to peer=%d (startheight:%d)\n", pindexLast->nHeight, pfrom->id, pfrom->nStartingHeight);
+            pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexLast), uint256());
+        }
+
+        CheckBlockIndex();
     }
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
+        {
+            LOCK(cs_main);
+            RecordBlockBytes(pfrom->GetId(), vRecv.size());
+        }
         CBlock block;
         vRecv >> block;
-        auto hashBlock = block.GetHash();
-        CInv inv(MSG_BLOCK, hashBlock);
-        LogPrint("net", "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
+        LogPrint("net", "received block %s peer=%d\n", block.GetHash().ToString(), pfrom->id);
+        ProcessReceivedBlock(pfrom, block, pairHighBlock);
+    }
 
-        bool inChain = mapBlockIndex.count(hashBlock) && chainActive.Contains(mapBlockIndex.at(hashBlock));
 
-        //When syncing with a peer, it will send this node its current chain tip after its round of 500 blocks of inventory
-        //This is to signal that it is ready to send the next round of inventory, but needs to be prompted to do so
-        bool fSentGetBlocks = false;
-        if (pfrom->fSyncingWith && !mapBlockIndex.count(block.hashPrevBlock) && hashBlock == pairHighBlock.second) {
-            //Signal sent from peer that they are ready for the next getblocks
-            pfrom->PushMessage("getblocks", chainActive.GetLocator(), inv.hash);
-            fSentGetBlocks = true;
-        } else if (block.nTime > pairHighBlock.first) {
-            pairHighBlock = std::make_pair(block.nTime, block.GetHash());
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        // Version 1 is the only one there is, ignore the others so they can be introduced later
+        if (nCMPCTBLOCKVersion == 1) {
+            pfrom->fSupportsCompactBlocks = true;
+            pfrom->fPreferHeaderAndIDs = fAnnounceUsingCMPCTBLOCK;
         }
+    }
 
-        //sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!inChain && mapBlockIndex.count(block.hashPrevBlock) && mapBlockIndex.at(block.hashPrevBlock)->nChainTx) {
-            pfrom->AddInventoryKnown(inv);
-            CValidationState state;
-            ProcessNewBlock(state, pfrom, &block);
-            int nDoS;
-            if (state.IsInvalid(nDoS)) {
-                pfrom->PushMessage("reject", strCommand, state.GetRejectCode(),
-                        state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash);
-                if (nDoS > 0) {
-                    TRY_LOCK(cs_main, lockMain);
-                    if (lockMain) Misbehaving(pfrom->GetId(), nDoS);
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        unsigned int nBytes = vRecv.size();
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        uint256 hashBlock = cmpctblock.header.GetHash();
+        LogPrint("net", "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+
+        {
+            LOCK(cs_main);
+            RecordBlockBytes(pfrom->GetId(), nBytes);
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                MarkBlockAsReceived(hashBlock);
+                return true;
+            }
+            // Only blocks we asked this peer for, or that it announces because we picked it to, are put together
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+            bool fRequested = itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == pfrom->GetId();
+            bool fAnnouncing = std::find(lNodesAnnouncingHeaderAndIDs.begin(), lNodesAnnouncingHeaderAndIDs.end(), pfrom->GetId()) != lNodesAnnouncingHeaderAndIDs.end();
+            if (!fRequested && !fAnnouncing) {
+                LogPrint("net", "ignoring unrequested cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+                return true;
+            }
+            BlockMap::iterator miPrev = mapBlockIndex.find(cmpctblock.header.hashPrevBlock);
+            if (miPrev != mapBlockIndex.end()) {
+                // Check the header and its proof of work before spending any work on the transactions
+                if (!CheckHeaderProofOfWork(cmpctblock.header)) {
+                    MarkBlockAsReceived(hashBlock);
+                    Misbehaving(pfrom->GetId(), 50);
+                    return error("Peer %d sent us a cmpctblock with invalid proof of work", pfrom->id);
+                }
+                // The stake of a MN-PoS header can only be checked with the whole block, it goes into the
+                // block index through AcceptBlock once the block is put together
+                CValidationState state;
+                CBlockIndex* pindex = NULL;
+                if (!IsProofOfStakeHeader(cmpctblock.header) && !AcceptBlockHeader(cmpctblock.header, cmpctblock.header.nVersion.IsProofOfStake(), state, &pindex)) {
+                    MarkBlockAsReceived(hashBlock);
+                    int nDoS;
+                    if (state.IsInvalid(nDoS)) {
+                        if (nDoS > 0)
+                            Misbehaving(pfrom->GetId(), nDoS);
+                        return error("Peer %d sent us a cmpctblock with an invalid header", pfrom->id);
+                    }
+                    return true;
                 }
             }
-            if (state.IsSuspicious()) {
-                //Tell the peer we consider this block suspicious
-                pfrom->PushMessage("reject", strCommand, 0, std::string("block-suspicious"), inv.hash);
+            // The block can't be put together from the mempool and connected yet, sync up to it
+            // the way the "block" message would
+            if (miPrev == mapBlockIndex.end() || !miPrev->second->nChainTx) {
+                MarkBlockAsReceived(hashBlock);
+                PushSyncRequest(pfrom, hashBlock);
+                return true;
             }
-        } else {
-            //ask to sync up to this block
-            if (!fSentGetBlocks)
-                pfrom->PushMessage("getblocks", chainActive.GetLocator(), inv.hash);
         }
+
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock = std::make_shared<PartiallyDownloadedBlock>(&mempool);
+        ReadStatus status = partialBlock->InitData(cmpctblock);
+        if (status == READ_STATUS_INVALID) {
+            LOCK(cs_main);
+            MarkBlockAsReceived(hashBlock);
+            Misbehaving(pfrom->GetId(), 100);
+            return error("Peer %d sent us an invalid cmpctblock", pfrom->id);
+        } else if (status == READ_STATUS_FAILED) {
+            // Short id collision, ask for the full block
+            pfrom->PushMessage("getdata", vector<CInv>(1, CInv(MSG_BLOCK, hashBlock)));
+            return true;
+        }
+
+        BlockTransactionsRequest req;
+        for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+            if (!partialBlock->IsTxAvailable(i))
+                req.indexes.push_back(i);
+        }
+        if (req.indexes.empty()) {
+            CBlock block;
+            status = partialBlock->FillBlock(block, vector<CTransaction>());
+            return ProcessCompactBlockResult(pfrom, block, status, pairHighBlock);
+        }
+
+        req.blockhash = hashBlock;
+        {
+            LOCK(cs_main);
+            CNodeState* state = State(pfrom->GetId());
+            state->partialBlock = partialBlock;
+            state->hashPartialBlock = hashBlock;
+        }
+        pfrom->PushMessage("getblocktxn", req);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        CBlock block;
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(req.blockhash);
+            if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrintf("Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->id);
+                return true;
+            }
+            // Only recent blocks are relayed as compact blocks, send older ones in full
+            if (mi->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->id, MAX_BLOCKTXN_DEPTH);
+                pfrom->vRecvGetData.push_back(CInv(MSG_BLOCK, req.blockhash));
+                ProcessGetData(pfrom);
+                return true;
+            }
+            if (!ReadBlockFromDisk(block, mi->second))
+                assert(!"cannot load block from disk");
+        }
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                LOCK(cs_main);
+                Misbehaving(pfrom->GetId(), 100);
+                return error("Peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        unsigned int nBytes = vRecv.size();
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<PartiallyDownloadedBlock> partialBlock;
+        {
+            LOCK(cs_main);
+            RecordBlockBytes(pfrom->GetId(), nBytes);
+            CNodeState* state = State(pfrom->GetId());
+            if (!state->partialBlock || state->hashPartialBlock != resp.blockhash) {
+                LogPrint("net", "Peer %d sent us block transactions for a block we weren't expecting\n", pfrom->id);
+                return true;
+            }
+            partialBlock.swap(state->partialBlock);
+        }
+
+        CBlock block;
+        ReadStatus status = partialBlock->FillBlock(block, resp.txn);
+        return ProcessCompactBlockResult(pfrom, block, status, pairHighBlock);
     }
 
 
@@ -5409,7 +5983,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     // getaddr message mitigates the attack.
     else if ((strCommand == "getaddr") && (pfrom->fInbound))
     {
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrKnown);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = addrman.GetAddr();
         BOOST_FOREACH(const CAddress &addr, vAddr)
             pfrom->PushAddress(addr);
@@ -5671,6 +6248,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     else
     {
         //probably one the extensions
+        LOCK(cs_extensionMessages);
         mnodeman.ProcessMessage(pfrom, strCommand, vRecv);
         snodeman.ProcessMessage(pfrom, strCommand, vRecv);
         budget.ProcessMessage(pfrom, strCommand, vRecv);
@@ -5762,6 +6340,8 @@ bool ProcessMessages(CNode* pfrom)
 
         // Process message
         bool fRet = false;
+        int64_t nTimeStart = GetTimeMicros();
+        int64_t nLockWaitStart = GetMainLockWaitTime();
         try
         {
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
@@ -5795,6 +6375,10 @@ bool ProcessMessages(CNode* pfrom)
             PrintExceptionContinue(NULL, "ProcessMessages()");
         }
 
+        int64_t nTime = GetTimeMicros() - nTimeStart;
+        pfrom->RecordMessageTime(strCommand, nTime);
+        CNode::RecordMessageStats(strCommand, nMessageSize, nTime, GetMainLockWaitTime() - nLockWaitStart);
+
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
 
@@ -5857,8 +6441,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             BOOST_FOREACH(CNode* pnode, vNodes)
             {
                 // Periodically clear setAddrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
+                if (nLastRebroadcast) {
+                    LOCK(pnode->cs_addrKnown);
                     pnode->setAddrKnown.clear();
+                }
 
                 // Rebroadcast our address
                 AdvertizeLocal(pnode);
@@ -5873,22 +6459,18 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (fSendTrickle)
         {
             vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
             {
-                // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second)
+                LOCK(pto->cs_addrKnown);
+                vAddr.reserve(pto->vAddrToSend.size());
+                BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
                 {
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
-                    {
-                        pto->PushMessage("addr", vAddr);
-                        vAddr.clear();
-                    }
+                    // returns true if wasn't already contained in the set
+                    if (pto->setAddrKnown.insert(addr).second)
+                        vAddr.push_back(addr);
                 }
+                pto->vAddrToSend.clear();
             }
-            pto->vAddrToSend.clear();
+            // PushAddress keeps at most MAX_ADDR_TO_SEND, within the 1000 the receiver accepts
             if (!vAddr.empty())
                 pto->PushMessage("addr", vAddr);
         }
@@ -5919,13 +6501,21 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         bool fFetch = state.fPreferredDownload || (nPreferredDownload == 0 && !pto->fClient && !pto->fOneShot); // Download if this is a nice peer, or we have no nice peers and this one might do.
         if (!state.fSyncStarted && !pto->fClient && !fImporting && !fReindex) {
             // Only actively request headers from a single peer, unless we're close to end of initial download.
-            if ((nSyncStarted < 2 && fFetch) || chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) {
+            // In headers-first mode that is when the headers are, every peer we then sync with tells us
+            // its best block so the blocks can be downloaded from all of them.
+            const CBlockIndex* pindexSynced = fHeadersFirst ? pindexBestHeader : chainActive.Tip();
+            if ((nSyncStarted < 2 && fFetch) || pindexSynced->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) {
                 state.fSyncStarted = true;
                 nSyncStarted++;
                 CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                LogPrint("net", "initial getblocks (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                pto->PushMessage("getblocks", chainActive.GetLocator(pindexStart), uint256());
-                pto->fSyncingWith = true;
+                if (fHeadersFirst) {
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256());
+                } else {
+                    LogPrint("net", "initial getblocks (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getblocks", chainActive.GetLocator(pindexStart), uint256());
+                    pto->fSyncingWith = true;
+                }
             }
         }
 
@@ -5955,9 +6545,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 if (inv.type == MSG_TX && !fSendTrickle)
                 {
                     // 1/4 of tx invs blast to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt.IsNull())
-                        hashSalt = GetRandHash();
+                    static const uint256 hashSalt = GetRandHash();
                     uint256 hashRand = ArithToUint256(UintToArith256(inv.hash) ^ UintToArith256(hashSalt));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
                     bool fTrickleWait = ((UintToArith256(hashRand) & 3) != 0);
@@ -6024,12 +6612,23 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         if (!pto->fDisconnect && !pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            //FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            if (fHeadersFirst) {
+                FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+                BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
+                    vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
+                    MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
+                    LogPrint("net", "Requesting block %s (%d) peer=%d\n", pindex->GetBlockHash().ToString(), pindex->nHeight, pto->id);
+                }
+            }
             while (!pto->listAskForBlocks.empty()) {
                 const CInv& inv = pto->listAskForBlocks.front();
                 //Only request if this block is not already in the chain
                 if (!(mapBlockIndex.count(inv.hash) && chainActive.Contains(mapBlockIndex.at(inv.hash)))) {
-                    vGetData.push_back(inv);
+                    // A new block is mostly made of transactions we already have, ask for it as a compact block
+                    if (pto->fSupportsCompactBlocks && !IsInitialBlockDownload())
+                        vGetData.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                    else
+                        vGetData.push_back(inv);
                     MarkBlockAsInFlight(pto->GetId(), inv.hash);
                     LogPrint("net", "Requesting block %s peer=%d\n", inv.hash.GetHex(), pto->id);
                 }
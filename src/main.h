@@ -32,8 +32,10 @@
 #include "undo.h"
 
 #include <algorithm>
+#include <deque>
 #include <exception>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
@@ -46,10 +48,12 @@ class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
 class CInv;
+class PaymentIndex;
 class ProofTracker;
 class CScriptCheck;
 class CValidationInterface;
 class CValidationState;
+struct StakePayment;
 
 struct CBlockTemplate;
 struct CNodeStateStats;
@@ -71,6 +75,10 @@ static const unsigned int MAX_P2SH_SIGOPS = 15;
 static const unsigned int MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -blockmsgcachesize, number of recently requested blocks kept as ready to send messages */
+static const unsigned int DEFAULT_BLOCK_MESSAGE_CACHE_SIZE = 16;
+/** Default for -headersfirst, sync the headers first and download the blocks from all peers in parallel during initial sync */
+static const bool DEFAULT_HEADERS_FIRST = false;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -97,6 +105,14 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
  *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Only blocks this close to the tip are sent as compact blocks, deeper ones are sent in full */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Only blocks this close to the tip have their transactions sent in reply to getblocktxn, deeper ones are sent in full */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+/** Number of peers we ask to announce new blocks to us as compact blocks, without waiting for a getdata */
+static const unsigned int MAX_CMPCTBLOCK_ANNOUNCING_PEERS = 3;
+/** Time in seconds over which the block download and connect rates reported by getsyncinfo are measured */
+static const int64_t SYNC_RATE_WINDOW = 60;
 /** Time to wait (in seconds) between writing blockchain state to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -129,6 +145,9 @@ struct SPHasher
 
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
+/** Serializes the masternode, systemnode, budget, spork and InstantSend message handlers across
+ *  message handler threads, must not be taken with cs_main held */
+extern CCriticalSection cs_extensionMessages;
 extern CTxMemPool mempool;
 extern Platform::NfTokenTxMemPoolHandler g_nfTokenTxMemPoolHandler;
 extern Platform::NftProtoTxMemPoolHandler g_nftProtoTxMemPoolHandler;
@@ -144,9 +163,11 @@ extern bool fImporting;
 extern bool fReindex;
 extern bool fVerifying;
 extern int nScriptCheckThreads;
+extern int nMempoolScriptCheckThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
+extern bool fHeadersFirst;
 extern size_t nCoinCacheUsage;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
@@ -159,6 +180,7 @@ extern std::map<uint256, int64_t> mapRejectedBlocks;
 typedef uint256 PointerHash;
 extern std::map<PointerHash, uint256> mapUsedStakePointers; //pointer hash matched to blockhash that it is in
 extern ProofTracker* g_proofTracker;
+extern PaymentIndex* g_paymentIndex;
 
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
@@ -219,6 +241,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the mempool script checking thread */
+void ThreadMempoolScriptCheck();
 
 /**
  * Check proof-of-work of a block header, taking auxpow into account.
@@ -277,8 +301,44 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    uint64_t nBlocksReceived;
+    uint64_t nBlockBytesReceived;
+    int64_t nStallingSince;
 };
 
+/** Sums values over a trailing time window to report them per second, times are in seconds */
+class CRollingRate
+{
+private:
+    int64_t nWindow;
+    int64_t nStart;
+    uint64_t nSum;
+    //! The values added in each second of the window
+    std::deque<std::pair<int64_t, uint64_t> > vSamples;
+
+    void Expire(int64_t nNow);
+
+public:
+    CRollingRate(int64_t nWindowIn);
+
+    void Add(int64_t nTime, uint64_t nValue);
+    /** The rate over the window ending at nNow, or over the time since the first value if that is shorter */
+    double GetRate(int64_t nNow);
+};
+
+struct CBlockDownloadStats {
+    int nBlocksInFlight;
+    int nPeersDownloading;
+    int nPeersStalling;
+    //! Blocks connected to the active chain per second
+    double dBlocksPerSec;
+    //! Bytes of block and compact block messages received per second
+    double dBytesPerSec;
+};
+
+/** Get the progress and throughput of block download over the last SYNC_RATE_WINDOW seconds */
+void GetBlockDownloadStats(CBlockDownloadStats& stats);
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -421,6 +481,16 @@ public:
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex);
+/** Read the block's serialized bytes as they are stored in the blk?????.dat file, without deserializing them */
+bool ReadRawBlockFromDisk(std::vector<char>& vBlock, const CBlockIndex* pindex);
+/** Get the block as a ready to send "block" message, from the cache of recently requested blocks if possible */
+bool GetBlockMessage(const CBlockIndex* pindex, std::shared_ptr<const CSerializeData>& pmessage);
+/** Set the number of blocks kept by GetBlockMessage, 0 disables the cache */
+void SetBlockMessageCacheSize(unsigned int nSize);
+/** Fill the payment index from the blocks of the active chain, ConnectTip and DisconnectTip keep it at the tip from then on */
+bool LoadPaymentIndex();
+/** Get the coinbase payments at nPos to payee from nMinHeight up to the tip, from the payment index */
+bool GetStakePayments(const CScript& payee, unsigned int nPos, int nMinHeight, std::vector<StakePayment>& vPayments);
 
 /** Functions for validating blocks and updating the block tree */
 
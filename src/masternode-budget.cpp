@@ -615,7 +615,7 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
     const int blockStart = GetNextSuperblock(pindexPrev->nHeight);
     const int blockEnd  =  blockStart + GetBudgetPaymentCycleBlocks() - 1;
     CAmount totalBudget = GetTotalBudget(blockStart);
-
+    const int nMinNetVotes = mnodeman.CountEnabled(MIN_BUDGET_PEER_PROTO_VERSION)/10;
 
     std::vector<std::pair<CBudgetProposal*, int> >::iterator it2 = vBudgetPorposalsSort.begin();
     while(it2 != vBudgetPorposalsSort.end())
@@ -625,7 +625,7 @@ std::vector<CBudgetProposal*> CBudgetManager::GetBudget()
         //prop start/end should be inside this period
         if(pbudgetProposal->fValid && pbudgetProposal->nBlockStart <= blockStart &&
                 pbudgetProposal->nBlockEnd >= blockEnd &&
-                pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > mnodeman.CountEnabled(MIN_BUDGET_PEER_PROTO_VERSION)/10 && 
+                pbudgetProposal->GetYeas() - pbudgetProposal->GetNays() > nMinNetVotes &&
                 pbudgetProposal->IsEstablished())
         {
             if(pbudgetProposal->GetAmount() + nBudgetAllocated <= totalBudget) {
@@ -929,22 +929,8 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, const std::string& strCommand,
 
 
         mapSeenMasternodeBudgetVotes.insert(make_pair(vote.GetHash(), vote));
-        if(!vote.SignatureValid(true)){
-            LogPrintf("mvote - signature invalid\n");
-            if(masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
-            // it could just be a non-synced masternode
-            mnodeman.AskForMN(pfrom, vote.vin);
-            return;
-        }
-        
-        std::string strError = "";
-        if(ReceiveProposalVote(vote, pfrom, strError)) {
-            vote.Relay();
-            masternodeSync.AddedBudgetItem(vote.GetHash());
-        }
-
-        DebugLogBudget(vote, pfrom->addr, "VA");
-        LogPrintf("mvote - new budget vote - %s\n", vote.GetHash().ToString());
+        legacySignerQueue.Push(pfrom, CSignedMessage(pmn->pubkey2, vote.vchSig, vote.GetSignatureMessage()),
+            [this, vote](CNode* pnode, bool fValid) { ProcessVerifiedVote(pnode, vote, fValid); });
     }
 
     if (strCommand == "fbs") { //Finalized Budget Suggestion
@@ -1027,23 +1013,55 @@ void CBudgetManager::ProcessMessage(CNode* pfrom, const std::string& strCommand,
         }
 
         mapSeenBudgetDraftVotes.insert(make_pair(vote.GetHash(), vote));
-        if(!vote.SignatureValid(true)){
-            LogPrintf("fbvote - signature invalid\n");
-            if(masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
-            // it could just be a non-synced masternode
-            mnodeman.AskForMN(pfrom, vote.vin);
-            return;
-        }
+        legacySignerQueue.Push(pfrom, CSignedMessage(pmn->pubkey2, vote.vchSig, vote.GetSignatureMessage()),
+            [this, vote](CNode* pnode, bool fValid) { ProcessVerifiedDraftVote(pnode, vote, fValid); });
+    }
+}
 
-        std::string strError = "";
-        if(UpdateBudgetDraft(vote, pfrom, strError)) {
-            vote.Relay();
-            masternodeSync.AddedBudgetItem(vote.GetHash());
+void CBudgetManager::ProcessVerifiedVote(CNode* pfrom, const CBudgetVote& voteIn, bool fValid)
+{
+    LOCK(cs);
 
-            LogPrintf("fbvote - new finalized budget vote - %s\n", vote.GetHash().ToString());
-        } else {
-            LogPrintf("fbvote - rejected finalized budget vote - %s - %s\n", vote.GetHash().ToString(), strError);
-        }
+    CBudgetVote vote(voteIn);
+    if(!fValid){
+        LogPrintf("mvote - signature invalid\n");
+        if(masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
+        // it could just be a non-synced masternode
+        mnodeman.AskForMN(pfrom, vote.vin);
+        return;
+    }
+
+    std::string strError = "";
+    if(ReceiveProposalVote(vote, pfrom, strError)) {
+        vote.Relay();
+        masternodeSync.AddedBudgetItem(vote.GetHash());
+    }
+
+    DebugLogBudget(vote, pfrom->addr, "VA");
+    LogPrintf("mvote - new budget vote - %s\n", vote.GetHash().ToString());
+}
+
+void CBudgetManager::ProcessVerifiedDraftVote(CNode* pfrom, const BudgetDraftVote& voteIn, bool fValid)
+{
+    LOCK(cs);
+
+    BudgetDraftVote vote(voteIn);
+    if(!fValid){
+        LogPrintf("fbvote - signature invalid\n");
+        if(masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
+        // it could just be a non-synced masternode
+        mnodeman.AskForMN(pfrom, vote.vin);
+        return;
+    }
+
+    std::string strError = "";
+    if(UpdateBudgetDraft(vote, pfrom, strError)) {
+        vote.Relay();
+        masternodeSync.AddedBudgetItem(vote.GetHash());
+
+        LogPrintf("fbvote - new finalized budget vote - %s\n", vote.GetHash().ToString());
+    } else {
+        LogPrintf("fbvote - rejected finalized budget vote - %s - %s\n", vote.GetHash().ToString(), strError);
     }
 }
 
@@ -1061,11 +1079,7 @@ void CBudgetManager::ResetSync()
         if(pbudgetProposal && pbudgetProposal->fValid){
         
             //mark votes
-            std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
-            while(it2 != pbudgetProposal->mapVotes.end()){
-                (*it2).second.fSynced = false;
-                ++it2;
-            }
+            pbudgetProposal->ResetSync();
         }
         ++it1;
     }
@@ -1093,12 +1107,7 @@ void CBudgetManager::MarkSynced()
         if(pbudgetProposal && pbudgetProposal->fValid){
         
             //mark votes
-            std::map<uint256, CBudgetVote>::iterator it2 = pbudgetProposal->mapVotes.begin();
-            while(it2 != pbudgetProposal->mapVotes.end()){
-                if((*it2).second.fValid)
-                    (*it2).second.fSynced = true;
-                ++it2;
-            }
+            pbudgetProposal->MarkSynced();
         }
         ++it1;
     }
@@ -1139,8 +1148,8 @@ void CBudgetManager::Sync(CNode* pfrom, uint256 nProp, bool fPartial) const
             nInvCount++;
         
             //send votes
-            std::map<uint256, CBudgetVote>::const_iterator it2 = pbudgetProposal->second.mapVotes.begin();
-            while(it2 != pbudgetProposal->second.mapVotes.end()){
+            std::map<uint256, CBudgetVote>::const_iterator it2 = pbudgetProposal->second.GetVoteMap().begin();
+            while(it2 != pbudgetProposal->second.GetVoteMap().end()){
                 if((*it2).second.fValid){
                     if((fPartial && !(*it2).second.fSynced) || !fPartial) {
                         pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, (*it2).second.GetHash()));
@@ -1364,6 +1373,7 @@ CBudgetProposal::CBudgetProposal()
     nAmount = 0;
     nTime = 0;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn)
@@ -1376,6 +1386,7 @@ CBudgetProposal::CBudgetProposal(std::string strProposalNameIn, std::string strU
     nAmount = nAmountIn;
     nFeeTXHash = nFeeTXHashIn;
     fValid = true;
+    RecountVotes();
 }
 
 CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
@@ -1390,6 +1401,7 @@ CBudgetProposal::CBudgetProposal(const CBudgetProposal& other)
     nFeeTXHash = other.nFeeTXHash;
     mapVotes = other.mapVotes;
     fValid = true;
+    RecountVotes();
 }
 
 bool CBudgetProposal::IsValid(std::string& strError, bool fCheckCollateral) const
@@ -1484,7 +1496,12 @@ bool CBudgetProposal::AddOrUpdateVote(const CBudgetVote& vote, std::string& strE
         return false;
     }        
 
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.find(hash);
+    if(it != mapVotes.end())
+        CountVote(it->second, -1);
+
     mapVotes[hash] = vote;
+    CountVote(vote, 1);
     return true;
 }
 
@@ -1494,62 +1511,75 @@ void CBudgetProposal::CleanAndRemove(bool fSignatureCheck)
     std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
 
     while(it != mapVotes.end()) {
-        (*it).second.fValid = (*it).second.SignatureValid(fSignatureCheck);
+        bool fVoteValid = (*it).second.SignatureValid(fSignatureCheck);
+        if((*it).second.fValid != fVoteValid) {
+            CountVote((*it).second, -1);
+            (*it).second.fValid = fVoteValid;
+            CountVote((*it).second, 1);
+        }
         ++it;
     }
 }
 
-double CBudgetProposal::GetRatio() const
+void CBudgetProposal::MarkSynced()
 {
-    int yeas = 0;
-    int nays = 0;
-
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_YES)
-            ++yeas;
-        if (i->second.nVote == VOTE_NO)
-            ++nays;
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    while(it != mapVotes.end()) {
+        if((*it).second.fValid)
+            (*it).second.fSynced = true;
+        ++it;
     }
-
-    if(yeas + nays == 0) return 0.0f;
-
-    return ((double)(yeas) / (double)(yeas+nays));
 }
 
-int CBudgetProposal::GetYeas() const
+void CBudgetProposal::ResetSync()
 {
-    int ret = 0;
-
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_YES && i->second.fValid)
-            ++ret;
+    std::map<uint256, CBudgetVote>::iterator it = mapVotes.begin();
+    while(it != mapVotes.end()) {
+        (*it).second.fSynced = false;
+        ++it;
     }
-
-    return ret;
 }
 
-int CBudgetProposal::GetNays() const
+void CBudgetProposal::SwapVotes(CBudgetProposal& other)
 {
-    int ret = 0;
+    using std::swap;
 
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_NO && i->second.fValid)
-            ++ret;
-    }
+    mapVotes.swap(other.mapVotes);
+    swap(nYeas, other.nYeas);
+    swap(nNays, other.nNays);
+    swap(nAbstains, other.nAbstains);
+    swap(nRatioYeas, other.nRatioYeas);
+    swap(nRatioNays, other.nRatioNays);
+}
 
-    return ret;
+// Add (nSign = 1) or remove (nSign = -1) a vote from the running tallies
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nSign)
+{
+    if (vote.nVote == VOTE_YES) {
+        nRatioYeas += nSign;
+        if (vote.fValid)
+            nYeas += nSign;
+    } else if (vote.nVote == VOTE_NO) {
+        nRatioNays += nSign;
+        if (vote.fValid)
+            nNays += nSign;
+    } else if (vote.nVote == VOTE_ABSTAIN && vote.fValid) {
+        nAbstains += nSign;
+    }
 }
 
-int CBudgetProposal::GetAbstains() const
+void CBudgetProposal::RecountVotes()
 {
-    int ret = 0;
+    nYeas = nNays = nAbstains = nRatioYeas = nRatioNays = 0;
+    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i)
+        CountVote(i->second, 1);
+}
 
-    for (std::map<uint256, CBudgetVote>::const_iterator i = mapVotes.begin(); i != mapVotes.end(); ++i) {
-        if (i->second.nVote == VOTE_ABSTAIN && i->second.fValid)
-            ++ret;
-    }
+double CBudgetProposal::GetRatio() const
+{
+    if(nRatioYeas + nRatioNays == 0) return 0.0f;
 
-    return ret;
+    return ((double)(nRatioYeas) / (double)(nRatioYeas+nRatioNays));
 }
 
 int CBudgetProposal::GetBlockStartCycle() const
@@ -1648,7 +1678,7 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!legacySigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrintf("CBudgetVote::Sign - Error upon calling SignMessage");
@@ -1663,10 +1693,15 @@ bool CBudgetVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     return true;
 }
 
+std::string CBudgetVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+}
+
 bool CBudgetVote::SignatureValid(bool fSignatureCheck) const
 {
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nProposalHash.ToString() + boost::lexical_cast<std::string>(nVote) + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
@@ -2322,7 +2357,7 @@ bool BudgetDraftVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     CKey keyCollateralAddress;
 
     std::string errorMessage;
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!legacySigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrintf("BudgetDraftVote::Sign - Error upon calling SignMessage");
@@ -2337,11 +2372,16 @@ bool BudgetDraftVote::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     return true;
 }
 
+std::string BudgetDraftVote::GetSignatureMessage() const
+{
+    return vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+}
+
 bool BudgetDraftVote::SignatureValid(bool fSignatureCheck)
 {
     std::string errorMessage;
 
-    std::string strMessage = vin.prevout.ToStringShort() + nBudgetHash.ToString() + boost::lexical_cast<std::string>(nTime);
+    std::string strMessage = GetSignatureMessage();
 
     CMasternode* pmn = mnodeman.Find(vin);
 
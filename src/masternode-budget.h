@@ -71,6 +71,7 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck) const;
+    std::string GetSignatureMessage() const;
     void Relay();
 
     std::string GetVoteString() const {
@@ -233,6 +234,10 @@ public:
 
 private:
     const BudgetDraft *GetMostVotedBudget(int height) const;
+
+    // apply votes received from pfrom once legacySignerQueue verified their signatures
+    void ProcessVerifiedVote(CNode *pfrom, const CBudgetVote &vote, bool fValid);
+    void ProcessVerifiedDraftVote(CNode *pfrom, const BudgetDraftVote &vote, bool fValid);
 };
 
 class CTxBudgetPayment
@@ -452,6 +457,7 @@ public:
 
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool SignatureValid(bool fSignatureCheck);
+    std::string GetSignatureMessage() const;
     void Relay();
 
     uint256 GetHash() const;
@@ -478,6 +484,8 @@ private:
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
     CAmount nAlloted;
+    // only change through AddOrUpdateVote, CleanAndRemove and the sync flags, the tallies below are kept in sync
+    map<uint256, CBudgetVote> mapVotes;
 
 public:
     bool fValid;
@@ -495,9 +503,19 @@ public:
     mutable int64_t nTime;
     uint256 nFeeTXHash;
 
-    map<uint256, CBudgetVote> mapVotes;
+protected:
     //cache object
+    int nYeas; // valid votes only
+    int nNays;
+    int nAbstains;
+    int nRatioYeas; // all votes, for GetRatio
+    int nRatioNays;
+
+    void CountVote(const CBudgetVote& vote, int nSign);
+    void RecountVotes();
+    void SwapVotes(CBudgetProposal& other);
 
+public:
     CBudgetProposal();
     CBudgetProposal(const CBudgetProposal& other);
     CBudgetProposal(std::string strProposalNameIn, std::string strURLIn, int nBlockStartIn, int nBlockEndIn, CScript addressIn, CAmount nAmountIn, uint256 nFeeTXHashIn);
@@ -506,6 +524,7 @@ public:
     bool AddOrUpdateVote(const CBudgetVote& vote, std::string& strError);
     bool HasMinimumRequiredSupport();
     std::pair<std::string, std::string> GetVotes();
+    const std::map<uint256, CBudgetVote>& GetVoteMap() const { return mapVotes; }
 
     bool IsValid(std::string& strError, bool fCheckCollateral=true) const;
 
@@ -529,14 +548,16 @@ public:
     int GetBlockCurrentCycle() const;
     int GetBlockEndCycle() const;
     double GetRatio() const;
-    int GetYeas() const;
-    int GetNays() const;
-    int GetAbstains() const;
+    int GetYeas() const { return nYeas; }
+    int GetNays() const { return nNays; }
+    int GetAbstains() const { return nAbstains; }
     CAmount GetAmount() const {return nAmount;}
     void SetAllotted(CAmount nAllotedIn) {nAlloted = nAllotedIn;}
     CAmount GetAllotted() const {return nAlloted;}
 
     void CleanAndRemove(bool fSignatureCheck);
+    void MarkSynced();
+    void ResetSync();
 
     uint256 GetHash() const {
         CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
@@ -568,6 +589,8 @@ public:
 
         //for saving to the serialized db
         READWRITE(mapVotes);
+        if (ser_action.ForRead())
+            RecountVotes();
     }
 };
 
@@ -595,7 +618,7 @@ class CBudgetProposalBroadcast : public CBudgetProposal
             swap(first.address, second.address);
             swap(first.nTime, second.nTime);
             swap(first.nFeeTXHash, second.nFeeTXHash);
-            first.mapVotes.swap(second.mapVotes);
+            first.SwapVotes(second);
         }
 
         CBudgetProposalBroadcast& operator=(CBudgetProposalBroadcast from)
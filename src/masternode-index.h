@@ -0,0 +1,108 @@
+// Copyright (c) 2014-2018 The Crown developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MASTERNODE_INDEX_H
+#define MASTERNODE_INDEX_H
+
+#include "crypto/common.h"
+#include "netbase.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "script/standard.h"
+
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+//
+// CMasternodeIndex : Hashed lookups into the Masternode (or Systemnode) list by collateral outpoint,
+// node pubkey, service address and payee. Entries are referenced by their position in the list, so
+// the owner has to call SetDirty() whenever the list or the keys of one of its entries change.
+//
+
+template <typename TNode>
+class CMasternodeIndex
+{
+private:
+    struct CKeyHasher
+    {
+        size_t operator()(const COutPoint& outpoint) const { return outpoint.hash.GetCheapHash() ^ outpoint.n; }
+        size_t operator()(const CKeyID& keyID) const { return ReadLE64(keyID.begin()); }
+        size_t operator()(const CService& addr) const { return addr.GetHash() ^ addr.GetPort(); }
+    };
+
+    boost::unordered_map<COutPoint, size_t, CKeyHasher> mapVin;
+    // pubkey2, the key the node signs its messages with
+    boost::unordered_map<CKeyID, size_t, CKeyHasher> mapPubKey;
+    // pubkey, the collateral key that gets paid
+    boost::unordered_map<CKeyID, size_t, CKeyHasher> mapPayee;
+    boost::unordered_map<CService, size_t, CKeyHasher> mapAddr;
+    bool fDirty;
+
+    void Rebuild(const std::vector<TNode>& vNodes)
+    {
+        mapVin.clear();
+        mapPubKey.clear();
+        mapPayee.clear();
+        mapAddr.clear();
+        // insert() keeps the first entry for duplicated keys, like the linear scans did
+        for (size_t i = 0; i < vNodes.size(); i++) {
+            mapVin.insert(std::make_pair(vNodes[i].vin.prevout, i));
+            mapPubKey.insert(std::make_pair(vNodes[i].pubkey2.GetID(), i));
+            mapPayee.insert(std::make_pair(vNodes[i].pubkey.GetID(), i));
+            mapAddr.insert(std::make_pair(vNodes[i].addr, i));
+        }
+        fDirty = false;
+    }
+
+    template <typename TMap, typename TKey, typename TMatch>
+    TNode* Lookup(std::vector<TNode>& vNodes, const TMap& map, const TKey& key, TMatch fMatch)
+    {
+        if (fDirty)
+            Rebuild(vNodes);
+        typename TMap::const_iterator it = map.find(key);
+        if (it == map.end())
+            return NULL;
+        if (it->second < vNodes.size() && fMatch(vNodes[it->second]))
+            return &vNodes[it->second];
+        // A change was not reported, fall back to a fresh index
+        Rebuild(vNodes);
+        it = map.find(key);
+        return it == map.end() ? NULL : &vNodes[it->second];
+    }
+
+public:
+    CMasternodeIndex() : fDirty(true) {}
+
+    void SetDirty() { fDirty = true; }
+
+    TNode* Find(std::vector<TNode>& vNodes, const COutPoint& outpoint)
+    {
+        return Lookup(vNodes, mapVin, outpoint, [&](const TNode& node) { return node.vin.prevout == outpoint; });
+    }
+
+    TNode* Find(std::vector<TNode>& vNodes, const CPubKey& pubkey)
+    {
+        return Lookup(vNodes, mapPubKey, pubkey.GetID(), [&](const TNode& node) { return node.pubkey2 == pubkey; });
+    }
+
+    TNode* Find(std::vector<TNode>& vNodes, const CService& addr)
+    {
+        return Lookup(vNodes, mapAddr, addr, [&](const TNode& node) { return node.addr == addr; });
+    }
+
+    TNode* Find(std::vector<TNode>& vNodes, const CScript& payee)
+    {
+        // Nodes are paid to the P2PKH script of their collateral key, nothing else can match
+        CTxDestination dest;
+        if (!ExtractDestination(payee, dest))
+            return NULL;
+        const CKeyID* keyID = boost::get<CKeyID>(&dest);
+        if (keyID == NULL || GetScriptForDestination(*keyID) != payee)
+            return NULL;
+        return Lookup(vNodes, mapPayee, *keyID, [&](const TNode& node) { return node.pubkey.GetID() == *keyID; });
+    }
+};
+
+#endif
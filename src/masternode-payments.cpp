@@ -260,7 +260,8 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
             return;
         }
 
-        if(!winner.SignatureValid()){
+        CMasternode* pmn = mnodeman.Find(winner.vinMasternode);
+        if(pmn == NULL){
             LogPrintf("mnw - invalid signature\n");
             if(masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
             // it could just be a non-synced masternode
@@ -268,16 +269,31 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
             return;
         }
 
-        CTxDestination address1;
-        ExtractDestination(winner.payee, address1);
-        CBitcoinAddress address2(address1);
+        legacySignerQueue.Push(pfrom, CSignedMessage(pmn->pubkey2, winner.vchSig, winner.GetSignatureMessage()),
+            [this, winner, nHeight](CNode* pnode, bool fValid) { ProcessVerifiedWinner(pnode, winner, nHeight, fValid); });
+    }
+}
+
+void CMasternodePayments::ProcessVerifiedWinner(CNode* pfrom, const CMasternodePaymentWinner& winnerIn, int nHeight, bool fValid)
+{
+    CMasternodePaymentWinner winner(winnerIn);
+    if(!fValid){
+        LogPrintf("mnw - invalid signature\n");
+        if(masternodeSync.IsSynced()) Misbehaving(pfrom->GetId(), 20);
+        // it could just be a non-synced masternode
+        mnodeman.AskForMN(pfrom, winner.vinMasternode);
+        return;
+    }
 
-        LogPrint("mnpayments", "mnw - winning vote - Addr %s Height %d bestHeight %d - %s\n", address2.ToString().c_str(), winner.nBlockHeight, nHeight, winner.vinMasternode.prevout.ToStringShort());
+    CTxDestination address1;
+    ExtractDestination(winner.payee, address1);
+    CBitcoinAddress address2(address1);
 
-        if(masternodePayments.AddWinningMasternode(winner)){
-            winner.Relay();
-            masternodeSync.AddedMasternodeWinner(winner.GetHash());
-        }
+    LogPrint("mnpayments", "mnw - winning vote - Addr %s Height %d bestHeight %d - %s\n", address2.ToString().c_str(), winner.nBlockHeight, nHeight, winner.vinMasternode.prevout.ToStringShort());
+
+    if(AddWinningMasternode(winner)){
+        winner.Relay();
+        masternodeSync.AddedMasternodeWinner(winner.GetHash());
     }
 }
 
@@ -286,9 +302,7 @@ bool CMasternodePaymentWinner::Sign(CKey& keyMasternode, CPubKey& pubKeyMasterno
     std::string errorMessage;
     std::string strMasterNodeSignMessage;
 
-    std::string strMessage =  vinMasternode.prevout.ToStringShort() +
-                boost::lexical_cast<std::string>(nBlockHeight) +
-                payee.ToString();
+    std::string strMessage = GetSignatureMessage();
 
     if(!legacySigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrintf("CMasternodePing::Sign() - Error: %s\n", errorMessage.c_str());
@@ -367,11 +381,62 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
 
     int n = 1;
     if(IsReferenceNode(winnerIn.vinMasternode)) n = 100;
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, n);
+    {
+        LOCK(cs_mapMasternodeBlocks);
+        CMasternodeBlockPayees& blockPayees = mapMasternodeBlocks[winnerIn.nBlockHeight];
+        blockPayees.AddPayee(winnerIn.payee, n);
+        if(blockPayees.HasPayeeWithVotes(winnerIn.payee, 2))
+            mapPayeeHeights[winnerIn.payee].insert(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CMasternodePayments::IndexPayeeHeights()
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    mapPayeeHeights.clear();
+    BOOST_FOREACH(PAIRTYPE(const int, CMasternodeBlockPayees)& blockPayees, mapMasternodeBlocks) {
+        BOOST_FOREACH(CMasternodePayee& payee, blockPayees.second.vecPayments) {
+            if(payee.nVotes >= 2)
+                mapPayeeHeights[payee.scriptPubKey].insert(blockPayees.first);
+        }
+    }
+}
+
+void CMasternodePayments::RemoveBlockPayees(int nBlockHeight)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+
+    std::map<int, CMasternodeBlockPayees>::iterator it = mapMasternodeBlocks.find(nBlockHeight);
+    if(it == mapMasternodeBlocks.end()) return;
+
+    BOOST_FOREACH(CMasternodePayee& payee, it->second.vecPayments) {
+        std::map<CScript, std::set<int> >::iterator itHeights = mapPayeeHeights.find(payee.scriptPubKey);
+        if(itHeights == mapPayeeHeights.end()) continue;
+        itHeights->second.erase(nBlockHeight);
+        if(itHeights->second.empty())
+            mapPayeeHeights.erase(itHeights);
+    }
+    mapMasternodeBlocks.erase(it);
+}
+
+int CMasternodePayments::GetLastPaidHeight(const CScript& payee, int nMaxHeight, int nMinHeight)
+{
+    LOCK(cs_mapMasternodeBlocks);
+
+    std::map<CScript, std::set<int> >::const_iterator it = mapPayeeHeights.find(payee);
+    if(it == mapPayeeHeights.end()) return 0;
+
+    // the first height above nMaxHeight, the one before it is the last payment up to nMaxHeight
+    std::set<int>::const_iterator itHeight = it->second.upper_bound(nMaxHeight);
+    if(itHeight == it->second.begin()) return 0;
+    --itHeight;
+
+    return *itHeight >= nMinHeight ? *itHeight : 0;
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew, const CAmount& nValueCreated)
 {
     LOCK(cs_vecPayments);
@@ -495,7 +560,7 @@ void CMasternodePayments::CheckAndRemove()
             LogPrint("mnpayments", "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
             masternodeSync.mapSeenSyncMNW.erase((*it).first);
             mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
+            RemoveBlockPayees(winner.nBlockHeight);
         } else {
             ++it;
         }
@@ -638,6 +703,13 @@ void CMasternodePaymentWinner::Relay()
     RelayInv(inv);
 }
 
+std::string CMasternodePaymentWinner::GetSignatureMessage() const
+{
+    return vinMasternode.prevout.ToStringShort() +
+                boost::lexical_cast<std::string>(nBlockHeight) +
+                payee.ToString();
+}
+
 bool CMasternodePaymentWinner::SignatureValid()
 {
 
@@ -645,9 +717,7 @@ bool CMasternodePaymentWinner::SignatureValid()
 
     if(pmn != NULL)
     {
-        std::string strMessage =  vinMasternode.prevout.ToStringShort() +
-                    boost::lexical_cast<std::string>(nBlockHeight) +
-                    payee.ToString();
+        std::string strMessage = GetSignatureMessage();
 
         std::string errorMessage = "";
         if(!legacySigner.VerifyMessage(pmn->pubkey2, vchSig, strMessage, errorMessage)){
@@ -11,6 +11,8 @@
 #include "masternode.h"
 #include <boost/lexical_cast.hpp>
 
+#include <set>
+
 using namespace std;
 
 extern CCriticalSection cs_vecPayments;
@@ -161,6 +163,7 @@ public:
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
+    std::string GetSignatureMessage() const;
     void Relay();
 
     void AddPayee(CScript payeeIn){
@@ -200,6 +203,14 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // apply a winner received from pfrom once legacySignerQueue verified its signature
+    void ProcessVerifiedWinner(CNode* pfrom, const CMasternodePaymentWinner& winner, int nHeight, bool fValid);
+
+    // heights at which each payee has at least 2 votes, the payments GetLastPaid counts
+    std::map<CScript, std::set<int> > mapPayeeHeights;
+    void IndexPayeeHeights();
+    void RemoveBlockPayees(int nBlockHeight);
+
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
     std::map<int, CMasternodeBlockPayees> mapMasternodeBlocks;
@@ -214,6 +225,7 @@ public:
         LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
         mapMasternodeBlocks.clear();
         mapMasternodePayeeVotes.clear();
+        mapPayeeHeights.clear();
     }
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
@@ -224,6 +236,8 @@ public:
     int LastPayment(CMasternode& mn);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
+    /** The last height from nMinHeight to nMaxHeight at which payee has at least 2 votes, 0 if none */
+    int GetLastPaidHeight(const CScript& payee, int nMaxHeight, int nMinHeight);
     bool IsTransactionValid(const CAmount& nValueCreated, const CTransaction& txNew, int nBlockHeight);
     bool IsScheduled(CMasternode& mn, int nNotBlockHeight);
 
@@ -243,6 +257,8 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead())
+            IndexPayeeHeights();
     }
 };
 
@@ -6,6 +6,7 @@
 #include "masternode.h"
 #include "masternodeman.h"
 #include "legacysigner.h"
+#include "collateraltracker.h"
 #include "util.h"
 #include "sync.h"
 #include "addrman.h"
@@ -159,7 +160,7 @@ arith_uint256 CMasternode::CalculateScore(int64_t nBlockHeight) const
         return arith_uint256();
 
     // Find the block hash where tx got MASTERNODE_MIN_CONFIRMATIONS
-    CBlockIndex *pblockIndex = chainActive[GetInputHeight(vin) + MASTERNODE_MIN_CONFIRMATIONS - 1];
+    CBlockIndex *pblockIndex = chainActive[collateralTracker.GetHeight(vin) + MASTERNODE_MIN_CONFIRMATIONS - 1];
     if (!pblockIndex)
         return arith_uint256();
     uint256 collateralMinConfBlockHash = pblockIndex->GetBlockHash();
@@ -199,21 +200,12 @@ void CMasternode::Check(bool forceCheck)
     }
 
     if(!unitTest){
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut((MASTERNODE_COLLATERAL - 0.01)*COIN, legacySigner.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
+        bool fSpent = false;
+        if(!collateralTracker.IsSpent(vin, MASTERNODE_COLLATERAL, fSpent)) return;
 
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if(!lockMain) return;
-
-            if(!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)){
-                activeState = MASTERNODE_VIN_SPENT;
-                return;
-
-            }
+        if(fSpent){
+            activeState = MASTERNODE_VIN_SPENT;
+            return;
         }
     }
 
@@ -263,69 +255,19 @@ int64_t CMasternode::GetLastPaid() const
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = UintToArith256(hash).GetCompact(false) % 150; 
 
-    if (chainActive.Tip() == NULL) return false;
-
-    const CBlockIndex *BlockReading = chainActive.Tip();
-
     int nMnCount = mnodeman.CountEnabled()*1.25;
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nMnCount){
-            return 0;
-        }
-        n++;
 
-        if(masternodePayments.mapMasternodeBlocks.count(BlockReading->nHeight)){
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network 
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if(masternodePayments.mapMasternodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(mnpayee, 2)){
-                return BlockReading->nTime + nOffset;
-            }
-        }
-
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
-    }
+    /*
+        Search the last nMnCount blocks for this payee, with at least 2 votes. This will aid in consensus allowing
+        the network to converge on the same payees quickly, then keep the same schedule.
+    */
+    int nHeight = masternodePayments.GetLastPaidHeight(mnpayee, pindexPrev->nHeight, std::max(pindexPrev->nHeight - nMnCount + 1, 1));
+    if(nHeight == 0) return 0;
 
-    return 0;
+    return chainActive[nHeight]->nTime + nOffset;
 }
 
 
-// Find all blocks where MN received reward within defined block depth
-// Used for generating stakepointers
-bool CMasternode::GetRecentPaymentBlocks(std::vector<const CBlockIndex*>& vPaymentBlocks, bool limitMostRecent) const
-{
-    vPaymentBlocks.clear();
-
-    int nMinimumValidBlockHeight = chainActive.Height() - Params().ValidStakePointerDuration() + 1;
-    if (nMinimumValidBlockHeight < 1)
-        nMinimumValidBlockHeight = 1;
-
-    CBlockIndex* pindex = chainActive[nMinimumValidBlockHeight];
-
-    CScript mnpayee;
-    mnpayee = GetScriptForDestination(pubkey.GetID());
-
-    bool fBlockFound = false;
-    while (chainActive.Next(pindex)) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
-            continue;
-
-        if (block.vtx[0].vout.size() > 1 && block.vtx[0].vout[1].scriptPubKey == mnpayee) {
-            vPaymentBlocks.emplace_back(pindex);
-            fBlockFound = true;
-            if (limitMostRecent)
-                return fBlockFound;
-        }
-        pindex = chainActive.Next(pindex);
-    }
-
-    return fBlockFound;
-}
-
 CMasternodeBroadcast::CMasternodeBroadcast()
 {
     vin = CTxIn();
@@ -610,6 +552,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos) const
         //take the newest entry
         LogPrintf("mnb - Got updated entry for %s\n", addr.ToString());
         if(pmn->UpdateFromNewBroadcast((*this))){
+            mnodeman.InvalidateIndex();
             pmn->Check();
             if(pmn->IsEnabled()) Relay();
         }
@@ -794,7 +737,7 @@ bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMaste
     std::string strMasterNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
 
     if(!legacySigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrintf("CMasternodePing::Sign() - Error: %s\n", errorMessage);
@@ -806,13 +749,12 @@ bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMaste
         return false;
     }
 
-    uint256 hash = Hash(vPrevBlockHash.begin(), vPrevBlockHash.end());
-    if(!legacySigner.SignMessage(hash.GetHex(), errorMessage, vchSigPrevBlocks, keyMasternode)) {
+    if(!legacySigner.SignMessage(GetPrevBlocksSignatureMessage(), errorMessage, vchSigPrevBlocks, keyMasternode)) {
         LogPrintf("CMasternodePing::Sign() - Error signing previous blocks: %s\n", errorMessage);
         return false;
     }
 
-    if(!legacySigner.VerifyMessage(pubKeyMasternode, vchSigPrevBlocks, hash.GetHex(), errorMessage)) {
+    if(!legacySigner.VerifyMessage(pubKeyMasternode, vchSigPrevBlocks, GetPrevBlocksSignatureMessage(), errorMessage)) {
         LogPrintf("CMasternodePing::Sign() - Error: %s\n", errorMessage);
         return false;
     }
@@ -820,9 +762,19 @@ bool CMasternodePing::Sign(const CKey& keyMasternode, const CPubKey& pubKeyMaste
     return true;
 }
 
+std::string CMasternodePing::GetSignatureMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
+
+std::string CMasternodePing::GetPrevBlocksSignatureMessage() const
+{
+    return Hash(vPrevBlockHash.begin(), vPrevBlockHash.end()).GetHex();
+}
+
 bool CMasternodePing::VerifySignature(const CPubKey& pubKeyMasternode, int &nDos) const
 {
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetSignatureMessage();
     std::string errorMessage = "";
 
     if(!legacySigner.VerifyMessage(pubKeyMasternode, vchSig, strMessage, errorMessage))
@@ -834,8 +786,7 @@ bool CMasternodePing::VerifySignature(const CPubKey& pubKeyMasternode, int &nDos
 
     //Also check signature of previous blockhashes
     if (nVersion > 1) {
-        uint256 hash = Hash(vPrevBlockHash.begin(), vPrevBlockHash.end());
-        if (!legacySigner.VerifyMessage(pubKeyMasternode, vchSigPrevBlocks, hash.GetHex(), errorMessage)) {
+        if (!legacySigner.VerifyMessage(pubKeyMasternode, vchSigPrevBlocks, GetPrevBlocksSignatureMessage(), errorMessage)) {
             LogPrintf("CMasternodePing::VerifySignature - Got bad Masternode signature for previous blocks %s Error: %s\n", vin.ToString(), errorMessage);
             nDos = 33;
             return false;
@@ -845,7 +796,7 @@ bool CMasternodePing::VerifySignature(const CPubKey& pubKeyMasternode, int &nDos
     return true;
 }
 
-bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fCheckSigTimeOnly) const
+bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fCheckSigTimeOnly, bool fSignatureChecked) const
 {
     if (sigTime > GetAdjustedTime() + 60 * 60) {
         LogPrintf("CMasternodePing::CheckAndUpdate - Signature rejected, too far into the future %s\n", vin.ToString());
@@ -878,7 +829,7 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled, bool fChec
         // last ping was more then MASTERNODE_MIN_MNP_SECONDS-60 ago comparing to this one
         if(!pmn->IsPingedWithin(MASTERNODE_MIN_MNP_SECONDS - 60, sigTime))
         {
-            if(!VerifySignature(pmn->pubkey2, nDos))
+            if(!fSignatureChecked && !VerifySignature(pmn->pubkey2, nDos))
                 return false;
 
             BlockMap::iterator mi = mapBlockIndex.find(blockHash);
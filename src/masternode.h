@@ -72,9 +72,12 @@ public:
         }
     }
 
-    bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true, bool fCheckSigTimeOnly = false) const;
+    /// fSignatureChecked skips verifying the signatures against the current key of the Masternode
+    bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true, bool fCheckSigTimeOnly = false, bool fSignatureChecked = false) const;
     bool Sign(const CKey& keyMasternode, const CPubKey& pubKeyMasternode);
     bool VerifySignature(const CPubKey& pubKeyMasternode, int &nDos) const;
+    std::string GetSignatureMessage() const;
+    std::string GetPrevBlocksSignatureMessage() const;
     void Relay() const;
 
     uint256 GetHash() const
@@ -281,8 +284,6 @@ public:
     }
 
     int64_t GetLastPaid() const;
-
-    bool GetRecentPaymentBlocks(std::vector<const CBlockIndex*>& vPaymentBlocks, bool limitMostRecent = false) const;
 };
 
 //
@@ -8,6 +8,7 @@
 #include "systemnodeman.h"
 #include "activemasternode.h"
 #include "legacysigner.h"
+#include "collateraltracker.h"
 #include "util.h"
 #include "addrman.h"
 #include "spork.h"
@@ -35,15 +36,6 @@ struct CompareScoreTxIn
     }
 };
 
-struct CompareScoreMN
-{
-    bool operator()(const pair<int64_t, CMasternode>& t1,
-                    const pair<int64_t, CMasternode>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 CMasternodeMan::CMasternodeMan() {
     nDsqCount = 0;
 }
@@ -60,6 +52,8 @@ bool CMasternodeMan::Add(const CMasternode &mn)
     {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.addr.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        index.SetDirty();
+        InvalidateRankCache();
         return true;
     }
 
@@ -130,7 +124,10 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            collateralTracker.Forget((*it).vin.prevout);
             it = vMasternodes.erase(it);
+            index.SetDirty();
+            InvalidateRankCache();
         } else {
             ++it;
         }
@@ -193,17 +190,23 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
+    BOOST_FOREACH(const CMasternode& mn, vMasternodes)
+        collateralTracker.Forget(mn.vin.prevout);
     vMasternodes.clear();
+    index.SetDirty();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
     mapSeenMasternodeBroadcast.clear();
     mapSeenMasternodePing.clear();
+    mapRankCache.clear();
     nDsqCount = 0;
 }
 
 int CMasternodeMan::CountEnabled(int protocolVersion)
 {
+    LOCK(cs);
+
     int i = 0;
     protocolVersion = protocolVersion == -1 ? masternodePayments.GetMinMasternodePaymentsProto() : protocolVersion;
 
@@ -241,52 +244,26 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
 CMasternode *CMasternodeMan::Find(const CScript &payee)
 {
     LOCK(cs);
-    CScript payee2;
-
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        payee2 = GetScriptForDestination(mn.pubkey.GetID());
-        if(payee2 == payee)
-            return &mn;
-    }
-    return NULL;
+    return index.Find(vMasternodes, payee);
 }
 
 CMasternode *CMasternodeMan::Find(const CTxIn &vin)
 {
     LOCK(cs);
-
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.vin.prevout == vin.prevout)
-            return &mn;
-    }
-    return NULL;
+    return index.Find(vMasternodes, vin.prevout);
 }
 
 
 CMasternode *CMasternodeMan::Find(const CPubKey &pubKeyMasternode)
 {
     LOCK(cs);
-
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.pubkey2 == pubKeyMasternode)
-            return &mn;
-    }
-    return NULL;
+    return index.Find(vMasternodes, pubKeyMasternode);
 }
 
 CMasternode *CMasternodeMan::Find(const CService& addr)
 {
     LOCK(cs);
-
-    BOOST_FOREACH(CMasternode& mn, vMasternodes)
-    {
-        if(mn.addr == addr)
-            return &mn;
-    }
-    return NULL;
+    return index.Find(vMasternodes, addr);
 }
 
 // 
@@ -389,128 +366,180 @@ CMasternode *CMasternodeMan::FindRandomNotInVec(std::vector<CTxIn> &vecToExclude
 
 CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
-    int64_t score = 0;
-    CMasternode* winner = NULL;
-
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        mn.Check();
-        if(mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
+    LOCK(cs);
 
-        // calculate the score for each Masternode
-        arith_uint256 n = mn.CalculateScore(nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    const CMasternodeRankTable* pranks = GetRankTable(nBlockHeight, minProtocol, true);
+    if(!pranks || pranks->vecScores.empty()) return NULL;
 
-        // determine the winner
-        if(n2 > score){
-            score = n2;
-            winner = &mn;
-        }
-    }
+    // the winner must have a valid score
+    if(pranks->vecScores.front().first <= 0) return NULL;
 
-    return winner;
+    return Find(pranks->vecScores.front().second);
 }
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
 
-    //make sure we know about this block
-    uint256 hash = uint256();
-    if(!GetBlockHash(hash, nBlockHeight)) return -1;
+    const CMasternodeRankTable* pranks = GetRankTable(nBlockHeight, minProtocol, fOnlyActive);
+    if(!pranks) return -1;
 
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-        if(mn.protocolVersion < minProtocol) continue;
-        if(fOnlyActive) {
-            mn.Check();
-            if(!mn.IsEnabled()) continue;
-        }
-        arith_uint256 n = mn.CalculateScore(nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
+    return pranks->GetRank(vin.prevout);
+}
 
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
+std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
+{
+    LOCK(cs);
+
+    std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    const CMasternodeRankTable* pranks = GetRankTable(nBlockHeight, minProtocol, true);
+    if(!pranks) return vecMasternodeRanks;
 
     int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn)& s, vecMasternodeScores){
+    BOOST_FOREACH (const PAIRTYPE(int64_t, CTxIn)& s, pranks->vecScores){
         rank++;
-        if(s.second.prevout == vin.prevout) {
-            return rank;
-        }
+        CMasternode* pmn = Find(s.second);
+        if(pmn) vecMasternodeRanks.push_back(make_pair(rank, *pmn));
     }
 
-    return -1;
+    return vecMasternodeRanks;
+}
+
+CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+{
+    LOCK(cs);
+
+    const CMasternodeRankTable* pranks = GetRankTable(nBlockHeight, minProtocol, fOnlyActive);
+    if(!pranks || nRank < 1 || nRank > (int)pranks->vecScores.size()) return NULL;
+
+    return Find(pranks->vecScores[nRank - 1].second);
 }
 
-std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
+const CMasternodeRankTable* CMasternodeMan::GetRankTable(int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
-    std::vector<pair<int, CMasternode> > vecMasternodeRanks;
+    AssertLockHeld(cs);
+
+    std::tuple<int64_t, int, bool> key = std::make_tuple(nBlockHeight, minProtocol, fOnlyActive);
+    std::map<std::tuple<int64_t, int, bool>, CMasternodeRankTable>::iterator it = mapRankCache.find(key);
 
     //make sure we know about this block
     uint256 hash = uint256();
-    if(!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
+    {
+        // callers like InstantSend hold their own locks here, so don't wait for cs_main with cs held
+        TRY_LOCK(cs_main, lockMain);
+        if(!lockMain) return it != mapRankCache.end() ? &it->second : NULL;
+        if(!GetBlockHash(hash, nBlockHeight)) return NULL;
+    }
 
-    // scan for winner
-    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
+    if(it != mapRankCache.end() && it->second.blockHash == hash) {
+        // masternode states are refreshed no more often than every MASTERNODE_CHECK_SECONDS anyway
+        if(GetTime() - it->second.nTimeChecked < MASTERNODE_CHECK_SECONDS) return &it->second;
 
-        mn.Check();
+        if(IsRankTableCurrent(it->second, minProtocol, fOnlyActive)) {
+            it->second.nTimeChecked = GetTime();
+            return &it->second;
+        }
+    }
+
+    CMasternodeRankTable table;
+    table.blockHash = hash;
+    table.nTimeChecked = GetTime();
 
+    BOOST_FOREACH(CMasternode& mn, vMasternodes) {
         if(mn.protocolVersion < minProtocol) continue;
-        if(!mn.IsEnabled()) {
-            continue;
+        if(fOnlyActive) {
+            mn.Check();
+            if(!mn.IsEnabled()) continue;
         }
 
         arith_uint256 n = mn.CalculateScore(nBlockHeight);
         int64_t n2 = n.GetCompact(false);
 
-        vecMasternodeScores.push_back(make_pair(n2, mn));
+        table.vecScores.push_back(make_pair(n2, mn.vin));
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+    sort(table.vecScores.rbegin(), table.vecScores.rend(), CompareScoreTxIn());
 
     int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode)& s, vecMasternodeScores){
+    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn)& s, table.vecScores){
         rank++;
-        vecMasternodeRanks.push_back(make_pair(rank, s.second));
+        table.mapRanks.insert(make_pair(s.second.prevout, rank));
     }
 
-    return vecMasternodeRanks;
+    if(it == mapRankCache.end()) {
+        // forget the oldest heights first
+        if(mapRankCache.size() >= MASTERNODES_RANK_CACHE_SIZE) mapRankCache.erase(mapRankCache.begin());
+        it = mapRankCache.insert(make_pair(key, CMasternodeRankTable())).first;
+    }
+    it->second = table;
+
+    return &it->second;
 }
 
-CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
+bool CMasternodeMan::IsRankTableCurrent(const CMasternodeRankTable& table, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    AssertLockHeld(cs);
 
-    // scan for winner
+    unsigned int nCount = 0;
     BOOST_FOREACH(CMasternode& mn, vMasternodes) {
-
         if(mn.protocolVersion < minProtocol) continue;
         if(fOnlyActive) {
             mn.Check();
             if(!mn.IsEnabled()) continue;
         }
 
-        arith_uint256 n = mn.CalculateScore(nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
+        if(!table.mapRanks.count(mn.vin.prevout)) return false;
+        nCount++;
     }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
+    return nCount == table.vecScores.size();
+}
 
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn)& s, vecMasternodeScores){
-        rank++;
-        if(rank == nRank) {
-            return Find(s.second);
-        }
+void CMasternodeMan::InvalidateRankCache()
+{
+    LOCK(cs);
+    mapRankCache.clear();
+}
+
+void CMasternodeMan::ProcessPing(CNode* pfrom, const CMasternodePing& mnp, const CPubKey& pubkeyVerified)
+{
+    int nDoS = 0;
+    LOCK(cs_main);
+
+    // Invalid signatures or a key changed in the meantime take the regular path, which verifies and scores them again
+    CMasternode* pmn = Find(mnp.vin);
+    bool fSignatureChecked = pubkeyVerified.IsValid() && pmn != NULL && pmn->pubkey2 == pubkeyVerified;
+    if(mnp.CheckAndUpdate(nDoS, true, false, fSignatureChecked)) return;
+
+    if(nDoS > 0) {
+        // if anything significant failed, mark that node
+        Misbehaving(pfrom->GetId(), nDoS);
+    } else {
+        // if nothing significant failed, search existing Masternode list
+        // if it's known, don't ask for the mnb, just return
+        if(pmn != NULL) return;
     }
 
-    return NULL;
+    // something significant is broken or mn is unknown,
+    // we might have to ask for a masternode entry once
+    AskForMN(pfrom, mnp.vin);
+}
+
+void CMasternodeMan::InvalidateIndex()
+{
+    LOCK(cs);
+    index.SetDirty();
+}
+
+void CMasternodeMan::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    if(!pindex) return;
+
+    LOCK(cs);
+
+    // payment votes for the block ten blocks ahead are ranked by the scores of 100 blocks before it
+    GetRankTable(pindex->nHeight + 10 - 100, MIN_MNW_PEER_PROTO_VERSION, true);
 }
 
 void CMasternodeMan::ProcessMasternodeConnections()
@@ -572,23 +601,22 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
         if(mapSeenMasternodePing.count(mnp.GetHash())) return; //seen
         mapSeenMasternodePing.insert(make_pair(mnp.GetHash(), mnp));
 
-        int nDoS = 0;
-        LOCK(cs_main);
-        if(mnp.CheckAndUpdate(nDoS)) return;
-
-        if(nDoS > 0) {
-            // if anything significant failed, mark that node
-            Misbehaving(pfrom->GetId(), nDoS);
-        } else {
-            // if nothing significant failed, search existing Masternode list
-            CMasternode* pmn = Find(mnp.vin);
-            // if it's known, don't ask for the mnb, just return
-            if(pmn != NULL) return;
+        CMasternode* pmn = Find(mnp.vin);
+        if(pmn == NULL) {
+            ProcessPing(pfrom, mnp, CPubKey());
+            return;
         }
 
-        // something significant is broken or mn is unknown,
-        // we might have to ask for a masternode entry once
-        AskForMN(pfrom, mnp.vin);
+        std::vector<CSignedMessage> vMessages;
+        vMessages.push_back(CSignedMessage(pmn->pubkey2, mnp.vchSig, mnp.GetSignatureMessage()));
+        if(mnp.nVersion > 1)
+            vMessages.push_back(CSignedMessage(pmn->pubkey2, mnp.vchSigPrevBlocks, mnp.GetPrevBlocksSignatureMessage()));
+
+        CPubKey pubkey = pmn->pubkey2;
+        legacySignerQueue.Push(pfrom, vMessages, [this, mnp, pubkey](CNode* pnode, bool fValid) {
+            LOCK(cs_process_message);
+            ProcessPing(pnode, mnp, fValid ? pubkey : CPubKey());
+        });
 
     } else if (strCommand == "dseg") { //Get Masternode list or specific entry
 
@@ -654,7 +682,10 @@ void CMasternodeMan::Remove(CTxIn vin)
     while(it != vMasternodes.end()){
         if((*it).vin == vin){
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).addr.ToString(), size() - 1);
+            collateralTracker.Forget((*it).vin.prevout);
             vMasternodes.erase(it);
+            index.SetDirty();
+            InvalidateRankCache();
             break;
         }
         ++it;
@@ -686,8 +717,9 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast mnb) {
     {
         CMasternode mn(mnb);
         Add(mn);
-    } else {
-        pmn->UpdateFromNewBroadcast(mnb);
+    } else if(pmn->UpdateFromNewBroadcast(mnb)) {
+        InvalidateIndex();
+        InvalidateRankCache();
     }
 }
 
@@ -13,9 +13,13 @@
 #include "base58.h"
 #include "main.h"
 #include "masternode.h"
+#include "masternode-index.h"
+
+#include <tuple>
 
 #define MASTERNODES_DUMP_SECONDS               (15*60)
 #define MASTERNODES_DSEG_SECONDS               (3*60*60)
+#define MASTERNODES_RANK_CACHE_SIZE            32
 
 using namespace std;
 
@@ -24,6 +28,27 @@ class CMasternodeMan;
 extern CMasternodeMan mnodeman;
 void DumpMasternodes();
 
+//
+// Masternode scores for a single block height, ordered from the best to the worst
+//
+class CMasternodeRankTable
+{
+public:
+    uint256 blockHash;
+    int64_t nTimeChecked;
+    std::vector<pair<int64_t, CTxIn> > vecScores;
+    std::map<COutPoint, int> mapRanks;
+
+    CMasternodeRankTable() : nTimeChecked(0) {}
+
+    /// Return the 1-based rank of the given collateral or -1 if it is not ranked
+    int GetRank(const COutPoint& outpoint) const
+    {
+        std::map<COutPoint, int>::const_iterator it = mapRanks.find(outpoint);
+        return it == mapRanks.end() ? -1 : it->second;
+    }
+};
+
 class CMasternodeMan
 {
 private:
@@ -35,12 +60,24 @@ private:
 
     // map to hold all MNs
     std::vector<CMasternode> vMasternodes;
+    // hashed lookups into vMasternodes
+    CMasternodeIndex<CMasternode> index;
     // who's asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForMasternodeList;
     // who we asked for the Masternode list and the last time
     std::map<CNetAddr, int64_t> mWeAskedForMasternodeList;
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
+    // ranks for recent block heights, keyed by (height, min protocol, only active)
+    std::map<std::tuple<int64_t, int, bool>, CMasternodeRankTable> mapRankCache;
+
+    /// Get the ranks for the given height, (re)calculating them when needed. cs_main is only tried for
+    /// the block hash, while it is busy the cached ranks are used.
+    const CMasternodeRankTable* GetRankTable(int64_t nBlockHeight, int minProtocol, bool fOnlyActive);
+    /// Check whether the set of ranked Masternodes still matches the list
+    bool IsRankTableCurrent(const CMasternodeRankTable& table, int minProtocol, bool fOnlyActive);
+    /// Apply a ping received from pfrom, pubkeyVerified is the key its signatures were verified against, if any
+    void ProcessPing(CNode* pfrom, const CMasternodePing& mnp, const CPubKey& pubkeyVerified);
 
 public:
     // Keep track of all broadcasts I've seen
@@ -57,6 +94,8 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         LOCK(cs);
         READWRITE(vMasternodes);
+        if (ser_action.ForRead())
+            index.SetDirty();
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -109,6 +148,13 @@ public:
     int GetMasternodeRank(const CTxIn &vin, int64_t nBlockHeight, int minProtocol=0, bool fOnlyActive=true);
     CMasternode* GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol=0, bool fOnlyActive=true);
 
+    /// Drop all cached ranks, must be called whenever the list changes
+    void InvalidateRankCache();
+    /// Must be called whenever the address or pubkey of a listed Masternode changes
+    void InvalidateIndex();
+    /// Precalculate ranks used by the payment voting for the new tip
+    void UpdatedBlockTip(const CBlockIndex* pindex);
+
     void ProcessMasternodeConnections();
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -30,8 +30,8 @@
 #include "mn-pos/stakeminer.h"
 #include "spork.h"
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
 #include <mn-pos/stakevalidation.h>
 
 using namespace std;
@@ -41,63 +41,339 @@ using namespace std;
 // CrownMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
+uint64_t nLastBlockTx = 0;
+uint64_t nLastBlockSize = 0;
+std::atomic<int64_t> nLastBlockTemplateTime(0);
+
+// We want to sort transactions by priority, so:
+typedef std::pair<double, CTxMemPool::txiter> TxCoinAgePriority;
+struct TxCoinAgePriorityCompare
 {
-public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
+    bool operator()(const TxCoinAgePriority& a, const TxCoinAgePriority& b)
+    {
+        if (a.first == b.first)
+            return CompareTxMemPoolEntryByScore()(*(b.second), *(a.second)); //Reverse order to make sort less than
+        return a.first < b.first;
+    }
+};
 
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+// Sort the transactions of a package so that parents come before their children
+struct CompareTxIterByAncestorCount
+{
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
     {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
     }
 };
 
-uint64_t nLastBlockTx = 0;
-uint64_t nLastBlockSize = 0;
+void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
+{
+    pblock->nTime = std::max(pindexPrev->GetMedianTimePast()+1, GetAdjustedTime());
+
+    // Updating time can change work required on testnet:
+    if (Params().AllowMinDifficultyBlocks())
+        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+}
+
+static CBlockTemplateCache blockTemplateCache;
+
+void CBlockTemplateCache::SetDirty()
+{
+    // The entries may be gone already, drop the iterators before they can be compared
+    fDirty = true;
+    inBlock.clear();
+    failedTx.clear();
+    pendingTx.clear();
+}
+
+void CBlockTemplateCache::EntryAdded(const uint256& hash)
+{
+    if (fDirty)
+        return;
+    CTxMemPool::txiter it = mempool.mapTx.find(hash);
+    if (it != mempool.mapTx.end())
+        pendingTx.insert(it);
+    ++nTransactionsUpdatedExpected;
+}
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
+void CBlockTemplateCache::EntryRemoved(const uint256& hash)
 {
-    bool byFee;
+    if (fDirty)
+        return;
+    CTxMemPool::txiter it = mempool.mapTx.find(hash);
+    if (it == mempool.mapTx.end())
+        return;
+    if (inBlock.count(it)) {
+        SetDirty();
+        return;
+    }
+    failedTx.erase(it);
+    pendingTx.erase(it);
+    ++nTransactionsUpdatedExpected;
+}
 
-public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) { }
+bool CBlockTemplateCache::TestTxForBlock(const CTransaction& tx, CCoinsViewCache& viewTx, unsigned int& nTxSigOps, CAmount& nTxFees)
+{
+    if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight))
+        return false;
+
+    if (!viewTx.HaveInputs(tx))
+        return false;
+
+    nTxFees = viewTx.GetValueIn(tx)-tx.GetValueOut();
+    nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, viewTx);
 
-    bool operator()(const TxPriority& a, const TxPriority& b)
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+    CValidationState state;
+    if (!CheckInputs(tx, state, viewTx, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        return false;
+
+    CTxUndo txundo;
+    UpdateCoins(tx, state, viewTx, txundo, nHeight);
+    return true;
+}
+
+void CBlockTemplateCache::AddToBlock(CTxMemPool::txiter iter, unsigned int nTxSigOps, CAmount nTxFees)
+{
+    const CTransaction& tx = iter->GetTx();
+    vtx.push_back(tx);
+    vTxFees.push_back(nTxFees);
+    vTxSigOps.push_back(nTxSigOps);
+    nBlockSize += iter->GetTxSize();
+    nBlockSigOps += nTxSigOps;
+    nFees += nTxFees;
+    inBlock.insert(iter);
+
+    if (fPrintPriority)
+    {
+        double dPriority = iter->GetPriority(nHeight);
+        CAmount dummy;
+        mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
+        LogPrintf("priority %.1f fee %s txid %s\n",
+            dPriority, CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(), tx.GetHash().ToString());
+    }
+}
+
+// Add a transaction together with its ancestors which are not in the block yet
+void CBlockTemplateCache::AddPackage(CTxMemPool::txiter iter)
+{
+    if (inBlock.count(iter) || failedTx.count(iter))
+        return;
+
+    CTxMemPool::setEntries ancestors;
+    mempool.CalculateMemPoolAncestors(*iter, ancestors);
+
+    uint64_t nPackageSize = iter->GetSizeWithAncestors();
+    CAmount nPackageFees = iter->GetModFeesWithAncestors();
+    vector<CTxMemPool::txiter> vPackage;
+    vPackage.push_back(iter);
+    BOOST_FOREACH(CTxMemPool::txiter ancestor, ancestors)
     {
-        if (byFee)
+        if (inBlock.count(ancestor)) {
+            nPackageSize -= ancestor->GetTxSize();
+            nPackageFees -= ancestor->GetModifiedFee();
+        } else if (failedTx.count(ancestor)) {
+            failedTx.insert(iter);
+            return;
+        } else {
+            vPackage.push_back(ancestor);
+        }
+    }
+
+    // Size limits
+    if (nBlockSize + nPackageSize >= nBlockMaxSize)
+        return;
+
+    // Skip free transactions if we're past the minimum block size:
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
+    mempool.ApplyDeltas(iter->GetTx().GetHash(), dPriorityDelta, nFeeDelta);
+    if ((dPriorityDelta <= 0) && (nFeeDelta <= 0) && (CFeeRate(nPackageFees, nPackageSize) < ::minRelayTxFee) && (nBlockSize + nPackageSize >= nBlockMinSize))
+        return;
+
+    // Legacy limits on sigOps:
+    unsigned int nPackageSigOps = 0;
+    BOOST_FOREACH(CTxMemPool::txiter entry, vPackage)
+        nPackageSigOps += GetLegacySigOpCount(entry->GetTx());
+    if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS)
+        return;
+
+    // Test the package in a throw-away view, parents first
+    std::sort(vPackage.begin(), vPackage.end(), CompareTxIterByAncestorCount());
+    CCoinsViewCache viewPackage(pview.get());
+    vector<std::pair<unsigned int, CAmount> > vPackageStats;
+    nPackageSigOps = 0;
+    BOOST_FOREACH(CTxMemPool::txiter entry, vPackage)
+    {
+        unsigned int nTxSigOps = 0;
+        CAmount nTxFees = 0;
+        if (!TestTxForBlock(entry->GetTx(), viewPackage, nTxSigOps, nTxFees)) {
+            failedTx.insert(entry);
+            failedTx.insert(iter);
+            return;
+        }
+        nPackageSigOps += nTxSigOps;
+        vPackageStats.push_back(std::make_pair(nTxSigOps, nTxFees));
+    }
+    if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS)
+        return;
+
+    viewPackage.Flush();
+    for (unsigned int i = 0; i < vPackage.size(); i++)
+        AddToBlock(vPackage[i], vPackageStats[i].first, vPackageStats[i].second);
+}
+
+void CBlockTemplateCache::Rebuild()
+{
+    pindexPrev = chainActive.Tip();
+    nHeight = pindexPrev->nHeight + 1;
+    nTimeRebuilt = GetTime();
+    fDirty = false;
+
+    inBlock.clear();
+    failedTx.clear();
+    pendingTx.clear();
+    vtx.clear();
+    vTxFees.clear();
+    vTxSigOps.clear();
+    nBlockSize = 1000;
+    nBlockSigOps = 100;
+    nFees = 0;
+    pview.reset(new CCoinsViewCache(pcoinsTip));
+
+    // First fill the high-priority area of the block, transactions are included there regardless
+    // of the fees they pay. Children wait for their in-mempool parents to be included.
+    if (nBlockPrioritySize > 0)
+    {
+        vector<TxCoinAgePriority> vecPriority;
+        TxCoinAgePriorityCompare pricomparer;
+        std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+        vecPriority.reserve(mempool.mapTx.size());
+        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
+             mi != mempool.mapTx.end(); ++mi)
         {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
+            double dPriority = mi->GetPriority(nHeight);
+            CAmount dummy;
+            mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+            vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
         }
-        else
+        std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+
+        while (!vecPriority.empty())
         {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
+            // Take highest priority transaction off the priority queue:
+            double dPriority = vecPriority.front().first;
+            CTxMemPool::txiter iter = vecPriority.front().second;
+            std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+            vecPriority.pop_back();
+
+            // Done with the priority area once the free transactions run out
+            if (!AllowFree(dPriority))
+                break;
+
+            if (inBlock.count(iter) || failedTx.count(iter))
+                continue;
+
+            // If this tx has a parent which is not in the block yet, wait for it
+            bool fDependent = false;
+            BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
+            {
+                if (!inBlock.count(parent)) {
+                    fDependent = true;
+                    break;
+                }
+            }
+            if (fDependent) {
+                waitPriMap.insert(std::make_pair(iter, dPriority));
+                continue;
+            }
+
+            // Size limits
+            unsigned int nTxSize = iter->GetTxSize();
+            if (nBlockSize + nTxSize >= nBlockMaxSize || nBlockSize + nTxSize >= nBlockPrioritySize)
+                continue;
+
+            // Legacy limits on sigOps:
+            const CTransaction& tx = iter->GetTx();
+            if (nBlockSigOps + GetLegacySigOpCount(tx) >= MAX_BLOCK_SIGOPS)
+                continue;
+
+            CCoinsViewCache viewTx(pview.get());
+            unsigned int nTxSigOps = 0;
+            CAmount nTxFees = 0;
+            if (!TestTxForBlock(tx, viewTx, nTxSigOps, nTxFees)) {
+                failedTx.insert(iter);
+                continue;
+            }
+            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+                continue;
+
+            viewTx.Flush();
+            AddToBlock(iter, nTxSigOps, nTxFees);
+
+            // Add transactions that depend on this one to the priority queue
+            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
+            {
+                std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator wpiter = waitPriMap.find(child);
+                if (wpiter != waitPriMap.end()) {
+                    vecPriority.push_back(TxCoinAgePriority(wpiter->second, child));
+                    std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                    waitPriMap.erase(wpiter);
+                }
+            }
         }
     }
-};
 
-void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
+    // Fill the rest of the block by walking the mempool in order of ancestor fee rate: each
+    // transaction comes with its package of ancestors, which are not in the block yet
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
+    for (; mi != mempool.mapTx.get<ancestor_score>().end(); ++mi)
+        AddPackage(mempool.mapTx.project<0>(mi));
+}
+
+void CBlockTemplateCache::Update(unsigned int nBlockMaxSizeIn, unsigned int nBlockPrioritySizeIn, unsigned int nBlockMinSizeIn)
 {
-    pblock->nTime = std::max(pindexPrev->GetMedianTimePast()+1, GetAdjustedTime());
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
 
-    // Updating time can change work required on testnet:
-    if (Params().AllowMinDifficultyBlocks())
-        pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
+    if (!connEntryAdded.connected()) {
+        connEntryAdded = mempool.NotifyEntryAdded.connect(boost::bind(&CBlockTemplateCache::EntryAdded, this, _1));
+        connEntryRemoved = mempool.NotifyEntryRemoved.connect(boost::bind(&CBlockTemplateCache::EntryRemoved, this, _1));
+        SetDirty();
+    }
+
+    fPrintPriority = GetBoolArg("-printpriority", false);
+
+    // Changes we were not notified about: prioritisation, clear(), connected blocks
+    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedExpected)
+        SetDirty();
+
+    if (fDirty || pindexPrev != chainActive.Tip() ||
+        nBlockMaxSizeIn != nBlockMaxSize || nBlockPrioritySizeIn != nBlockPrioritySize || nBlockMinSizeIn != nBlockMinSize ||
+        GetTime() - nTimeRebuilt >= BLOCK_TEMPLATE_REBUILD_INTERVAL)
+    {
+        nBlockMaxSize = nBlockMaxSizeIn;
+        nBlockPrioritySize = nBlockPrioritySizeIn;
+        nBlockMinSize = nBlockMinSizeIn;
+        Rebuild();
+    }
+    else if (!pendingTx.empty())
+    {
+        // Append the new arrivals, best packages first
+        vector<CTxMemPool::txiter> vPending(pendingTx.begin(), pendingTx.end());
+        pendingTx.clear();
+        std::sort(vPending.begin(), vPending.end(), [](const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) {
+            return CompareTxMemPoolEntryByAncestorFee()(*a, *b);
+        });
+        BOOST_FOREACH(CTxMemPool::txiter iter, vPending)
+            AddPackage(iter);
+    }
+
+    nTransactionsUpdatedExpected = mempool.GetTransactionsUpdated();
 }
 
 CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake)
@@ -179,10 +455,10 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
 
     {
         LOCK2(cs_main, mempool.cs);
+        int64_t nTimeStart = GetTimeMicros();
 
         CBlockIndex* pindexPrev = chainActive.Tip();
         const int nHeight = pindexPrev->nHeight + 1;
-        CCoinsViewCache view(pcoinsTip);
 
         // Add our coinbase tx as first transaction
         if (!fProofOfStake)
@@ -190,183 +466,14 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         pblocktemplate->vTxFees.push_back(-1); // updated at end
         pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi)
-        {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash))
-                {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash))
-                    {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan)
-                    {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn-tx.GetValueOut(), nTxSize);
-
-            if (porphan)
-            {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            }
-            else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
         // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty())
-        {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority)))
-            {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            CAmount nTxFees = view.GetValueIn(tx)-tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
-
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority)
-            {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash))
-            {
-                BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
-                {
-                    if (!porphan->setDependsOn.empty())
-                    {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty())
-                        {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        blockTemplateCache.Update(nBlockMaxSize, nBlockPrioritySize, nBlockMinSize);
+        pblock->vtx.insert(pblock->vtx.end(), blockTemplateCache.vtx.begin(), blockTemplateCache.vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), blockTemplateCache.vTxFees.begin(), blockTemplateCache.vTxFees.end());
+        pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), blockTemplateCache.vTxSigOps.begin(), blockTemplateCache.vTxSigOps.end());
+        uint64_t nBlockSize = blockTemplateCache.nBlockSize;
+        uint64_t nBlockTx = blockTemplateCache.vtx.size();
+        nFees = blockTemplateCache.nFees;
 
         // Masternode and general budget payments
         if (IsSporkActive(SPORK_4_ENABLE_MASTERNODE_PAYMENTS))
@@ -447,11 +554,21 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             }
         }
 
-        CValidationState state;
-        if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
-            LogPrintf("CreateNewBlock() : TestBlockValidity failed\n  %s\n", pblock->ToString());
-            return NULL;
+        // A proof of work template with the same transactions on the same tip was checked already
+        if (fProofOfStake || !blockTemplateCache.IsValidated(pindexPrev, pblock->hashMerkleRoot)) {
+            CValidationState state;
+            if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
+                LogPrintf("CreateNewBlock() : TestBlockValidity failed\n  %s\n", pblock->ToString());
+                blockTemplateCache.Invalidate();
+                return NULL;
+            }
+            if (!fProofOfStake)
+                blockTemplateCache.SetValidated(pindexPrev, pblock->hashMerkleRoot);
         }
+
+        int64_t nTemplateTime = GetTimeMicros() - nTimeStart;
+        nLastBlockTemplateTime = nTemplateTime;
+        LogPrint("bench", "CreateNewBlock(): %u transactions, %.2fms\n", nBlockTx, nTemplateTime * 0.001);
     }
 
     return pblocktemplate.release();
@@ -6,7 +6,16 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "amount.h"
+#include "coins.h"
+#include "txmempool.h"
+
+#include <atomic>
+#include <memory>
 #include <stdint.h>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
 
 class CBlock;
 class CBlockHeader;
@@ -17,6 +26,89 @@ class CWallet;
 
 struct CBlockTemplate;
 
+/** How long a transaction selection is extended before it is rebuilt from the whole mempool (seconds) */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 60;
+
+/**
+ * The mempool transactions picked for the next block. The selection is kept between calls to
+ * CreateNewBlock(), transactions entering the mempool are appended to it as packages. It is only
+ * rebuilt from the whole mempool on a new tip, when a selected transaction leaves the mempool,
+ * on prioritisation and after BLOCK_TEMPLATE_REBUILD_INTERVAL, so that time-locked transactions
+ * which became final and new high-priority transactions are picked up as well.
+ * Protected by mempool.cs.
+ */
+class CBlockTemplateCache
+{
+private:
+    const CBlockIndex* pindexPrev;
+    int nHeight;
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    bool fPrintPriority;
+    bool fDirty;
+    int64_t nTimeRebuilt;
+    //! mempool.GetTransactionsUpdated() after the last update plus the notifications since
+    unsigned int nTransactionsUpdatedExpected;
+
+    //! Coins of the chain tip with the selected transactions applied
+    std::unique_ptr<CCoinsViewCache> pview;
+
+    //! Selected entries, entries which can not be included and entries which arrived since the last update
+    CTxMemPool::setEntries inBlock;
+    CTxMemPool::setEntries failedTx;
+    CTxMemPool::setEntries pendingTx;
+
+    //! Last tip and merkle root which passed TestBlockValidity()
+    const CBlockIndex* pindexValidated;
+    uint256 hashValidatedMerkleRoot;
+
+    boost::signals2::scoped_connection connEntryAdded;
+    boost::signals2::scoped_connection connEntryRemoved;
+
+    void EntryAdded(const uint256& hash);
+    void EntryRemoved(const uint256& hash);
+    void SetDirty();
+
+    void Rebuild();
+    bool TestTxForBlock(const CTransaction& tx, CCoinsViewCache& viewTx, unsigned int& nTxSigOps, CAmount& nTxFees);
+    void AddToBlock(CTxMemPool::txiter iter, unsigned int nTxSigOps, CAmount nTxFees);
+    void AddPackage(CTxMemPool::txiter iter);
+
+public:
+    std::vector<CTransaction> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    uint64_t nBlockSize;
+    int nBlockSigOps;
+    CAmount nFees;
+
+    CBlockTemplateCache() : pindexPrev(NULL), nHeight(0), nBlockMaxSize(0), nBlockPrioritySize(0), nBlockMinSize(0),
+        fPrintPriority(false), fDirty(true), nTimeRebuilt(0), nTransactionsUpdatedExpected(0), pindexValidated(NULL),
+        nBlockSize(0), nBlockSigOps(0), nFees(0) {}
+
+    /** Bring the selection up to date with the chain tip and the mempool */
+    void Update(unsigned int nBlockMaxSizeIn, unsigned int nBlockPrioritySizeIn, unsigned int nBlockMinSizeIn);
+
+    /** When the selection was last rebuilt from the whole mempool */
+    int64_t GetTimeRebuilt() const { return nTimeRebuilt; }
+
+    bool IsValidated(const CBlockIndex* pindex, const uint256& hashMerkleRoot) const
+    {
+        return pindex == pindexValidated && hashMerkleRoot == hashValidatedMerkleRoot;
+    }
+    void SetValidated(const CBlockIndex* pindex, const uint256& hashMerkleRoot)
+    {
+        pindexValidated = pindex;
+        hashValidatedMerkleRoot = hashMerkleRoot;
+    }
+    void Invalidate()
+    {
+        SetDirty();
+        pindexValidated = NULL;
+    }
+};
+
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
 void BitcoinMiner(CWallet *pwallet, bool fProofOfStake);
@@ -32,5 +124,7 @@ bool ProcessBlockFound(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey)
 
 extern double dHashesPerSec;
 extern int64_t nHPSTimerStart;
+/** Time in microseconds it took to assemble the last block template */
+extern std::atomic<int64_t> nLastBlockTemplateTime;
 
 #endif // BITCOIN_MINER_H
@@ -25,10 +25,21 @@ Kernel::Kernel(const std::pair<uint256, unsigned int>& outpoint, const uint64_t
 }
 
 uint256 Kernel::GetStakeHash()
+{
+    std::vector<unsigned char> vchData = GetStakeData();
+    return Hash(vchData.begin(), vchData.end());
+}
+
+std::vector<unsigned char> Kernel::GetStakeData() const
 {
     CDataStream ss(SER_GETHASH, 0);
     ss << m_outpoint.first << m_outpoint.second << m_nStakeModifier << m_nTimeBlockFrom << m_nTimeStake;
-    return Hash(ss.begin(), ss.end());
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+uint64_t Kernel::GetAmount() const
+{
+    return m_nAmount;
 }
 
 uint64_t Kernel::GetTime() const
@@ -3,6 +3,8 @@
 
 #include "uint256.h"
 
+#include <vector>
+
 class arith_uint256;
 class StakePointer;
 
@@ -12,6 +14,9 @@ public:
     Kernel(const std::pair<uint256, unsigned int>& outpoint, const uint64_t nAmount, const uint256& nStakeModifier,
             const uint64_t& nTimeBlockFrom, const uint64_t& nTimeStake);
     uint256 GetStakeHash();
+    //! The serialized data that is hashed, the stake time is its last 8 bytes
+    std::vector<unsigned char> GetStakeData() const;
+    uint64_t GetAmount() const;
     uint64_t GetTime() const;
     bool IsValidProof(const uint256& nTarget);
     void SetStakeTime(uint64_t nTime);
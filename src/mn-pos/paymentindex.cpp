@@ -0,0 +1,71 @@
+#include "paymentindex.h"
+#include "primitives/block.h"
+
+void PaymentIndex::AddBlock(const CBlock& block, int nHeight)
+{
+    m_nHeight = nHeight;
+    if (block.vtx.empty())
+        return;
+
+    const CTransaction& txCoinbase = block.vtx[0];
+    uint256 hashBlock = block.GetHash();
+    uint256 txid = txCoinbase.GetHash();
+    // The first output is the miner's, the payments to masternodes and systemnodes come after it
+    for (unsigned int i = 1; i < txCoinbase.vout.size(); i++) {
+        const CScript& payee = txCoinbase.vout[i].scriptPubKey;
+        if (payee.empty())
+            continue;
+
+        StakePayment payment;
+        payment.nHeight = nHeight;
+        payment.hashBlock = hashBlock;
+        payment.txid = txid;
+        payment.nPos = i;
+        m_mapPayments[payee].emplace_back(payment);
+        m_dequePayees.emplace_back(std::make_pair(nHeight, payee));
+    }
+}
+
+void PaymentIndex::RemoveBlock(int nHeight)
+{
+    while (!m_dequePayees.empty() && m_dequePayees.back().first >= nHeight) {
+        auto it = m_mapPayments.find(m_dequePayees.back().second);
+        it->second.pop_back();
+        if (it->second.empty())
+            m_mapPayments.erase(it);
+        m_dequePayees.pop_back();
+    }
+    m_nHeight = nHeight - 1;
+}
+
+void PaymentIndex::EraseBeforeHeight(int nHeight)
+{
+    while (!m_dequePayees.empty() && m_dequePayees.front().first < nHeight) {
+        auto it = m_mapPayments.find(m_dequePayees.front().second);
+        it->second.pop_front();
+        if (it->second.empty())
+            m_mapPayments.erase(it);
+        m_dequePayees.pop_front();
+    }
+}
+
+std::vector<StakePayment> PaymentIndex::GetPayments(const CScript& payee, unsigned int nPos, int nMinHeight) const
+{
+    std::vector<StakePayment> vPayments;
+    auto it = m_mapPayments.find(payee);
+    if (it == m_mapPayments.end())
+        return vPayments;
+
+    for (const StakePayment& payment : it->second) {
+        if (payment.nHeight >= nMinHeight && payment.nPos == nPos)
+            vPayments.emplace_back(payment);
+    }
+    return vPayments;
+}
+
+void PaymentIndex::Clear()
+{
+    m_mapPayments.clear();
+    m_dequePayees.clear();
+    m_nHeight = -1;
+}
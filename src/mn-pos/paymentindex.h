@@ -0,0 +1,45 @@
+#ifndef CROWNCORE_PAYMENTINDEX_H
+#define CROWNCORE_PAYMENTINDEX_H
+
+#include "script/script.h"
+#include "uint256.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+class CBlock;
+
+/** An output of a coinbase after the first, a masternode or systemnode payment its payee can use as stake pointer */
+struct StakePayment
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint256 txid;
+    unsigned int nPos;
+};
+
+/*
+ * The coinbase payments of the recent blocks by payee, so that a staking node finds its stake pointers without
+ * reading the blocks back from disk. Blocks are added and removed at the tip, in chain order.
+ */
+class PaymentIndex
+{
+private:
+    std::map<CScript, std::deque<StakePayment> > m_mapPayments; // {payee => payments, oldest first}
+    std::deque<std::pair<int, CScript> > m_dequePayees; // {height, payee} of every payment, oldest first
+    int m_nHeight; // last block added, -1 when empty
+
+public:
+    PaymentIndex() : m_nHeight(-1) {}
+
+    void AddBlock(const CBlock& block, int nHeight);
+    void RemoveBlock(int nHeight);
+    void EraseBeforeHeight(int nHeight);
+    std::vector<StakePayment> GetPayments(const CScript& payee, unsigned int nPos, int nMinHeight) const;
+    int GetHeight() const { return m_nHeight; }
+    size_t GetPaymentCount() const { return m_dequePayees.size(); }
+    void Clear();
+};
+
+#endif //CROWNCORE_PAYMENTINDEX_H
@@ -4,23 +4,91 @@
 #include "kernel.h"
 #include "stakevalidation.h"
 #include "util.h"
+#include "crypto/common.h"
+
+#include <assert.h>
+#include <string.h>
+
+void KernelSearch::AddKernel(const Kernel& kernel)
+{
+    std::vector<unsigned char> vchData = kernel.GetStakeData();
+    //The tail and its padding have to fit in a single SHA256 block
+    assert(vchData.size() > 64 && vchData.size() - 64 <= 55);
+
+    Lane lane;
+    CSHA256().Write(vchData.data(), 64).GetMidstate(lane.midstate);
+    size_t nTail = vchData.size() - 64;
+    memset(lane.lastBlock, 0, sizeof(lane.lastBlock));
+    memcpy(lane.lastBlock, vchData.data() + 64, nTail);
+    lane.lastBlock[nTail] = 0x80;
+    WriteBE64(lane.lastBlock + 56, (uint64_t)vchData.size() << 3);
+    lane.nTimeOffset = nTail - 8;
+    lane.nAmount = kernel.GetAmount();
+    m_vLanes.emplace_back(lane);
+    m_vKernels.emplace_back(kernel);
+}
+
+bool KernelSearch::Search(uint32_t nTimeStart, uint32_t nTimeEnd, const uint256& nTarget, size_t& nFound)
+{
+    arith_uint256 target = UintToArith256(nTarget);
+    for (Lane& lane : m_vLanes)
+        lane.targetWeighted = lane.nAmount * target; //Same as Kernel::CheckProof
+
+    uint32_t midstates[8 * SEARCH_BATCH_SIZE];
+    unsigned char blocks[64 * SEARCH_BATCH_SIZE];
+    unsigned char hashes[CSHA256::OUTPUT_SIZE * SEARCH_BATCH_SIZE];
+    size_t vBatchLane[SEARCH_BATCH_SIZE];
+    uint64_t vBatchTime[SEARCH_BATCH_SIZE];
+    size_t nBatch = 0;
+
+    //Hash the batch and check it in search order, so the earliest stake time is still found first
+    auto checkBatch = [&]() -> bool {
+        SHA256DMidstate(hashes, midstates, blocks, nBatch);
+        m_nHashes += nBatch;
+        uint256 hashProof;
+        for (size_t n = 0; n < nBatch; n++) {
+            memcpy(hashProof.begin(), hashes + CSHA256::OUTPUT_SIZE * n, CSHA256::OUTPUT_SIZE);
+            if (UintToArith256(hashProof) < m_vLanes[vBatchLane[n]].targetWeighted) {
+                m_vKernels[vBatchLane[n]].SetStakeTime(vBatchTime[n]);
+                nFound = vBatchLane[n];
+                return true;
+            }
+        }
+        nBatch = 0;
+        return false;
+    };
+
+    for (uint64_t nTimeStake = nTimeStart; nTimeStake <= nTimeEnd; ++nTimeStake) {
+        for (size_t i = 0; i < m_vLanes.size(); i++) {
+            const Lane& lane = m_vLanes[i];
+            memcpy(midstates + 8 * nBatch, lane.midstate, sizeof(lane.midstate));
+            unsigned char* block = blocks + 64 * nBatch;
+            memcpy(block, lane.lastBlock, sizeof(lane.lastBlock));
+            WriteLE64(block + lane.nTimeOffset, nTimeStake);
+            vBatchLane[nBatch] = i;
+            vBatchTime[nBatch] = nTimeStake;
+            if (++nBatch == SEARCH_BATCH_SIZE && checkBatch())
+                return true;
+        }
+    }
+
+    return nBatch > 0 && checkBatch();
+}
 
 //! Search a specific period of timestamps to see if a valid proof hash is created
 bool SearchTimeSpan(Kernel& kernel, uint32_t nTimeStart, uint32_t nTimeEnd, const uint256& nTarget)
 {
-    uint64_t nTimeStake = nTimeStart;
-    kernel.SetStakeTime(nTimeStart);
-
-    while (!kernel.IsValidProof(nTarget)) {
-        ++nTimeStake;
-        kernel.SetStakeTime(nTimeStake);
+    KernelSearch search;
+    search.AddKernel(kernel);
 
-        //Searched through the requested period
-        if (nTimeStake > nTimeEnd)
-            break;
+    size_t nFound;
+    if (!search.Search(nTimeStart, nTimeEnd, nTarget, nFound)) {
+        kernel.SetStakeTime(nTimeEnd);
+        return false;
     }
 
-    return kernel.IsValidProof(nTarget);
+    kernel = search.GetKernel(nFound);
+    return true;
 }
 
 bool SignBlock(CBlock* pblock)
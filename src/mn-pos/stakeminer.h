@@ -1,12 +1,52 @@
 #ifndef CROWN_CORE_STAKEMINER_H
 #define CROWN_CORE_STAKEMINER_H
 
+#include "arith_uint256.h"
+#include "crypto/sha256.h"
+#include "kernel.h"
+
 #include <cstdint>
+#include <vector>
 
 class CBlock;
-class Kernel;
 class uint256;
 
+/**
+ * Searches a span of stake times for a valid proof of many kernels in one pass, earliest stake time first.
+ * The first 64 bytes of a kernel's stake data don't depend on the stake time, so the SHA256 state after them
+ * is computed once per kernel and each stake time only hashes the last block. The candidates are hashed in
+ * batches with SHA256DMidstate, several at once where the CPU has SSE4.1 or AVX2.
+ */
+class KernelSearch
+{
+private:
+    struct Lane
+    {
+        uint32_t midstate[8]; // state after the first 64 bytes of stake data
+        unsigned char lastBlock[64]; // the rest of the stake data with its padding, the stake time at nTimeOffset
+        size_t nTimeOffset;
+        uint64_t nAmount;
+        arith_uint256 targetWeighted; // nAmount * target of the current search
+    };
+
+    //! Number of stake time and kernel pairs hashed at once
+    static const size_t SEARCH_BATCH_SIZE = 16;
+
+    std::vector<Kernel> m_vKernels;
+    std::vector<Lane> m_vLanes;
+    uint64_t m_nHashes;
+
+public:
+    KernelSearch() : m_nHashes(0) {}
+
+    void AddKernel(const Kernel& kernel);
+    //! Find the first stake time from nTimeStart to nTimeEnd that gives any kernel a valid proof, that kernel's stake time is set to it
+    bool Search(uint32_t nTimeStart, uint32_t nTimeEnd, const uint256& nTarget, size_t& nFound);
+    Kernel& GetKernel(size_t n) { return m_vKernels[n]; }
+    size_t GetKernelCount() const { return m_vKernels.size(); }
+    uint64_t GetHashCount() const { return m_nHashes; }
+};
+
 bool SearchTimeSpan(Kernel& kernel, uint32_t nTimeStart, uint32_t nTimeEnd, const uint256& nTarget);
 bool SignBlock(CBlock* pblock);
 #endif //CROWN_CORE_STAKEMINER_H
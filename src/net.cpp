@@ -27,6 +27,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -36,6 +40,7 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 // Dump addresses to peers.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
@@ -86,6 +91,7 @@ uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
 CAddrMan addrman;
 int nMaxConnections = 125;
+bool fSocketEventsEpoll = false;
 bool fAddressesInitialized = false;
 
 vector<CNode*> vNodes;
@@ -358,6 +364,8 @@ uint64_t CNode::nTotalBytesRecv = 0;
 uint64_t CNode::nTotalBytesSent = 0;
 CCriticalSection CNode::cs_totalBytesRecv;
 CCriticalSection CNode::cs_totalBytesSent;
+CCriticalSection CNode::cs_mapMessageStats;
+std::map<std::string, CMessageStats> CNode::mapMessageStats;
 
 CNode* FindNode(const CNetAddr& ip)
 {
@@ -393,6 +401,12 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+/** Whether the socket handler can wait on the socket, select() only handles descriptors below FD_SETSIZE */
+static bool IsSocketHandlerSocket(SOCKET hSocket)
+{
+    return fSocketEventsEpoll || IsSelectableSocket(hSocket);
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool Masternode, bool Systemnode)
 {
     if (pszDest == NULL) {
@@ -424,7 +438,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool Masternode, b
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsSocketHandlerSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -584,9 +598,24 @@ void CNode::copyStats(CNodeStats &stats)
 
     // Leave string empty if addrLocal invalid (not filled in yet)
     stats.addrLocal = addrLocal.IsValid() ? addrLocal.ToString() : "";
+
+    {
+        LOCK(cs_mapTimePerMsgCmd);
+        stats.mapTimePerMsgCmd = mapTimePerMsgCmd;
+    }
 }
 #undef X
 
+void CNode::RecordMessageTime(const std::string& strCommand, int64_t nTime)
+{
+    LOCK(cs_mapTimePerMsgCmd);
+    // A peer can make up commands, don't let it grow the map without bound
+    if (mapTimePerMsgCmd.size() >= MAX_MSG_TIME_COMMANDS && !mapTimePerMsgCmd.count(strCommand))
+        mapTimePerMsgCmd["*other*"] += nTime;
+    else
+        mapTimePerMsgCmd[strCommand] += nTime;
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 {
@@ -619,7 +648,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
-            messageHandlerCondition.notify_one();
+            messageHandlerCondition.notify_all();
         }
     }
 
@@ -727,8 +756,113 @@ void SocketSendData(CNode *pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+/**
+ * Decide what to wait for on a node's socket:
+ * * If there is data to send, wait for sending data. As this only
+ *   happens when optimistic write failed, we choose to first drain the
+ *   write buffer in this case before receiving more. This avoids
+ *   needlessly queueing received data, if the remote peer is not themselves
+ *   receiving data. This means properly utilizing TCP flow control signalling.
+ * * Otherwise, if there is no (complete) message in the receive buffer,
+ *   or there is space left in the buffer, wait for receiving data.
+ * * (if neither of the above applies, there is certainly one message
+ *   in the receiver buffer ready to be processed).
+ * Together, that means that at least one of the following is always possible,
+ * so we don't deadlock:
+ * * We send some data.
+ * * We wait for data to be received (and disconnect after timeout).
+ * * We process a message in the buffer (message handler thread).
+ */
+static void GetSocketInterest(CNode* pnode, bool& fWantSend, bool& fWantRecv)
+{
+    fWantSend = false;
+    fWantRecv = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty()) {
+            fWantSend = true;
+            return;
+        }
+    }
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv && (
+            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+            fWantRecv = true;
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/**
+ * The socket handler's epoll instance. Unlike with select() sockets are registered once,
+ * and again only when what we wait for changes, so waking up costs the kernel the number
+ * of ready sockets instead of the number of peers, and there is no FD_SETSIZE limit.
+ */
+class CSocketEventsEpoll
+{
+private:
+    int hEpoll;
+
+public:
+    CSocketEventsEpoll() : hEpoll(epoll_create1(EPOLL_CLOEXEC)) {}
+    ~CSocketEventsEpoll()
+    {
+        if (hEpoll != -1)
+            close(hEpoll);
+    }
+
+    bool IsValid() const { return hEpoll != -1; }
+
+    /** Wait for nEvents on the socket, nRegistered are the events it is registered for or -1 */
+    void Watch(SOCKET hSocket, int& nRegistered, int nEvents)
+    {
+        if (nRegistered == nEvents)
+            return;
+        struct epoll_event event;
+        event.events = nEvents;
+        event.data.fd = hSocket;
+        if (epoll_ctl(hEpoll, nRegistered == -1 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, hSocket, &event) != 0) {
+            // The descriptor was closed (which unregisters it) and reused behind our back
+            int nOp = errno == EEXIST ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            if (epoll_ctl(hEpoll, nOp, hSocket, &event) != 0) {
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+                return;
+            }
+        }
+        nRegistered = nEvents;
+    }
+
+    /** Wait for events on the registered sockets, returns false on error */
+    bool Wait(boost::unordered_map<SOCKET, int>& mapReady, int nTimeout)
+    {
+        struct epoll_event events[1024];
+        mapReady.clear();
+        int nEvents = epoll_wait(hEpoll, events, sizeof(events) / sizeof(events[0]), nTimeout);
+        if (nEvents < 0)
+            return errno == EINTR;
+        for (int i = 0; i < nEvents; i++)
+            mapReady[events[i].data.fd] |= events[i].events;
+        return true;
+    }
+};
+#endif
+
 void ThreadSocketHandler()
 {
+#ifdef HAVE_SYS_EPOLL_H
+    CSocketEventsEpoll epoll;
+    if (fSocketEventsEpoll) {
+        if (!epoll.IsValid())
+            throw std::runtime_error(strprintf("ThreadSocketHandler: epoll_create1 failed: %s", NetworkErrorString(errno)));
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+            int nRegistered = -1;
+            epoll.Watch(hListenSocket.socket, nRegistered, EPOLLIN);
+        }
+    }
+    boost::unordered_map<SOCKET, int> mapReady;
+#endif
+
     unsigned int nPrevNodeCount = 0;
     while (true)
     {
@@ -798,91 +932,110 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
         fd_set fdsetRecv;
         fd_set fdsetSend;
         fd_set fdsetError;
         FD_ZERO(&fdsetRecv);
         FD_ZERO(&fdsetSend);
         FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
 
+#ifdef HAVE_SYS_EPOLL_H
+        if (fSocketEventsEpoll)
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
             {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
                 {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
+                    if (pnode->hSocket == INVALID_SOCKET)
                         continue;
-                    }
+                    bool fWantSend, fWantRecv;
+                    GetSocketInterest(pnode, fWantSend, fWantRecv);
+                    epoll.Watch(pnode->hSocket, pnode->nSocketEvents, fWantSend ? EPOLLOUT : fWantRecv ? EPOLLIN : 0);
                 }
+            }
+
+            if (!epoll.Wait(mapReady, 50)) // frequency to poll pnode->vSend
+            {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+                MilliSleep(50);
+            }
+            boost::this_thread::interruption_point();
+        }
+        else
+#endif
+        {
+            struct timeval timeout;
+            timeout.tv_sec  = 0;
+            timeout.tv_usec = 50000; // frequency to poll pnode->vSend
+
+            SOCKET hSocketMax = 0;
+            bool have_fds = false;
+
+            BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+                FD_SET(hListenSocket.socket, &fdsetRecv);
+                hSocketMax = max(hSocketMax, hListenSocket.socket);
+                have_fds = true;
+            }
+
+            {
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
                 {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    if (pnode->hSocket == INVALID_SOCKET)
+                        continue;
+                    FD_SET(pnode->hSocket, &fdsetError);
+                    hSocketMax = max(hSocketMax, pnode->hSocket);
+                    have_fds = true;
+
+                    bool fWantSend, fWantRecv;
+                    GetSocketInterest(pnode, fWantSend, fWantRecv);
+                    if (fWantSend)
+                        FD_SET(pnode->hSocket, &fdsetSend);
+                    else if (fWantRecv)
                         FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
-        }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
+            int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                                 &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+            boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
+            if (nSelect == SOCKET_ERROR)
             {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+                if (have_fds)
+                {
+                    int nErr = WSAGetLastError();
+                    LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                    for (unsigned int i = 0; i <= hSocketMax; i++)
+                        FD_SET(i, &fdsetRecv);
+                }
+                FD_ZERO(&fdsetSend);
+                FD_ZERO(&fdsetError);
+                MilliSleep(timeout.tv_usec/1000);
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
         }
 
+        // Whether the last wait found the socket ready for receiving or sending
+        auto IsSocketReady = [&](SOCKET hSocket, bool fSend) -> bool {
+#ifdef HAVE_SYS_EPOLL_H
+            if (fSocketEventsEpoll) {
+                boost::unordered_map<SOCKET, int>::const_iterator it = mapReady.find(hSocket);
+                if (it == mapReady.end())
+                    return false;
+                return (it->second & (fSend ? EPOLLOUT : (EPOLLIN | EPOLLERR | EPOLLHUP))) != 0;
+            }
+#endif
+            if (fSend)
+                return FD_ISSET(hSocket, &fdsetSend);
+            return FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError);
+        };
+
         //
         // Accept new connections
         //
         BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            if (hListenSocket.socket != INVALID_SOCKET && IsSocketReady(hListenSocket.socket, false))
             {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
@@ -908,7 +1061,7 @@ void ThreadSocketHandler()
                     if (nErr != WSAEWOULDBLOCK)
                         LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
                 }
-                else if (!IsSelectableSocket(hSocket))
+                else if (!IsSocketHandlerSocket(hSocket))
                 {
                     LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
                     CloseSocket(hSocket);
@@ -965,7 +1118,7 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            if (IsSocketReady(pnode->hSocket, false))
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -1009,7 +1162,7 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (IsSocketReady(pnode->hSocket, true))
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
@@ -1485,7 +1638,13 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-void ThreadMessageHandler()
+/**
+ * Process the received messages and send the queued ones of the connected peers. With
+ * several message handler threads every thread walks all peers, starting at a different
+ * one, and serves those no other thread is busy with. A slow message then only holds up
+ * its own peer, while each peer still has its messages processed one by one in order.
+ */
+void ThreadMessageHandler(int nThread, int nThreads)
 {
     boost::mutex condition_mutex;
     boost::unique_lock<boost::mutex> lock(condition_mutex);
@@ -1501,10 +1660,12 @@ void ThreadMessageHandler()
                 pnode->AddRef();
             }
         }
+        std::rotate(vNodesCopy.begin(), vNodesCopy.begin() + vNodesCopy.size() * nThread / nThreads, vNodesCopy.end());
 
         // Poll the connected nodes for messages
+        // Only the first thread trickles, so there are no more trickles with more threads
         CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
+        if (nThread == 0 && !vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
         bool fSleep = true;
@@ -1514,6 +1675,11 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
+            // Another thread is serving this peer
+            TRY_LOCK(pnode->cs_messageHandler, lockHandler);
+            if (!lockHandler)
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1542,6 +1708,9 @@ void ThreadMessageHandler()
             boost::this_thread::interruption_point();
         }
 
+        // Apply the Masternode messages whose signatures got verified in the meantime
+        if (nThread == 0)
+            legacySignerQueue.ProcessVerified();
 
         {
             LOCK(cs_vNodes);
@@ -1581,7 +1750,7 @@ bool BindListenPort(const CService &addrBind, string& strError, bool fWhiteliste
         LogPrintf("%s\n", strError);
         return false;
     }
-    if (!IsSelectableSocket(hListenSocket))
+    if (!IsSocketHandlerSocket(hListenSocket))
     {
         strError = "Error: Couldn't create a listenable socket for incoming connections";
         LogPrintf("%s\n", strError);
@@ -1755,7 +1924,10 @@ void StartNode(boost::thread_group& threadGroup)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageHandlerThreads = std::max(1, std::min((int)GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand",
+            boost::function<void()>(boost::bind(&ThreadMessageHandler, i, nMessageHandlerThreads))));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpAddresses, DUMP_ADDRESSES_INTERVAL * 1000));
@@ -1783,6 +1955,15 @@ bool StopNode()
     return true;
 }
 
+void CloseListenSockets()
+{
+    BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket)
+        if (hListenSocket.socket != INVALID_SOCKET)
+            if (!CloseSocket(hListenSocket.socket))
+                LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+    vhListenSocket.clear();
+}
+
 class CNetCleanup
 {
 public:
@@ -1794,10 +1975,7 @@ public:
         BOOST_FOREACH(CNode* pnode, vNodes)
             if (pnode->hSocket != INVALID_SOCKET)
                 CloseSocket(pnode->hSocket);
-        BOOST_FOREACH(ListenSocket& hListenSocket, vhListenSocket)
-            if (hListenSocket.socket != INVALID_SOCKET)
-                if (!CloseSocket(hListenSocket.socket))
-                    LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
+        CloseListenSockets();
 
         // clean up some globals (to help leak detection)
         BOOST_FOREACH(CNode *pnode, vNodes)
@@ -1806,7 +1984,6 @@ public:
             delete pnode;
         vNodes.clear();
         vNodesDisconnected.clear();
-        vhListenSocket.clear();
         delete semOutbound;
         semOutbound = NULL;
         delete pnodeLocalHost;
@@ -1901,6 +2078,20 @@ void CNode::RecordBytesSent(uint64_t bytes)
     nTotalBytesSent += bytes;
 }
 
+void CNode::RecordMessageStats(const std::string& strCommand, unsigned int nBytes, int64_t nTime, int64_t nLockWait)
+{
+    LOCK(cs_mapMessageStats);
+    std::map<std::string, CMessageStats>::iterator it = mapMessageStats.find(strCommand);
+    if (it == mapMessageStats.end())
+        it = mapMessageStats.insert(std::make_pair(mapMessageStats.size() < MAX_MSG_TIME_COMMANDS ? strCommand : "*other*", CMessageStats())).first;
+    CMessageStats& stats = it->second;
+    stats.nCount++;
+    stats.nBytes += nBytes;
+    stats.nTime += nTime;
+    stats.nMaxTime = std::max(stats.nMaxTime, nTime);
+    stats.nLockWait += nLockWait;
+}
+
 uint64_t CNode::GetTotalBytesRecv()
 {
     LOCK(cs_totalBytesRecv);
@@ -1913,6 +2104,12 @@ uint64_t CNode::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+std::map<std::string, CMessageStats> CNode::GetMessageStats()
+{
+    LOCK(cs_mapMessageStats);
+    return mapMessageStats;
+}
+
 void CNode::Fuzz(int nChance)
 {
     if (!fSuccessfullyConnected) return; // Don't fuzz initial handshake
@@ -2052,6 +2249,7 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 {
     nServices = 0;
     hSocket = hSocketIn;
+    nSocketEvents = -1;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2076,6 +2274,8 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
     nStartingHeight = -1;
     fGetAddr = false;
     fRelayTxes = false;
+    fSupportsCompactBlocks = false;
+    fPreferHeaderAndIDs = false;
     setInventoryKnown.max_size(SendBufferSize() / 1000);
     pfilter = new CBloomFilter();
     nPingNonceSent = 0;
@@ -2211,6 +2411,33 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::SerializeMessage(const char* pszCommand, const std::vector<char>& vPayload, CSerializeData& vMessage)
+{
+    CDataStream ssMessage(SER_NETWORK, PROTOCOL_VERSION);
+    ssMessage.reserve(CMessageHeader::HEADER_SIZE + vPayload.size());
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, vPayload.size());
+    uint256 hash = Hash(vPayload.begin(), vPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    ssMessage << hdr;
+    ssMessage.write(vPayload.empty() ? NULL : &vPayload[0], vPayload.size());
+    ssMessage.GetAndClear(vMessage);
+}
+
+void CNode::PushSerializedMessage(const CSerializeData& vMessage)
+{
+    assert(vMessage.size() >= CMessageHeader::HEADER_SIZE);
+    LOCK(cs_vSend);
+    const char* pszCommand = &vMessage[MESSAGE_START_SIZE];
+    LogPrint("net", "sending: %s (%d bytes) peer=%d\n", SanitizeString(std::string(pszCommand, strnlen(pszCommand, CMessageHeader::COMMAND_SIZE))), vMessage.size() - CMessageHeader::HEADER_SIZE, id);
+
+    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), vMessage);
+    nSendSize += (*it).size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (it == vSendMsg.begin())
+        SocketSendData(this);
+}
+
 int MinPeerProtoVersion()
 {
     if (IsSporkActive(SPORK_16_DISCONNECT_OLD_NODES))
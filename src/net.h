@@ -19,6 +19,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -58,6 +59,14 @@ static const bool DEFAULT_UPNP = USE_UPNP;
 #else
 static const bool DEFAULT_UPNP = false;
 #endif
+/** -msghandlerthreads default, the number of threads processing peer messages */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** Commands processing statistics are kept for, overall and by peer, others are counted together */
+static const unsigned int MAX_MSG_TIME_COMMANDS = 64;
+/** -socketevents default, the way the socket handler waits for socket readiness */
+static const char* const DEFAULT_SOCKETEVENTS = "select";
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 
@@ -75,9 +84,13 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 void MapPort(bool fUseUPnP);
 unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
+/** Close and forget all sockets opened by BindListenPort, the socket handler must not be running */
+void CloseListenSockets();
 void StartNode(boost::thread_group& threadGroup);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+void ThreadSocketHandler();
+void ThreadMessageHandler(int nThread, int nThreads);
 
 typedef int NodeId;
 
@@ -128,6 +141,7 @@ extern uint64_t nLocalServices;
 extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
+extern bool fSocketEventsEpoll;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
@@ -172,6 +186,23 @@ public:
     double dPingTime;
     double dPingWait;
     std::string addrLocal;
+    std::map<std::string, int64_t> mapTimePerMsgCmd;
+};
+
+
+
+
+/** Processing statistics of one message command, see getnetmsgstats */
+class CMessageStats
+{
+public:
+    uint64_t nCount;
+    uint64_t nBytes;     // payload bytes
+    int64_t nTime;       // total processing time in usec
+    int64_t nMaxTime;
+    int64_t nLockWait;   // time in usec spent waiting for cs_main while processing
+
+    CMessageStats() : nCount(0), nBytes(0), nTime(0), nMaxTime(0), nLockWait(0) {}
 };
 
 
@@ -226,6 +257,8 @@ public:
     // socket
     uint64_t nServices;
     SOCKET hSocket;
+    // events hSocket is registered for with the socket handler's epoll instance, -1 if it is not
+    int nSocketEvents;
     CDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
@@ -238,6 +271,8 @@ public:
     CCriticalSection cs_vRecvMsg;
     uint64_t nRecvBytes;
     int nRecvVersion;
+    // held by the message handler thread serving this peer, so its messages are processed in order
+    CCriticalSection cs_messageHandler;
 
     int64_t nLastSend;
     int64_t nLastRecv;
@@ -263,6 +298,10 @@ public:
     // b) the peer may tell us in their version message that we should not relay tx invs
     //    until they have initialized their bloom filter.
     bool fRelayTxes;
+    // The peer sent "sendcmpct", so we can ask it for compact blocks
+    std::atomic<bool> fSupportsCompactBlocks;
+    // The peer wants new blocks announced as "cmpctblock" messages rather than by inv
+    std::atomic<bool> fPreferHeaderAndIDs;
     // Should be 'true' only if we connected to this node to actually mix funds.
     // In this case node will be released automatically via CMasternodeMan::ProcessMasternodeConnections().
     // Connecting to verify connectability/status or connecting for sending/relaying single message
@@ -299,6 +338,8 @@ public:
     // flood relay
     std::vector<CAddress> vAddrToSend;
     mruset<CAddress> setAddrKnown;
+    // Other peers' handler threads relay addresses to this node
+    CCriticalSection cs_addrKnown;
     bool fGetAddr;
     std::set<uint256> setKnown;
     bool fSyncingWith;
@@ -321,6 +362,13 @@ public:
     // Whether a ping is requested.
     bool fPingQueued;
 
+protected:
+    // Time (in usec) spent processing the messages of each command
+    std::map<std::string, int64_t> mapTimePerMsgCmd;
+    CCriticalSection cs_mapTimePerMsgCmd;
+
+public:
+
     CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false);
     ~CNode();
 
@@ -331,6 +379,10 @@ private:
     static uint64_t nTotalBytesRecv;
     static uint64_t nTotalBytesSent;
 
+    // Message processing totals
+    static CCriticalSection cs_mapMessageStats;
+    static std::map<std::string, CMessageStats> mapMessageStats;
+
     CNode(const CNode&);
     void operator=(const CNode&);
 
@@ -381,6 +433,7 @@ public:
 
     void AddAddressKnown(const CAddress& addr)
     {
+        LOCK(cs_addrKnown);
         setAddrKnown.insert(addr);
     }
 
@@ -389,6 +442,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrKnown);
         if (addr.IsValid() && !setAddrKnown.count(addr)) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand() % vAddrToSend.size()] = addr;
@@ -431,6 +485,11 @@ public:
     void PushVersion();
     void PushTxLockedList();
 
+    /** Frame an already serialized payload as a complete message, with its size and checksum set */
+    static void SerializeMessage(const char* pszCommand, const std::vector<char>& vPayload, CSerializeData& vMessage);
+    /** Queue a complete message made by SerializeMessage, it can be sent to any number of peers */
+    void PushSerializedMessage(const CSerializeData& vMessage);
+
 
     void PushMessage(const char* pszCommand)
     {
@@ -694,10 +753,13 @@ public:
 
     // Network stats
     static void RecordBytesRecv(uint64_t bytes);
+    void RecordMessageTime(const std::string& strCommand, int64_t nTime);
+    static void RecordMessageStats(const std::string& strCommand, unsigned int nBytes, int64_t nTime, int64_t nLockWait);
     static void RecordBytesSent(uint64_t bytes);
 
     static uint64_t GetTotalBytesRecv();
     static uint64_t GetTotalBytesSent();
+    static std::map<std::string, CMessageStats> GetMessageStats();
 };
 
 class CExplicitNetCleanup
@@ -0,0 +1,150 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWN_PLATFORM_NF_TOKEN_PERSISTENT_MAP_H
+#define CROWN_PLATFORM_NF_TOKEN_PERSISTENT_MAP_H
+
+#include <array>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Platform
+{
+    /// Gives the caller a node it may modify. Nodes of an older generation may be shared with
+    /// published copies, they are copied once and the copy is owned by the current generation.
+    template<typename Node>
+    Node & CopyOnWrite(std::shared_ptr<Node> & node, uint64_t generation)
+    {
+        if (node == nullptr)
+            node = std::make_shared<Node>();
+        else if (node->generation != generation)
+            node = std::make_shared<Node>(*node);
+        else
+            return *node;
+        node->generation = generation;
+        return *node;
+    }
+
+    /// Hash map with O(1) copies. The entries are kept in small leaves of a two level radix tree of
+    /// 256-way nodes, indexed by the low bytes of the key hash. A copy shares every node, a modification
+    /// copies the nodes on the path to its leaf, at most once between two copies.
+    /// KeyHasher returns a uint64_t, it should be salted if the keys are chosen by others.
+    template<typename Key, typename Value, typename KeyHasher>
+    class PersistentHashMap
+    {
+    public:
+        explicit PersistentHashMap(const KeyHasher & hasher = KeyHasher()) : m_hasher(hasher) {}
+
+        const Value * Find(const Key & key) const
+        {
+            uint64_t hash = m_hasher(key);
+            if (m_root == nullptr)
+                return nullptr;
+            const auto & inner = m_root->children[hash & 0xff];
+            if (inner == nullptr)
+                return nullptr;
+            const auto & leaf = inner->children[(hash >> 8) & 0xff];
+            if (leaf == nullptr)
+                return nullptr;
+            for (const auto & entry : leaf->entries)
+            {
+                if (entry.first == key)
+                    return &entry.second;
+            }
+            return nullptr;
+        }
+
+        /// The value of a key which can be modified without affecting copies, null if it is missing
+        Value * FindMutable(const Key & key)
+        {
+            if (Find(key) == nullptr)
+                return nullptr;
+            for (auto & entry : MutableLeaf(m_hasher(key)).entries)
+            {
+                if (entry.first == key)
+                    return &entry.second;
+            }
+            return nullptr;
+        }
+
+        /// Insert or replace the value of a key
+        void Set(const Key & key, Value value)
+        {
+            Value * existing = FindMutable(key);
+            if (existing != nullptr)
+            {
+                *existing = std::move(value);
+                return;
+            }
+            MutableLeaf(m_hasher(key)).entries.emplace_back(key, std::move(value));
+            ++m_size;
+        }
+
+        bool Erase(const Key & key)
+        {
+            if (Find(key) == nullptr)
+                return false;
+            auto & entries = MutableLeaf(m_hasher(key)).entries;
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if (it->first == key)
+                {
+                    *it = std::move(entries.back());
+                    entries.pop_back();
+                    --m_size;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::size_t Size() const { return m_size; }
+
+        /// Generation the nodes modified from now on belong to
+        uint64_t Generation() const { return m_generation; }
+
+        /// Copy for readers, later modifications of this map do not show in it
+        PersistentHashMap Share()
+        {
+            PersistentHashMap copy(*this);
+            ++m_generation;
+            return copy;
+        }
+
+    private:
+        struct Leaf
+        {
+            uint64_t generation{0};
+            std::vector<std::pair<Key, Value> > entries;
+        };
+
+        struct Inner
+        {
+            uint64_t generation{0};
+            std::array<std::shared_ptr<Leaf>, 256> children;
+        };
+
+        struct Root
+        {
+            uint64_t generation{0};
+            std::array<std::shared_ptr<Inner>, 256> children;
+        };
+
+        Leaf & MutableLeaf(uint64_t hash)
+        {
+            Root & root = CopyOnWrite(m_root, m_generation);
+            Inner & inner = CopyOnWrite(root.children[hash & 0xff], m_generation);
+            return CopyOnWrite(inner.children[(hash >> 8) & 0xff], m_generation);
+        }
+
+    private:
+        std::shared_ptr<Root> m_root;
+        uint64_t m_generation{1};
+        std::size_t m_size{0};
+        KeyHasher m_hasher;
+    };
+}
+
+#endif // CROWN_PLATFORM_NF_TOKEN_PERSISTENT_MAP_H
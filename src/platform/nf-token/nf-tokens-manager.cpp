@@ -15,6 +15,8 @@ namespace Platform
     using NftIndexByProtocolAndOwnerId = NfTokensIndexSet::index<Tags::ProtocolIdOwnerId>::type;
     using NftIndexByProtocolId = NfTokensIndexSet::index<Tags::ProtocolId>::type;
     using NftIndexByOwnerId = NfTokensIndexSet::index<Tags::OwnerId>::type;
+    using NftOfOwnerByProtocolId = NfTokensOfOwner::index<Tags::ProtocolIdHeight>::type;
+    using NftOfOwnerByHeight = NfTokensOfOwner::index<Tags::Height>::type;
 
     /*static*/ std::unique_ptr<NfTokensManager> NfTokensManager::s_instance;
 
@@ -42,7 +44,12 @@ namespace Platform
                 }
                 return PlatformDb::Instance().ProcessNftIndex(dbIt, [this](NfTokenIndex nftIndex) -> bool
                 {
-                    return m_nfTokensIndexSet.emplace(std::move(nftIndex)).second;
+                    auto itRes = m_nfTokensIndexSet.emplace(std::move(nftIndex));
+                    if (itRes.second)
+                    {
+                        AddToOwnerMaps(*itRes.first);
+                    }
+                    return itRes.second;
                 });
             });
         }
@@ -54,6 +61,8 @@ namespace Platform
                 return true;
             });
         }
+
+        PublishSnapshot();
     }
 
     bool NfTokensManager::AddNfToken(const NfToken & nfToken, const CTransaction & tx, const CBlockIndex * pindex)
@@ -67,16 +76,25 @@ namespace Platform
         assert(!tx.GetHash().IsNull());
 
         std::shared_ptr<NfToken> nfTokenPtr(new NfToken(nfToken));
-        NfTokenIndex nftIndex(pindex, tx.GetHash(), nfTokenPtr);
-        auto itRes = m_nfTokensIndexSet.emplace(std::move(nftIndex));
 
-        if (itRes.second)
+        if (PlatformDb::Instance().OptimizeSpeed())
         {
-            NfTokenDiskIndex nftDiskIndex(*pindex->phashBlock, pindex, tx.GetHash(), nfTokenPtr);
-            PlatformDb::Instance().WriteNftDiskIndex(nftDiskIndex);
-            this->UpdateTotalSupply(nfTokenPtr->tokenProtocolId, true);
+            NfTokenIndex nftIndex(pindex, tx.GetHash(), nfTokenPtr);
+            auto itRes = m_nfTokensIndexSet.emplace(std::move(nftIndex));
+            if (!itRes.second)
+                return false;
+            AddToOwnerMaps(*itRes.first);
         }
-        return itRes.second;
+        else /// PlatformDb::Instance().OptimizeRam() is on, only the database record is kept
+        {
+            if (!PlatformDb::Instance().ReadNftIndex(nfToken.tokenProtocolId, nfToken.tokenId).IsNull())
+                return false;
+        }
+
+        NfTokenDiskIndex nftDiskIndex(*pindex->phashBlock, pindex, tx.GetHash(), nfTokenPtr);
+        PlatformDb::Instance().WriteNftDiskIndex(nftDiskIndex);
+        this->UpdateTotalSupply(nfTokenPtr->tokenProtocolId, true);
+        return true;
     }
 
     NfTokenIndex NfTokensManager::GetNfTokenIndex(uint64_t protocolId, const uint256 & tokenId)
@@ -140,10 +158,17 @@ namespace Platform
 
     CKeyID NfTokensManager::OwnerOf(uint64_t protocolId, const uint256 & tokenId)
     {
-        LOCK(m_cs);
         assert(protocolId != NfToken::UNKNOWN_TOKEN_PROTOCOL);
         assert(!tokenId.IsNull());
 
+        if (PlatformDb::Instance().OptimizeSpeed())
+        {
+            const auto snapshot = Snapshot();
+            const CKeyID * ownerId = snapshot->tokenOwners.Find(std::make_pair(protocolId, tokenId));
+            return ownerId != nullptr ? *ownerId : CKeyID();
+        }
+
+        LOCK(m_cs);
         NfTokensIndexSet::const_iterator it = m_nfTokensIndexSet.find(std::make_tuple(protocolId, tokenId));
         if (it != m_nfTokensIndexSet.end())
         {
@@ -159,62 +184,58 @@ namespace Platform
 
     std::size_t NfTokensManager::BalanceOf(uint64_t protocolId, const CKeyID & ownerId) const
     {
-        LOCK(m_cs);
         // TODO: put my addresses balance into db
         assert(protocolId != NfToken::UNKNOWN_TOKEN_PROTOCOL);
         assert(!ownerId.IsNull());
 
         if (PlatformDb::Instance().OptimizeRam())
         {
-            std::size_t count = 0;
-            PlatformDb::Instance().ProcessNftIndexGutsOnly([&](NfTokenIndex nftIndex) -> bool
-            {
-                if (nftIndex.NfTokenPtr()->tokenProtocolId == protocolId &&
-                    nftIndex.NfTokenPtr()->tokenOwnerKeyId == ownerId)
-                {
-                    count++;
-                }
-                return true;
-            });
-            return count;
+            return PlatformDb::Instance().ReadNftOwnerBalance(ownerId, protocolId);
         }
 
         /// PlatformDb::Instance().OptimizeSpeed() is on
-        const NftIndexByProtocolAndOwnerId & protocolOwnerIndex = m_nfTokensIndexSet.get<Tags::ProtocolIdOwnerId>();
-        return protocolOwnerIndex.count(std::make_tuple(protocolId, ownerId));
+        const auto snapshot = Snapshot();
+        const auto ownerNode = snapshot->owners.Find(ownerId);
+        if (ownerNode == nullptr)
+            return 0;
+        const NftOfOwnerByProtocolId & protocolIndex = (*ownerNode)->nfTokens.get<Tags::ProtocolIdHeight>();
+        return protocolIndex.count(std::make_tuple(protocolId));
     }
 
     std::size_t NfTokensManager::BalanceOf(const CKeyID & ownerId) const
     {
-        LOCK(m_cs);
         // TODO: put my addresses balance into db
         assert(!ownerId.IsNull());
 
         if (PlatformDb::Instance().OptimizeRam())
         {
-            std::size_t count = 0;
-            PlatformDb::Instance().ProcessNftIndexGutsOnly([&](NfTokenIndex nftIndex) -> bool
-            {
-                if (nftIndex.NfTokenPtr()->tokenOwnerKeyId == ownerId)
-                    count++;
-                return true;
-            });
-            return count;
+            return PlatformDb::Instance().ReadNftOwnerBalance(ownerId);
         }
 
         /// PlatformDb::Instance().OptimizeSpeed() is on
-        const NftIndexByOwnerId & ownerIndex = m_nfTokensIndexSet.get<Tags::OwnerId>();
-        return ownerIndex.count(ownerId);
+        const auto snapshot = Snapshot();
+        const auto ownerNode = snapshot->owners.Find(ownerId);
+        return ownerNode != nullptr ? (*ownerNode)->nfTokens.size() : 0;
     }
 
     std::vector<std::weak_ptr<const NfToken> > NfTokensManager::NfTokensOf(uint64_t protocolId, const CKeyID & ownerId) const
     {
-        LOCK(m_cs);
         assert(protocolId != NfToken::UNKNOWN_TOKEN_PROTOCOL);
         assert(!ownerId.IsNull());
 
-        const NftIndexByProtocolAndOwnerId & protocolOwnerIndex = m_nfTokensIndexSet.get<Tags::ProtocolIdOwnerId>();
-        const auto range = protocolOwnerIndex.equal_range(std::make_tuple(protocolId, ownerId));
+        if (PlatformDb::Instance().OptimizeRam())
+        {
+            /// The returned pointers would not outlive the call, use NfTokenIdsOf
+            std::string error = std::string(__func__) + " is implemented only for speed optimized node instances. Change the conf and restart your node.";
+            throw std::runtime_error(error);
+        }
+
+        const auto snapshot = Snapshot();
+        const auto ownerNode = snapshot->owners.Find(ownerId);
+        if (ownerNode == nullptr)
+            return {};
+        const NftOfOwnerByProtocolId & protocolIndex = (*ownerNode)->nfTokens.get<Tags::ProtocolIdHeight>();
+        const auto range = protocolIndex.equal_range(std::make_tuple(protocolId));
 
         std::vector<std::weak_ptr<const NfToken> > nfTokens;
         nfTokens.reserve(std::distance(range.first, range.second));
@@ -228,11 +249,21 @@ namespace Platform
 
     std::vector<std::weak_ptr<const NfToken> > NfTokensManager::NfTokensOf(const CKeyID & ownerId) const
     {
-        LOCK(m_cs);
         assert(!ownerId.IsNull());
 
-        const NftIndexByOwnerId & ownerIndex = m_nfTokensIndexSet.get<Tags::OwnerId>();
-        const auto range = ownerIndex.equal_range(ownerId);
+        if (PlatformDb::Instance().OptimizeRam())
+        {
+            /// The returned pointers would not outlive the call, use NfTokenIdsOf
+            std::string error = std::string(__func__) + " is implemented only for speed optimized node instances. Change the conf and restart your node.";
+            throw std::runtime_error(error);
+        }
+
+        const auto snapshot = Snapshot();
+        const auto ownerNode = snapshot->owners.Find(ownerId);
+        if (ownerNode == nullptr)
+            return {};
+        const NftOfOwnerByHeight & heightIndex = (*ownerNode)->nfTokens.get<Tags::Height>();
+        const auto range = std::make_pair(heightIndex.begin(), heightIndex.end());
 
         std::vector<std::weak_ptr<const NfToken> > nfTokens;
         nfTokens.reserve(std::distance(range.first, range.second));
@@ -246,12 +277,26 @@ namespace Platform
 
     std::vector<uint256> NfTokensManager::NfTokenIdsOf(uint64_t protocolId, const CKeyID & ownerId) const
     {
-        LOCK(m_cs);
         assert(protocolId != NfToken::UNKNOWN_TOKEN_PROTOCOL);
         assert(!ownerId.IsNull());
 
-        const NftIndexByProtocolAndOwnerId & protocolOwnerIndex = m_nfTokensIndexSet.get<Tags::ProtocolIdOwnerId>();
-        const auto range = protocolOwnerIndex.equal_range(std::make_tuple(protocolId, ownerId));
+        if (PlatformDb::Instance().OptimizeRam())
+        {
+            std::vector<uint256> nfTokenIds;
+            PlatformDb::Instance().ProcessNftOwnerIndex(ownerId, protocolId, [&](uint64_t, const uint256 & tokenId) -> bool
+            {
+                nfTokenIds.push_back(tokenId);
+                return true;
+            });
+            return nfTokenIds;
+        }
+
+        const auto snapshot = Snapshot();
+        const auto ownerNode = snapshot->owners.Find(ownerId);
+        if (ownerNode == nullptr)
+            return {};
+        const NftOfOwnerByProtocolId & protocolIndex = (*ownerNode)->nfTokens.get<Tags::ProtocolIdHeight>();
+        const auto range = protocolIndex.equal_range(std::make_tuple(protocolId));
 
         std::vector<uint256> nfTokenIds;
         nfTokenIds.reserve(std::distance(range.first, range.second));
@@ -264,11 +309,25 @@ namespace Platform
 
     std::vector<uint256> NfTokensManager::NfTokenIdsOf(const CKeyID & ownerId) const
     {
-        LOCK(m_cs);
         assert(!ownerId.IsNull());
 
-        const NftIndexByOwnerId & ownerIndex = m_nfTokensIndexSet.get<Tags::OwnerId>();
-        const auto range = ownerIndex.equal_range(ownerId);
+        if (PlatformDb::Instance().OptimizeRam())
+        {
+            std::vector<uint256> nfTokenIds;
+            PlatformDb::Instance().ProcessNftOwnerIndex(ownerId, NfToken::UNKNOWN_TOKEN_PROTOCOL, [&](uint64_t, const uint256 & tokenId) -> bool
+            {
+                nfTokenIds.push_back(tokenId);
+                return true;
+            });
+            return nfTokenIds;
+        }
+
+        const auto snapshot = Snapshot();
+        const auto ownerNode = snapshot->owners.Find(ownerId);
+        if (ownerNode == nullptr)
+            return {};
+        const NftOfOwnerByHeight & heightIndex = (*ownerNode)->nfTokens.get<Tags::Height>();
+        const auto range = std::make_pair(heightIndex.begin(), heightIndex.end());
 
         std::vector<uint256> nfTokenIds;
         nfTokenIds.reserve(std::distance(range.first, range.second));
@@ -286,9 +345,9 @@ namespace Platform
 
     std::size_t NfTokensManager::TotalSupply(uint64_t protocolId) const
     {
-        LOCK(m_cs);
-        auto it = m_protocolsTotalSupply.find(protocolId);
-        if (it == m_protocolsTotalSupply.end())
+        const auto snapshot = Snapshot();
+        auto it = snapshot->protocolsTotalSupply.find(protocolId);
+        if (it == snapshot->protocolsTotalSupply.end())
         {
             if (protocolId != NfToken::UNKNOWN_TOKEN_PROTOCOL)
                 throw std::runtime_error("Unknown protocol ID: " + ProtocolName(protocolId).ToString());
@@ -471,6 +530,7 @@ namespace Platform
             auto it = m_nfTokensIndexSet.find(std::make_tuple(protocolId, tokenId));
             if (it != m_nfTokensIndexSet.end() && it->BlockIndex()->nHeight <= height)
             {
+                EraseFromOwnerMaps(protocolId, tokenId, it->NfTokenPtr()->tokenOwnerKeyId);
                 m_nfTokensIndexSet.erase(it);
                 PlatformDb::Instance().EraseNftDiskIndex(protocolId, tokenId);
                 this->UpdateTotalSupply(protocolId, false);
@@ -500,6 +560,7 @@ namespace Platform
             m_tipHeight = pindex->nHeight;
             m_tipBlockHash = pindex->GetBlockHash();
         }
+        PublishSnapshot();
     }
 
     void NfTokensManager::OnNewProtocolRegistered(uint64_t protocolId)
@@ -522,11 +583,71 @@ namespace Platform
         }
     }
 
+    NfTokensOfOwner & NfTokensManager::MutableNfTokensOf(const CKeyID & ownerId)
+    {
+        std::shared_ptr<NfTokensOwnerNode> * ownerNode = m_owners.FindMutable(ownerId);
+        if (ownerNode == nullptr)
+        {
+            m_owners.Set(ownerId, nullptr);
+            ownerNode = m_owners.FindMutable(ownerId);
+        }
+        /// Readers may still hold the published version, leave it untouched
+        return CopyOnWrite(*ownerNode, m_owners.Generation()).nfTokens;
+    }
+
+    void NfTokensManager::AddToOwnerMaps(const NfTokenIndex & nftIndex)
+    {
+        const NfToken & nfToken = *nftIndex.NfTokenPtr();
+        MutableNfTokensOf(nfToken.tokenOwnerKeyId).insert(nftIndex);
+        m_tokenOwners.Set(std::make_pair(nfToken.tokenProtocolId, nfToken.tokenId), nfToken.tokenOwnerKeyId);
+    }
+
+    void NfTokensManager::EraseFromOwnerMaps(uint64_t protocolId, const uint256 & tokenId, const CKeyID & ownerId)
+    {
+        m_tokenOwners.Erase(std::make_pair(protocolId, tokenId));
+        if (m_owners.Find(ownerId) == nullptr)
+            return;
+
+        NfTokensOfOwner & nfTokens = MutableNfTokensOf(ownerId);
+        auto it = nfTokens.find(std::make_tuple(protocolId, tokenId));
+        if (it != nfTokens.end())
+            nfTokens.erase(it);
+        if (nfTokens.empty())
+            m_owners.Erase(ownerId);
+    }
+
+    void NfTokensManager::PublishSnapshot()
+    {
+        auto snapshot = std::make_shared<NfTokensSnapshot>();
+        snapshot->tipHeight = m_tipHeight;
+        snapshot->tipBlockHash = m_tipBlockHash;
+        snapshot->owners = m_owners.Share();
+        snapshot->tokenOwners = m_tokenOwners.Share();
+        snapshot->protocolsTotalSupply = m_protocolsTotalSupply;
+
+        std::shared_ptr<const NfTokensSnapshot> previous = snapshot;
+        {
+            LOCK(m_csSnapshot);
+            m_snapshot.swap(previous);
+        }
+        /// The previous version is released here, outside of m_csSnapshot
+    }
+
+    std::shared_ptr<const NfTokensSnapshot> NfTokensManager::Snapshot() const
+    {
+        LOCK(m_csSnapshot);
+        return m_snapshot;
+    }
+
     NfTokenIndex NfTokensManager::GetNftIndexFromDb(uint64_t protocolId, const uint256 & tokenId)
     {
         NfTokenIndex nftIndex = PlatformDb::Instance().ReadNftIndex(protocolId, tokenId);
         if (!nftIndex.IsNull())
         {
+            /// Hot records of a RAM optimized node are cached by PlatformDb
+            if (PlatformDb::Instance().OptimizeRam())
+                return nftIndex;
+
             auto insRes = m_nfTokensIndexSet.emplace(std::move(nftIndex));
             assert(insRes.second);
             return *insRes.first;
@@ -5,14 +5,18 @@
 #ifndef CROWN_PLATFORM_NF_TOKENS_MANAGER_H
 #define CROWN_PLATFORM_NF_TOKENS_MANAGER_H
 
+#include <limits>
 #include <unordered_map>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/any_range.hpp>
 
 #include "sync.h"
 #include "chain.h"
+#include "hash.h"
+#include "random.h"
 #include "nf-token-multiindex-utils.h"
 #include "nf-token-index.h"
+#include "nf-token-persistent-map.h"
 
 class CTransaction;
 class CBlockIndex;
@@ -162,6 +166,77 @@ namespace Platform
         >
     >;
 
+    /// The nf-tokens of a single owner, ordered by protocol and registration height
+    using NfTokensOfOwner = bmx::multi_index_container<
+        NfTokenIndex,
+        bmx::indexed_by<
+            bmx::hashed_unique<
+                bmx::tag<Tags::ProtocolIdTokenId>,
+                bmx::composite_key<
+                    NfTokenIndex,
+                    TokenProtocolIdExtractor,
+                    TokenIdExtractor
+                >
+            >,
+            bmx::ordered_non_unique<
+                bmx::tag<Tags::ProtocolIdHeight>,
+                bmx::composite_key<
+                    NfTokenIndex,
+                    TokenProtocolIdExtractor,
+                    HeightExtractor
+                >
+            >,
+            bmx::ordered_non_unique<
+                bmx::tag<Tags::Height>,
+                HeightExtractor
+            >
+        >
+    >;
+
+    struct NfTokensOwnerNode
+    {
+        uint64_t generation{0};
+        NfTokensOfOwner nfTokens;
+    };
+
+    /// Salted, token ids are chosen by the registrants
+    struct NfTokensSnapshotHasher
+    {
+        uint64_t k0;
+        uint64_t k1;
+
+        NfTokensSnapshotHasher()
+            : k0(GetRand(std::numeric_limits<uint64_t>::max()))
+            , k1(GetRand(std::numeric_limits<uint64_t>::max()))
+        {
+        }
+
+        uint64_t operator()(const CKeyID & ownerId) const
+        {
+            return CSipHasher(k0, k1).Write(ownerId.begin(), ownerId.size()).Finalize();
+        }
+
+        uint64_t operator()(const std::pair<uint64_t, uint256> & protocolIdTokenId) const
+        {
+            return CSipHasher(k0, k1).Write(protocolIdTokenId.first).Write(protocolIdTokenId.second.begin(), 32).Finalize();
+        }
+    };
+
+    using NfTokensOwnersMap = PersistentHashMap<CKeyID, std::shared_ptr<NfTokensOwnerNode>, NfTokensSnapshotHasher>;
+    using NfTokenOwnerIdsMap = PersistentHashMap<std::pair<uint64_t, uint256>, CKeyID, NfTokensSnapshotHasher>;
+
+    /// Immutable view of the nf-tokens published at a block tip.
+    /// Readers share it without holding the manager lock. Publishing copies the
+    /// maps in O(1), only the parts modified since the previous tip are copied later.
+    struct NfTokensSnapshot
+    {
+        int tipHeight{-1};
+        uint256 tipBlockHash;
+        NfTokensOwnersMap owners;
+        NfTokenOwnerIdsMap tokenOwners;
+        std::unordered_map<uint64_t, std::size_t> protocolsTotalSupply;
+    };
+
     class NfTokensManager
     {
         public:
@@ -174,6 +249,11 @@ namespace Platform
                 return *s_instance;
             }
 
+            static void DestroyInstance()
+            {
+                s_instance.reset();
+            }
+
             /// Adds a new nf-token to the global set
             bool AddNfToken(const NfToken & nfToken, const CTransaction & tx, const CBlockIndex * pindex);
 
@@ -187,6 +267,9 @@ namespace Platform
             /// Retrieve a specified nf-token index by a transaction ID, may be null
             NfTokenIndex GetNfTokenIndex(const uint256 & regTxId);
 
+            /// OwnerOf, BalanceOf, NfTokensOf, NfTokenIdsOf and TotalSupply read the snapshot
+            /// published at the last block tip and do not wait for block connection
+
             /// Owner of a specified nf-token
             CKeyID OwnerOf(uint64_t protocolId, const uint256 & tokenId);
 
@@ -255,12 +338,26 @@ namespace Platform
             void UpdateTotalSupply(uint64_t protocolId, bool increase);
             NfTokenIndex GetNftIndexFromDb(uint64_t protocolId, const uint256 & tokenId);
 
+            /// The nf-tokens of an owner that can be modified, copied first if they are still part of the published snapshot
+            NfTokensOfOwner & MutableNfTokensOf(const CKeyID & ownerId);
+            void AddToOwnerMaps(const NfTokenIndex & nftIndex);
+            void EraseFromOwnerMaps(uint64_t protocolId, const uint256 & tokenId, const CKeyID & ownerId);
+            void PublishSnapshot();
+            std::shared_ptr<const NfTokensSnapshot> Snapshot() const;
+
         private:
             NfTokensIndexSet m_nfTokensIndexSet;
             int m_tipHeight{-1};
             uint256 m_tipBlockHash;
             mutable CCriticalSection m_cs;
 
+            /// Live owner maps, modified under m_cs
+            NfTokensOwnersMap m_owners;
+            NfTokenOwnerIdsMap m_tokenOwners;
+            /// Only guards the snapshot pointer itself
+            mutable CCriticalSection m_csSnapshot;
+            std::shared_ptr<const NfTokensSnapshot> m_snapshot;
+
             std::unordered_map<uint64_t, std::size_t> m_protocolsTotalSupply;
 
             static std::unique_ptr<NfTokensManager> s_instance;
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/thread.hpp>
+#include "crypto/common.h"
 #include "platform-utils.h"
 #include "platform-db.h"
 #include "platform/specialtx.h"
@@ -11,16 +12,99 @@
 
 namespace Platform
 {
+    namespace
+    {
+        /// Key of the NFT owner index, the value is unused
+        struct NftOwnerIndexKey
+        {
+            char prefix;
+            CKeyID ownerId;
+            uint64_t protocolId;
+            uint32_t height;
+            uint256 tokenId;
+
+            NftOwnerIndexKey() : prefix(PlatformDb::DB_NFT_OWNER), protocolId(NfToken::UNKNOWN_TOKEN_PROTOCOL), height(0) {}
+            explicit NftOwnerIndexKey(const NfTokenIndex & nftIndex)
+                : prefix(PlatformDb::DB_NFT_OWNER)
+                , ownerId(nftIndex.NfTokenPtr()->tokenOwnerKeyId)
+                , protocolId(nftIndex.NfTokenPtr()->tokenProtocolId)
+                , height(nftIndex.BlockIndex()->nHeight)
+                , tokenId(nftIndex.NfTokenPtr()->tokenId)
+            {
+            }
+
+            /// Required to be staged in a CDBTransaction
+            friend bool operator<(const NftOwnerIndexKey & a, const NftOwnerIndexKey & b)
+            {
+                return std::tie(a.ownerId, a.protocolId, a.height, a.tokenId) < std::tie(b.ownerId, b.protocolId, b.height, b.tokenId);
+            }
+
+            ADD_SERIALIZE_METHODS
+            template<typename Stream, typename Operation>
+            inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+            {
+                READWRITE(prefix);
+                READWRITE(ownerId);
+                READWRITE(protocolId);
+                /// Big endian, so that leveldb orders the records of an owner by height
+                unsigned char heightBE[4];
+                WriteBE32(heightBE, height);
+                READWRITE(FLATDATA(heightBE));
+                height = ReadBE32(heightBE);
+                READWRITE(tokenId);
+            }
+        };
+
+        /// Process the committed owner index keys of an owner, UNKNOWN_TOKEN_PROTOCOL selects all protocols
+        void ProcessNftOwnerIndexKeys(CLevelDBWrapper & db, const CKeyID & ownerId, uint64_t protocolId,
+                                      std::function<bool(const NftOwnerIndexKey &)> keyHandler)
+        {
+            CDataStream prefix(SER_DISK, CLIENT_VERSION);
+            prefix << PlatformDb::DB_NFT_OWNER << ownerId;
+            if (protocolId != NfToken::UNKNOWN_TOKEN_PROTOCOL)
+                prefix << protocolId;
+            leveldb::Slice slicePrefix(&prefix[0], prefix.size());
+
+            std::unique_ptr<leveldb::Iterator> dbIt(db.NewIterator());
+            for (dbIt->Seek(slicePrefix); dbIt->Valid() && dbIt->key().starts_with(slicePrefix); dbIt->Next())
+            {
+                leveldb::Slice sliceKey = dbIt->key();
+                CDataStream streamKey(sliceKey.data(), sliceKey.data() + sliceKey.size(), SER_DISK, CLIENT_VERSION);
+                NftOwnerIndexKey key;
+
+                try
+                {
+                    streamKey >> key;
+                }
+                catch (const std::exception & ex)
+                {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, ex.what());
+                    continue;
+                }
+
+                if (!keyHandler(key))
+                    break;
+            }
+
+            HandleError(dbIt->status());
+        }
+    }
+
     /*static*/ std::unique_ptr<PlatformDb> PlatformDb::s_instance;
     /*static*/ const char PlatformDb::DB_NFT = 'n';
     /*static*/ const char PlatformDb::DB_NFT_TOTAL = 't';
     /*static*/ const char PlatformDb::DB_NFT_PROTO = 'p';
     /*static*/ const char PlatformDb::DB_NFT_PROTO_TOTAL = 'c';
+    /*static*/ const char PlatformDb::DB_NFT_OWNER = 'o';
+    /*static*/ const char PlatformDb::DB_NFT_OWNER_BALANCE = 'b';
+    /*static*/ const char PlatformDb::DB_NFT_OWNER_INDEX_FLAG = 'O';
 
-    PlatformDb::PlatformDb(size_t nCacheSize, PlatformOpt optSetting, bool fMemory, bool fWipe)
+    PlatformDb::PlatformDb(size_t nCacheSize, PlatformOpt optSetting, bool fMemory, bool fWipe, std::size_t nftIndexCacheSize)
     : TransactionLevelDBWrapper("platform", nCacheSize, fMemory, fWipe)
     {
         m_optSetting = optSetting;
+        /// Speed optimized nodes keep every NFT index in memory already
+        m_nftIndexCache.max_size(optSetting == PlatformOpt::OptRam ? nftIndexCacheSize : 0);
     }
 
     void PlatformDb::ProcessPlatformDbGuts(std::function<bool(const leveldb::Iterator &)> processor)
@@ -198,6 +282,14 @@ namespace Platform
 
     void PlatformDb::WriteNftDiskIndex(const NfTokenDiskIndex & nftDiskIndex)
     {
+        LOCK(m_cs);
+        const auto & nfToken = *nftDiskIndex.NfTokenPtr();
+        m_nftIndexCache.erase(std::make_pair(nfToken.tokenProtocolId, nfToken.tokenId));
+        if (!this->Exists(std::make_tuple(DB_NFT, nfToken.tokenProtocolId, nfToken.tokenId)))
+        {
+            this->Write(NftOwnerIndexKey(nftDiskIndex), '1');
+            UpdateNftOwnerBalance(nfToken.tokenOwnerKeyId, nfToken.tokenProtocolId, true);
+        }
         this->Write(std::make_tuple(DB_NFT,
               nftDiskIndex.NfTokenPtr()->tokenProtocolId,
               nftDiskIndex.NfTokenPtr()->tokenId),
@@ -207,19 +299,130 @@ namespace Platform
 
     void PlatformDb::EraseNftDiskIndex(const uint64_t &protocolId, const uint256 &tokenId)
     {
+        LOCK(m_cs);
+        m_nftIndexCache.erase(std::make_pair(protocolId, tokenId));
+        NfTokenDiskIndex nftDiskIndex;
+        if (this->Read(std::make_tuple(DB_NFT, protocolId, tokenId), nftDiskIndex))
+        {
+            const CKeyID & ownerId = nftDiskIndex.NfTokenPtr()->tokenOwnerKeyId;
+            NfTokenIndex nftIndex = NftDiskIndexToNftMemIndex(nftDiskIndex);
+            if (!nftIndex.IsNull())
+            {
+                this->Erase(NftOwnerIndexKey(nftIndex));
+            }
+            else
+            {
+                /// The height is not stored with the record, without the block index the key is found by a search
+                LogPrintf("%s : Block %s of NFT %s is unknown, searching the owner index\n", __func__,
+                          nftDiskIndex.BlockHash().ToString(), tokenId.ToString());
+                ProcessNftOwnerIndexKeys(m_db, ownerId, protocolId, [&](const NftOwnerIndexKey & key) -> bool
+                {
+                    if (key.tokenId != tokenId)
+                        return true;
+                    this->Erase(key);
+                    return false;
+                });
+            }
+            UpdateNftOwnerBalance(ownerId, protocolId, false);
+        }
         this->Erase(std::make_tuple(DB_NFT, protocolId, tokenId));
     }
 
     NfTokenIndex PlatformDb::ReadNftIndex(const uint64_t &protocolId, const uint256 &tokenId)
     {
+        LOCK(m_cs);
+        auto cacheKey = std::make_pair(protocolId, tokenId);
+        NfTokenIndex nftIndex;
+        if (m_nftIndexCache.get(cacheKey, nftIndex))
+        {
+            ++m_nftIndexCacheHits;
+            return nftIndex;
+        }
+        ++m_nftIndexCacheMisses;
+
         NfTokenDiskIndex nftDiskIndex;
         if (this->Read(std::make_tuple(DB_NFT, protocolId, tokenId), nftDiskIndex))
         {
-            return NftDiskIndexToNftMemIndex(nftDiskIndex);
+            nftIndex = NftDiskIndexToNftMemIndex(nftDiskIndex);
+            /// Records read inside an open block transaction may still be rolled back
+            if (!nftIndex.IsNull() && m_dbTransaction.IsClean())
+                m_nftIndexCache.insert(cacheKey, nftIndex);
+            return nftIndex;
         }
         return NfTokenIndex();
     }
 
+    NftIndexCacheStats PlatformDb::GetNftIndexCacheStats()
+    {
+        LOCK(m_cs);
+        NftIndexCacheStats stats;
+        stats.size = m_nftIndexCache.size();
+        stats.maxSize = m_nftIndexCache.max_size();
+        stats.hits = m_nftIndexCacheHits;
+        stats.misses = m_nftIndexCacheMisses;
+        return stats;
+    }
+
+    bool PlatformDb::IsNftOwnerIndexBuilt()
+    {
+        return m_db.Exists(DB_NFT_OWNER_INDEX_FLAG);
+    }
+
+    void PlatformDb::BuildNftOwnerIndex()
+    {
+        LOCK(m_cs);
+        LogPrintf("%s: Building the NFT owner index\n", __func__);
+
+        CLevelDBBatch batch;
+        std::map<std::pair<CKeyID, uint64_t>, std::size_t> balances;
+        uint64_t allProtocolsId = NfToken::UNKNOWN_TOKEN_PROTOCOL;
+        ProcessNftIndexGutsOnly([&](NfTokenIndex nftIndex) -> bool
+        {
+            batch.Write(NftOwnerIndexKey(nftIndex), '1');
+            const CKeyID & ownerId = nftIndex.NfTokenPtr()->tokenOwnerKeyId;
+            ++balances[std::make_pair(ownerId, nftIndex.NfTokenPtr()->tokenProtocolId)];
+            ++balances[std::make_pair(ownerId, allProtocolsId)];
+            return true;
+        });
+
+        for (const auto & balance : balances)
+        {
+            batch.Write(std::make_tuple(DB_NFT_OWNER_BALANCE, balance.first.first, balance.first.second), balance.second);
+        }
+        batch.Write(DB_NFT_OWNER_INDEX_FLAG, '1');
+        m_db.WriteBatch(batch, true);
+    }
+
+    void PlatformDb::ProcessNftOwnerIndex(const CKeyID & ownerId, uint64_t protocolId, std::function<bool(uint64_t, const uint256 &)> nftHandler)
+    {
+        ProcessNftOwnerIndexKeys(m_db, ownerId, protocolId, [&](const NftOwnerIndexKey & key) -> bool
+        {
+            return nftHandler(key.protocolId, key.tokenId);
+        });
+    }
+
+    std::size_t PlatformDb::ReadNftOwnerBalance(const CKeyID & ownerId, uint64_t protocolId)
+    {
+        std::size_t balance = 0;
+        m_db.Read(std::make_tuple(DB_NFT_OWNER_BALANCE, ownerId, protocolId), balance);
+        return balance;
+    }
+
+    void PlatformDb::UpdateNftOwnerBalance(const CKeyID & ownerId, uint64_t protocolId, bool increase)
+    {
+        for (uint64_t balanceProtocolId : {protocolId, NfToken::UNKNOWN_TOKEN_PROTOCOL})
+        {
+            auto key = std::make_tuple(DB_NFT_OWNER_BALANCE, ownerId, balanceProtocolId);
+            std::size_t balance = 0;
+            this->Read(key, balance);
+            balance = increase ? balance + 1 : balance - 1;
+            if (balance == 0)
+                this->Erase(key);
+            else
+                this->Write(key, balance);
+        }
+    }
+
     void PlatformDb::WriteNftProtoDiskIndex(const NftProtoDiskIndex & protoDiskIndex)
     {
         this->Write(std::make_pair(DB_NFT_PROTO, protoDiskIndex.NftProtoPtr()->tokenProtocolId), protoDiskIndex);
@@ -7,6 +7,7 @@
 
 #include "uint256.h"
 #include "leveldbwrapper.h"
+#include "lrucache.h"
 #include "sync.h"
 #include "platform/nf-token/nf-token-index.h"
 #include "platform/nf-token/nf-token-protocol-index.h"
@@ -21,6 +22,17 @@ namespace Platform
         OptRam
     };
 
+    /// Default number of NFT index entries cached in memory with PlatformOpt::OptRam
+    static const std::size_t DEFAULT_NFT_INDEX_CACHE_SIZE = 50000;
+
+    struct NftIndexCacheStats
+    {
+        std::size_t size;
+        std::size_t maxSize;
+        uint64_t hits;
+        uint64_t misses;
+    };
+
     class PlatformDb : public TransactionLevelDBWrapper
     {
     public:
@@ -28,10 +40,11 @@ namespace Platform
                 size_t nCacheSize,
                 PlatformOpt optSetting = PlatformOpt::OptSpeed,
                 bool fMemory = false,
-                bool fWipe = false)
+                bool fWipe = false,
+                std::size_t nftIndexCacheSize = DEFAULT_NFT_INDEX_CACHE_SIZE)
         {
             if (s_instance == nullptr)
-                s_instance.reset(new PlatformDb(nCacheSize, optSetting, fMemory, fWipe));
+                s_instance.reset(new PlatformDb(nCacheSize, optSetting, fMemory, fWipe, nftIndexCacheSize));
             return *s_instance;
         }
 
@@ -62,7 +75,17 @@ namespace Platform
         bool IsNftIndexEmpty();
         void WriteNftDiskIndex(const NfTokenDiskIndex & nftDiskIndex);
         void EraseNftDiskIndex(const uint64_t &protocolId, const uint256 &tokenId);
+        /// With PlatformOpt::OptRam the most recently read records are kept in an LRU cache
         NfTokenIndex ReadNftIndex(const uint64_t &protocolId, const uint256 &tokenId);
+        NftIndexCacheStats GetNftIndexCacheStats();
+
+        /// Secondary index of the NFTs by owner, maintained by WriteNftDiskIndex and EraseNftDiskIndex.
+        /// Queries read the committed state and run in O(result) regardless of the registry size.
+        bool IsNftOwnerIndexBuilt();
+        void BuildNftOwnerIndex();
+        /// Process NFTs of an owner grouped by protocol and ordered by height, UNKNOWN_TOKEN_PROTOCOL selects all protocols
+        void ProcessNftOwnerIndex(const CKeyID & ownerId, uint64_t protocolId, std::function<bool(uint64_t, const uint256 &)> nftHandler);
+        std::size_t ReadNftOwnerBalance(const CKeyID & ownerId, uint64_t protocolId = NfToken::UNKNOWN_TOKEN_PROTOCOL);
 
         void WriteTotalSupply(std::size_t count, uint64_t nftProtocolId = NfToken::UNKNOWN_TOKEN_PROTOCOL);
         bool ReadTotalSupply(std::size_t & count, uint64_t nftProtocolId = NfToken::UNKNOWN_TOKEN_PROTOCOL);
@@ -79,7 +102,8 @@ namespace Platform
                 size_t nCacheSize,
                 PlatformOpt optSetting = PlatformOpt::OptSpeed,
                 bool fMemory = false,
-                bool fWipe = false
+                bool fWipe = false,
+                std::size_t nftIndexCacheSize = DEFAULT_NFT_INDEX_CACHE_SIZE
                 );
 
     public:
@@ -87,10 +111,21 @@ namespace Platform
         static const char DB_NFT_TOTAL;
         static const char DB_NFT_PROTO;
         static const char DB_NFT_PROTO_TOTAL;
+        static const char DB_NFT_OWNER;
+        static const char DB_NFT_OWNER_BALANCE;
+        static const char DB_NFT_OWNER_INDEX_FLAG;
+
+    private:
+        void UpdateNftOwnerBalance(const CKeyID & ownerId, uint64_t protocolId, bool increase);
 
     private:
         PlatformOpt m_optSetting = PlatformOpt::OptSpeed;
 
+        /// Guarded by m_cs, only holds committed records
+        lrucache<std::pair<uint64_t, uint256>, NfTokenIndex> m_nftIndexCache;
+        uint64_t m_nftIndexCacheHits{0};
+        uint64_t m_nftIndexCacheMisses{0};
+
         static std::unique_ptr<PlatformDb> s_instance;
     };
 }
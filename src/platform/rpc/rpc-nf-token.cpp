@@ -10,6 +10,7 @@
 #include "platform/nf-token/nf-token-reg-tx-builder.h"
 #include "platform/nf-token/nf-tokens-manager.h"
 #include "platform/nf-token/nft-protocols-manager.h"
+#include "platform/platform-db.h"
 #include "specialtx-rpc-utils.h"
 #include "rpc-nf-token.h"
 
@@ -20,7 +21,7 @@ json_spirit::Value nftoken(const json_spirit::Array& params, bool fHelp)
         throw std::runtime_error("NFT spork is off");
     }
 
-    std::string command = Platform::GetCommand(params, "usage: nftoken register(issue)|list|get|getbytxid|totalsupply|balanceof|ownerof");
+    std::string command = Platform::GetCommand(params, "usage: nftoken register(issue)|list|get|getbytxid|totalsupply|balanceof|ownerof|cachestats");
 
     if (command == "register" || command == "issue")
         return Platform::RegisterNfToken(params, fHelp);
@@ -36,6 +37,8 @@ json_spirit::Value nftoken(const json_spirit::Array& params, bool fHelp)
         return Platform::NfTokenBalanceOf(params, fHelp);
     else if (command == "ownerof")
         return Platform::NfTokenOwnerOf(params, fHelp);
+    else if (command == "cachestats")
+        return Platform::NfTokenCacheStats(params, fHelp);
 
     throw std::runtime_error("Invalid command: " + command);
 }
@@ -442,4 +445,40 @@ Examples:
 
         return CBitcoinAddress(ownerId).ToString();
     }
+
+    void NfTokenCacheStatsHelp()
+    {
+        static std::string helpMessage = R"(nftoken cachestats
+Get statistics of the in-memory NFT index cache used by -platformoptram nodes
+
+Result:
+{
+  "size": n,        (numeric) Number of cached NFT index records
+  "maxsize": n,     (numeric) Cache capacity, see -nftindexcachesize. 0 when every record is kept in memory or read from disk
+  "hits": n,        (numeric) Lookups answered from the cache
+  "misses": n       (numeric) Lookups that had to read the platform database
+}
+
+Examples:
+)"
++ HelpExampleCli("nftoken", "cachestats")
++ HelpExampleRpc("nftoken", "cachestats");
+
+        throw std::runtime_error(helpMessage);
+    }
+
+    json_spirit::Value NfTokenCacheStats(const json_spirit::Array& params, bool fHelp)
+    {
+        if (fHelp || params.size() != 1)
+            NfTokenCacheStatsHelp();
+
+        NftIndexCacheStats stats = PlatformDb::Instance().GetNftIndexCacheStats();
+
+        json_spirit::Object statsJsonObj;
+        statsJsonObj.push_back(json_spirit::Pair("size", static_cast<uint64_t>(stats.size)));
+        statsJsonObj.push_back(json_spirit::Pair("maxsize", static_cast<uint64_t>(stats.maxSize)));
+        statsJsonObj.push_back(json_spirit::Pair("hits", stats.hits));
+        statsJsonObj.push_back(json_spirit::Pair("misses", stats.misses));
+        return statsJsonObj;
+    }
 }
@@ -25,6 +25,8 @@ namespace Platform
     void NfTokenBalanceOfHelp();
     json_spirit::Value NfTokenOwnerOf(const json_spirit::Array& params, bool fHelp);
     void NfTokenOwnerOfHelp();
+    json_spirit::Value NfTokenCacheStats(const json_spirit::Array& params, bool fHelp);
+    void NfTokenCacheStatsHelp();
 }
 
 #endif // CROWN_PLATFORM_RPC_NF_TOKEN_H
@@ -33,7 +33,8 @@ static const char* ppszTypeName[] =
     "sn winner",
     "sn announce",
     "sn ping",
-    "dstx"
+    "dstx",
+    "compact block"
 };
 
 CMessageHeader::CMessageHeader(const MessageStartChars& pchMessageStartIn)
@@ -164,7 +164,10 @@ enum {
     MSG_SYSTEMNODE_ANNOUNCE,
     MSG_SYSTEMNODE_PING,
     MSG_SYSTEMNODE_WINNER,
-    MSG_DSTX
+    MSG_DSTX,
+    // Like MSG_FILTERED_BLOCK, MSG_CMPCT_BLOCK only appears in getdata, to ask for a "cmpctblock"
+    // message, and only to peers of at least COMPACT_BLOCKS_VERSION that sent "sendcmpct".
+    MSG_CMPCT_BLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -6,6 +6,7 @@
 
 #include "checkpoints.h"
 #include "main.h"
+#include "miner.h"
 #include "rpcserver.h"
 #include "sync.h"
 #include "util.h"
@@ -201,10 +202,9 @@ Value getrawmempool(const Array& params, bool fHelp)
     {
         LOCK(mempool.cs);
         Object o;
-        BOOST_FOREACH(const PAIRTYPE(uint256, CTxMemPoolEntry)& entry, mempool.mapTx)
+        BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
         {
-            const uint256& hash = entry.first;
-            const CTxMemPoolEntry& e = entry.second;
+            const uint256& hash = e.GetTx().GetHash();
             Object info;
             info.push_back(Pair("size", (int)e.GetTxSize()));
             info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
@@ -551,6 +551,48 @@ Value getblockchaininfo(const Array& params, bool fHelp)
     return obj;
 }
 
+Value getsyncinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsyncinfo\n"
+            "Returns an object containing the progress and throughput of block download.\n"
+            "Rates are measured over the last minute.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"headersfirst\": true|false,      (boolean) whether the headers are synced first and the blocks downloaded from all peers in parallel\n"
+            "  \"initialblockdownload\": true|false, (boolean) whether the node is in initial block download\n"
+            "  \"blocks\": xxxxxx,                (numeric) the current number of blocks processed in the server\n"
+            "  \"headers\": xxxxxx,               (numeric) the current number of headers we have validated\n"
+            "  \"verificationprogress\": xxxx,    (numeric) estimate of verification progress [0..1]\n"
+            "  \"inflight\": xxxx,                (numeric) the number of blocks requested from peers and not received yet\n"
+            "  \"downloadpeers\": xxxx,           (numeric) the number of peers we are downloading blocks from\n"
+            "  \"stallingpeers\": xxxx,           (numeric) the number of peers holding up the block download window\n"
+            "  \"blockspersec\": x.xx,            (numeric) blocks connected to the chain per second\n"
+            "  \"bytespersec\": x.xx              (numeric) bytes of block data received per second\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getsyncinfo", "")
+            + HelpExampleRpc("getsyncinfo", "")
+        );
+
+    CBlockDownloadStats stats;
+    GetBlockDownloadStats(stats);
+
+    Object obj;
+    obj.push_back(Pair("headersfirst",          fHeadersFirst));
+    obj.push_back(Pair("initialblockdownload",  IsInitialBlockDownload()));
+    obj.push_back(Pair("blocks",                (int)chainActive.Height()));
+    obj.push_back(Pair("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1));
+    obj.push_back(Pair("verificationprogress",  Checkpoints::GuessVerificationProgress(chainActive.Tip())));
+    obj.push_back(Pair("inflight",              stats.nBlocksInFlight));
+    obj.push_back(Pair("downloadpeers",         stats.nPeersDownloading));
+    obj.push_back(Pair("stallingpeers",         stats.nPeersStalling));
+    obj.push_back(Pair("blockspersec",          stats.dBlocksPerSec));
+    obj.push_back(Pair("bytespersec",           stats.dBytesPerSec));
+    return obj;
+}
+
 /** Comparison function for sorting the getchaintips heads.  */
 struct CompareBlocksByHeight
 {
@@ -665,6 +707,7 @@ Value getmempoolinfo(const Array& params, bool fHelp)
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
+            "  \"templatetime\": xxxxx        (numeric) Time in milliseconds it took to assemble the last block template\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -675,6 +718,7 @@ Value getmempoolinfo(const Array& params, bool fHelp)
     ret.push_back(Pair("size", (int64_t) mempool.size()));
     ret.push_back(Pair("bytes", (int64_t) mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t) mempool.DynamicMemoryUsage()));
+    ret.push_back(Pair("templatetime", nLastBlockTemplateTime.load() * 0.001));
 
     return ret;
 }
@@ -471,8 +471,8 @@ Value mnbudget(const Array& params, bool fHelp)
 
         if(pbudgetProposal == NULL) return "Unknown proposal name";
 
-        std::map<uint256, CBudgetVote>::iterator it = pbudgetProposal->mapVotes.begin();
-        while(it != pbudgetProposal->mapVotes.end()){
+        std::map<uint256, CBudgetVote>::const_iterator it = pbudgetProposal->GetVoteMap().begin();
+        while(it != pbudgetProposal->GetVoteMap().end()){
 
             Object bObj;
             bObj.push_back(Pair("nHash",  (*it).first.ToString().c_str()));
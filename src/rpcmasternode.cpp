@@ -13,6 +13,8 @@
 #include "masternode-payments.h"
 #include "masternode-budget.h"
 #include "masternodeconfig.h"
+#include "legacysigner.h"
+#include "mn-pos/paymentindex.h"
 #include "rpcserver.h"
 #include "utilmoneystr.h"
 
@@ -88,6 +90,49 @@ Value getstakepointers(const Array& params, bool fHelp)
     return ret;
 }
 
+Value getstakingstatus(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+                "getstakingstatus\n"
+                "Returns how the last attempt to stake a block went.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"staking_active\": true|false,   (boolean) if a block was staked for in the last two minutes\n"
+                "  \"attempts\": n,                  (numeric) attempts since startup, left out like the fields up to attempt_ms with -disablewallet\n"
+                "  \"last_attempt\": ttt,            (numeric) time of the last attempt in seconds since epoch\n"
+                "  \"stake_pointers\": n,            (numeric) stake pointers found in the last attempt\n"
+                "  \"pointer_search_ms\": x.xx,      (numeric) time taken to find the stake pointers\n"
+                "  \"kernel_search_ms\": x.xx,       (numeric) time taken to search their kernels\n"
+                "  \"attempt_ms\": x.xx,             (numeric) time taken by the whole attempt\n"
+                "  \"paymentindex_height\": n,       (numeric) tip of the payment index the stake pointers come from\n"
+                "  \"paymentindex_payments\": n      (numeric) payments in the payment index\n"
+                "}\n"
+                "\nExamples:\n"
+                + HelpExampleCli("getstakingstatus", "")
+                + HelpExampleRpc("getstakingstatus", ""));
+
+    Object obj;
+    obj.push_back(Pair("staking_active", (bool)(GetTime() - nLastStakeAttempt < 120)));
+    if (pwalletMain) {
+        LOCK(pwalletMain->cs_wallet);
+        const CStakeAttemptStats& stats = pwalletMain->stakeAttemptStats;
+        obj.push_back(Pair("attempts", (uint64_t)stats.nAttempts));
+        obj.push_back(Pair("last_attempt", stats.nTime));
+        obj.push_back(Pair("stake_pointers", (uint64_t)stats.nPointers));
+        obj.push_back(Pair("pointer_search_ms", stats.nPointerTime * 0.001));
+        obj.push_back(Pair("kernel_search_ms", stats.nKernelTime * 0.001));
+        obj.push_back(Pair("attempt_ms", (stats.nPointerTime + stats.nKernelTime) * 0.001));
+    }
+    {
+        LOCK(cs_main);
+        obj.push_back(Pair("paymentindex_height", g_paymentIndex->GetHeight()));
+        obj.push_back(Pair("paymentindex_payments", (uint64_t)g_paymentIndex->GetPaymentCount()));
+    }
+
+    return obj;
+}
+
 
 Value masternode(const Array& params, bool fHelp)
 {
@@ -99,7 +144,7 @@ Value masternode(const Array& params, bool fHelp)
         (strCommand != "start" && strCommand != "start-alias" && strCommand != "start-many" && strCommand != "start-all" && strCommand != "start-missing" &&
          strCommand != "start-disabled" && strCommand != "list" && strCommand != "list-conf" && strCommand != "count"  && strCommand != "enforce" &&
         strCommand != "debug" && strCommand != "current" && strCommand != "winners" && strCommand != "connect" &&
-        strCommand != "outputs" && strCommand != "status" && strCommand != "calcscore"))
+        strCommand != "outputs" && strCommand != "status" && strCommand != "calcscore" && strCommand != "sigcache"))
         throw runtime_error(
                 "masternode \"command\"... ( \"passphrase\" )\n"
                 "Set of commands to execute masternode related actions\n"
@@ -118,6 +163,7 @@ Value masternode(const Array& params, bool fHelp)
                 "  status       - Print masternode status information\n"
                 "  list         - Print list of all known masternodes (see masternodelist for more info)\n"
                 "  list-conf    - Print masternode.conf in JSON format\n"
+                "  sigcache     - Print usage of the masternode message signature cache\n"
                 "  winners      - Print list of masternode winners\n"
                 );
 
@@ -412,6 +458,21 @@ Value masternode(const Array& params, bool fHelp)
         return obj;
     }
 
+    if (strCommand == "sigcache")
+    {
+        CLegacySignerCacheStats stats = legacySigner.GetCacheStats();
+        uint64_t nLookups = stats.nHits + stats.nMisses;
+
+        Object obj;
+        obj.push_back(Pair("entries", (uint64_t)stats.nEntries));
+        obj.push_back(Pair("usage", (uint64_t)stats.nUsage));
+        obj.push_back(Pair("maxsize", GetArg("-maxmnsigcachesize", DEFAULT_MAX_LEGACYSIGNER_CACHE_SIZE) << 20));
+        obj.push_back(Pair("hits", stats.nHits));
+        obj.push_back(Pair("misses", stats.nMisses));
+        obj.push_back(Pair("hitrate", nLookups > 0 ? (double)stats.nHits / nLookups : 0.0));
+        return obj;
+    }
+
     /*
         Shows which masternode wins by score each block
     */
@@ -107,7 +107,15 @@ Value getpeerinfo(const Array& params, bool fHelp)
             "    \"inflight\": [\n"
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
-            "    ]\n"
+            "    ],\n"
+            "    \"blocksrecv\": n,           (numeric) The number of blocks received from this peer\n"
+            "    \"blockbytesrecv\": n,       (numeric) The bytes of block data received from this peer\n"
+            "    \"stalling\": true|false,    (boolean) Whether this peer is holding up the block download window\n"
+            "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
+            "    \"timepermsg\": {            (json object) Time spent processing the messages of the peer, by command\n"
+            "       \"command\": n,            (numeric) The total processing time in microseconds\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -154,8 +162,15 @@ Value getpeerinfo(const Array& params, bool fHelp)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("blocksrecv", statestats.nBlocksReceived));
+            obj.push_back(Pair("blockbytesrecv", statestats.nBlockBytesReceived));
+            obj.push_back(Pair("stalling", statestats.nStallingSince != 0));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        Object timePerMsg;
+        BOOST_FOREACH(const PAIRTYPE(std::string, int64_t)& item, stats.mapTimePerMsgCmd)
+            timePerMsg.push_back(Pair(item.first, item.second));
+        obj.push_back(Pair("timepermsg", timePerMsg));
 
         ret.push_back(obj);
     }
@@ -418,6 +433,51 @@ Value getnettotals(const Array& params, bool fHelp)
     return obj;
 }
 
+Object netMsgStatsToJSON()
+{
+    Object obj;
+    std::map<std::string, CMessageStats> mapStats = CNode::GetMessageStats();
+    BOOST_FOREACH(const PAIRTYPE(std::string, CMessageStats)& item, mapStats) {
+        const CMessageStats& stats = item.second;
+        Object entry;
+        entry.push_back(Pair("count", stats.nCount));
+        entry.push_back(Pair("bytes", stats.nBytes));
+        entry.push_back(Pair("time", stats.nTime));
+        entry.push_back(Pair("avgtime", stats.nCount > 0 ? stats.nTime / (int64_t)stats.nCount : 0));
+        entry.push_back(Pair("maxtime", stats.nMaxTime));
+        entry.push_back(Pair("lockwait", stats.nLockWait));
+        obj.push_back(Pair(item.first, entry));
+    }
+    return obj;
+}
+
+Value getnetmsgstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns statistics about the processing of the messages received from peers, by command.\n"
+            "Times are in microseconds.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"command\": {       (json object) The message command, such as tx, mnb or mvote\n"
+            "    \"count\": n,      (numeric) Number of messages processed\n"
+            "    \"bytes\": n,      (numeric) Total payload bytes\n"
+            "    \"time\": n,       (numeric) Total processing time\n"
+            "    \"avgtime\": n,    (numeric) Average processing time\n"
+            "    \"maxtime\": n,    (numeric) Longest processing time\n"
+            "    \"lockwait\": n    (numeric) Total time spent waiting for the main lock (cs_main)\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getnetmsgstats", "")
+            + HelpExampleRpc("getnetmsgstats", "")
+       );
+
+    return netMsgStatsToJSON();
+}
+
 static Array GetNetworksInfo()
 {
     Array networks;
@@ -20,10 +20,14 @@
 #include "wallet.h"
 #endif
 
+#include <atomic>
+#include <deque>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
 #include <boost/iostreams/concepts.hpp>
@@ -37,6 +41,76 @@ using namespace boost::asio;
 using namespace json_spirit;
 using namespace std;
 
+/** Requests read in full from the RPC clients, waiting for and being serviced by the RPC worker threads */
+class RPCWorkQueue
+{
+public:
+    RPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), nActive(0), fRunning(true) {}
+
+    /** Queue a request, fails if nMaxDepth requests are already waiting */
+    bool Enqueue(const boost::function<void(void)>& func)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!fRunning || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(func);
+        cond.notify_one();
+        return true;
+    }
+
+    /** Service queued requests until interrupted, run by each of the RPC worker threads */
+    void Run()
+    {
+        while (true) {
+            boost::function<void(void)> func;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    break;
+                func = queue.front();
+                queue.pop_front();
+                nActive++;
+            }
+            func();
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                nActive--;
+            }
+        }
+    }
+
+    void Interrupt()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        fRunning = false;
+        cond.notify_all();
+    }
+
+    size_t GetMaxDepth() const { return nMaxDepth; }
+
+    size_t GetQueued()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return queue.size();
+    }
+
+    size_t GetActive()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        return nActive;
+    }
+
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::deque<boost::function<void(void)> > queue;
+    const size_t nMaxDepth;
+    size_t nActive;
+    bool fRunning;
+};
+
 static std::string strRPCUserColonPass;
 
 static bool fRPCRunning = false;
@@ -52,6 +126,10 @@ static boost::thread_group* rpc_worker_group = NULL;
 static boost::asio::io_service::work *rpc_dummy_work = NULL;
 static std::vector<CSubNet> rpc_allow_subnets; //!< List of subnets to allow RPC connections from
 static std::vector< boost::shared_ptr<ip::tcp::acceptor> > rpc_acceptors;
+static RPCWorkQueue* rpc_work_queue = NULL;
+static int rpc_worker_count = 0;
+static std::atomic<int> rpc_connection_count(0); //!< Open client connections, most of them idle between requests
+static int rpc_server_timeout = DEFAULT_RPC_SERVER_TIMEOUT; //!< Seconds a connection may take to send its next request
 
 void RPCTypeCheck(const Array& params,
                   const list<Value_type>& typesExpected,
@@ -304,6 +382,35 @@ Value restart(const Array& params, bool fHelp)
 }
 
 
+Value getrpcinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrpcinfo\n"
+            "\nReturns the state of the RPC server.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"threads\": n,       (numeric) The number of RPC worker threads (-rpcthreads)\n"
+            "  \"workqueue\": n,     (numeric) The most requests that can wait for a worker (-rpcworkqueue)\n"
+            "  \"queued\": n,        (numeric) The requests waiting for a worker\n"
+            "  \"active\": n,        (numeric) The requests being serviced by a worker\n"
+            "  \"connections\": n    (numeric) The open client connections, idle ones wait without a worker\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrpcinfo", "")
+            + HelpExampleRpc("getrpcinfo", "")
+        );
+
+    Object obj;
+    obj.push_back(Pair("threads", rpc_worker_count));
+    obj.push_back(Pair("workqueue", rpc_work_queue ? (int)rpc_work_queue->GetMaxDepth() : 0));
+    obj.push_back(Pair("queued", rpc_work_queue ? (int)rpc_work_queue->GetQueued() : 0));
+    obj.push_back(Pair("active", rpc_work_queue ? (int)rpc_work_queue->GetActive() : 0));
+    obj.push_back(Pair("connections", rpc_connection_count.load()));
+    return obj;
+}
+
+
 /**
  * Call Table
  */
@@ -312,6 +419,7 @@ static const CRPCCommand vRPCCommands[] =
   //  --------------------- ------------------------  -----------------------  ---------- ---------- ---------
     /* Overall control/query calls */
     { "control",            "getinfo",                &getinfo,                true,      false,      false }, /* uses wallet if enabled */
+    { "control",            "getrpcinfo",             &getrpcinfo,             true,      true,       false },
     { "control",            "help",                   &help,                   true,      true,       false },
     { "control",            "stop",                   &stop,                   true,      true,       false },
     { "control",            "restart",                &restart,                true,      true,       false },
@@ -322,6 +430,7 @@ static const CRPCCommand vRPCCommands[] =
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,      true,       false },
     { "network",            "getconnectioncount",     &getconnectioncount,     true,      false,      false },
     { "network",            "getnettotals",           &getnettotals,           true,      true,       false },
+    { "network",            "getnetmsgstats",         &getnetmsgstats,         true,      true,       false },
     { "network",            "getpeerinfo",            &getpeerinfo,            true,      false,      false },
     { "network",            "ping",                   &ping,                   true,      false,      false },
 
@@ -336,6 +445,7 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,      false,      false },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,      true,       false },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,      false,      false },
+    { "blockchain",         "getsyncinfo",            &getsyncinfo,            true,      false,      false },
     { "blockchain",         "gettxout",               &gettxout,               true,      false,      false },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,      false,      false },
     { "blockchain",         "verifychain",            &verifychain,            true,      false,      false },
@@ -392,6 +502,7 @@ static const CRPCCommand vRPCCommands[] =
     { "crown",               "systemnodebroadcast",  &systemnodebroadcast,   true,      true,       false },
     { "crown",               "node",  &node,   true,      true,       false },
     { "crown",               "getstakepointers",  &getstakepointers,   true,      true,       false },
+    { "crown",               "getstakingstatus",  &getstakingstatus,   true,      true,       false },
 
     /* API features */
     { "api",                 "service",               &service,                true,      true,       false },
@@ -520,23 +631,47 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
+static bool ServiceRequest(AcceptedConnection *conn,
+                           string& strURI,
+                           string& strRequest,
+                           map<string, string>& mapHeaders,
+                           bool fRun);
+
+/**
+ * A connection from an RPC client. Between requests it is parked on the RPC io_service, which reads
+ * the next request asynchronously and only then queues it for an RPC worker thread, so idle keep-alive
+ * clients do not hold on to a worker. The reply to a request is written into stream().
+ */
 template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+class AcceptedConnectionImpl : public AcceptedConnection,
+                               public boost::enable_shared_from_this< AcceptedConnectionImpl<Protocol> >
 {
 public:
     AcceptedConnectionImpl(
             asio::io_service& io_service,
             ssl::context &context,
-            bool fUseSSL) :
+            bool fUseSSLIn) :
         sslStream(io_service, context),
-        _d(sslStream, fUseSSL),
-        _stream(_d)
+        fUseSSL(fUseSSLIn),
+        readBuf(MAX_HEADERS_SIZE),
+        requestTimer(io_service),
+        nProto(0),
+        nBodyLen(0),
+        fRun(false),
+        fKeepOpen(false),
+        fStarted(false)
+    {
+    }
+
+    ~AcceptedConnectionImpl()
     {
+        if (fStarted)
+            rpc_connection_count--;
     }
 
     virtual std::iostream& stream()
     {
-        return _stream;
+        return replyStream;
     }
 
     virtual std::string peer_address_to_string() const
@@ -546,25 +681,171 @@ public:
 
     virtual void close()
     {
-        _stream.close();
+        boost::system::error_code ec;
+        sslStream.lowest_layer().close(ec);
+    }
+
+    /** Wait for the first request, after the SSL handshake if needed */
+    void Start()
+    {
+        fStarted = true;
+        rpc_connection_count++;
+        if (fUseSSL)
+            sslStream.async_handshake(ssl::stream_base::server,
+                boost::bind(&AcceptedConnectionImpl::HandleHandshake, this->shared_from_this(), asio::placeholders::error));
+        else
+            ReadRequest();
+    }
+
+    /** Send what was written to stream(), then wait for the next request if fKeepOpenIn or close */
+    void SendReply(bool fKeepOpenIn)
+    {
+        fKeepOpen = fKeepOpenIn;
+        strReply = replyStream.str();
+        replyStream.str("");
+        replyStream.clear();
+        if (fUseSSL)
+            asio::async_write(sslStream, asio::buffer(strReply),
+                boost::bind(&AcceptedConnectionImpl::HandleWrite, this->shared_from_this(), asio::placeholders::error));
+        else
+            asio::async_write(sslStream.next_layer(), asio::buffer(strReply),
+                boost::bind(&AcceptedConnectionImpl::HandleWrite, this->shared_from_this(), asio::placeholders::error));
     }
 
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
 private:
-    SSLIOStreamDevice<Protocol> _d;
-    iostreams::stream< SSLIOStreamDevice<Protocol> > _stream;
-};
+    static const size_t MAX_HEADERS_SIZE = 8192;
+
+    bool fUseSSL;
+    asio::streambuf readBuf; // only ever holds the headers, the body is read into strRequest
+    asio::deadline_timer requestTimer; // closes the connection if the next request does not come in time
+    std::stringstream replyStream;
+    std::string strReply;
+
+    // The request being serviced
+    int nProto;
+    string strMethod, strURI, strRequest;
+    map<string, string> mapHeaders;
+    size_t nBodyLen;
+    bool fRun;
+    bool fKeepOpen;
+    bool fStarted;
+
+    void HandleHandshake(const boost::system::error_code& error)
+    {
+        if (error) {
+            close();
+            return;
+        }
+        ReadRequest();
+    }
+
+    void ReadRequest()
+    {
+        requestTimer.expires_from_now(posix_time::seconds(rpc_server_timeout));
+        requestTimer.async_wait(boost::bind(&AcceptedConnectionImpl::HandleTimeout, this->shared_from_this(), asio::placeholders::error));
+        if (fUseSSL)
+            asio::async_read_until(sslStream, readBuf, "\r\n\r\n",
+                boost::bind(&AcceptedConnectionImpl::HandleHeaders, this->shared_from_this(), asio::placeholders::error));
+        else
+            asio::async_read_until(sslStream.next_layer(), readBuf, "\r\n\r\n",
+                boost::bind(&AcceptedConnectionImpl::HandleHeaders, this->shared_from_this(), asio::placeholders::error));
+    }
+
+    void HandleTimeout(const boost::system::error_code& error)
+    {
+        // Cancelled once the request was read
+        if (error == asio::error::operation_aborted)
+            return;
+        LogPrint("rpc", "RPC client %s did not send a request within %d seconds, closing\n", peer_address_to_string(), rpc_server_timeout);
+        close();
+    }
+
+    void HandleHeaders(const boost::system::error_code& error)
+    {
+        // The client went away, or sent more than MAX_HEADERS_SIZE without ending the headers
+        if (error) {
+            close();
+            return;
+        }
+
+        std::istream request(&readBuf);
+        mapHeaders.clear();
+        if (!ReadHTTPRequestLine(request, nProto, strMethod, strURI)) {
+            close();
+            return;
+        }
+        int nLen = ReadHTTPHeaders(request, mapHeaders);
+        if (nLen < 0 || (size_t)nLen > MAX_SIZE) {
+            close();
+            return;
+        }
+        nBodyLen = nLen;
+
+        // Part or all of the body may have come along with the headers, the rest is read straight into strRequest
+        size_t nHave = std::min(readBuf.size(), nBodyLen);
+        asio::streambuf::const_buffers_type data = readBuf.data();
+        strRequest.assign(asio::buffers_begin(data), asio::buffers_begin(data) + nHave);
+        readBuf.consume(nHave);
+        strRequest.resize(nBodyLen);
+
+        if (nHave == nBodyLen)
+            HandleBody(boost::system::error_code());
+        else if (fUseSSL)
+            asio::async_read(sslStream, asio::buffer(&strRequest[nHave], nBodyLen - nHave),
+                boost::bind(&AcceptedConnectionImpl::HandleBody, this->shared_from_this(), asio::placeholders::error));
+        else
+            asio::async_read(sslStream.next_layer(), asio::buffer(&strRequest[nHave], nBodyLen - nHave),
+                boost::bind(&AcceptedConnectionImpl::HandleBody, this->shared_from_this(), asio::placeholders::error));
+    }
+
+    void HandleBody(const boost::system::error_code& error)
+    {
+        if (error) {
+            close();
+            return;
+        }
+        requestTimer.cancel();
+
+        string sConHdr = mapHeaders["connection"];
+        if ((sConHdr != "close") && (sConHdr != "keep-alive"))
+            mapHeaders["connection"] = nProto >= 1 ? "keep-alive" : "close";
 
-void ServiceConnection(AcceptedConnection *conn);
+        // HTTP Keep-Alive is false; close connection after the reply
+        fRun = mapHeaders["connection"] != "close" && GetBoolArg("-rpckeepalive", true);
+
+        if (!rpc_work_queue->Enqueue(boost::bind(&AcceptedConnectionImpl::Service, this->shared_from_this()))) {
+            LogPrint("rpc", "RPC work queue depth exceeded, refusing request from %s\n", peer_address_to_string());
+            replyStream << HTTPReply(HTTP_SERVICE_UNAVAILABLE, "Work queue depth exceeded", false, false, "text/plain") << std::flush;
+            SendReply(false);
+        }
+    }
+
+    /** Run on an RPC worker thread */
+    void Service()
+    {
+        bool fOk = ServiceRequest(this, strURI, strRequest, mapHeaders, fRun);
+        SendReply(fOk && fRun && !ShutdownRequested());
+    }
+
+    void HandleWrite(const boost::system::error_code& error)
+    {
+        if (error || !fKeepOpen) {
+            close();
+            return;
+        }
+        ReadRequest();
+    }
+};
 
 //! Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
                              ssl::context& context,
                              bool fUseSSL,
-                             boost::shared_ptr< AcceptedConnection > conn,
+                             boost::shared_ptr< AcceptedConnectionImpl<Protocol> > conn,
                              const boost::system::error_code& error);
 
 /**
@@ -597,7 +878,7 @@ template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
                              ssl::context& context,
                              const bool fUseSSL,
-                             boost::shared_ptr< AcceptedConnection > conn,
+                             boost::shared_ptr< AcceptedConnectionImpl<Protocol> > conn,
                              const boost::system::error_code& error)
 {
     // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
@@ -617,13 +898,15 @@ static void RPCAcceptHandler(boost::shared_ptr< basic_socket_acceptor<Protocol,
     else if (tcp_conn && !ClientAllowed(tcp_conn->peer.address()))
     {
         // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
-        if (!fUseSSL)
+        if (!fUseSSL) {
             conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
-        conn->close();
+            conn->SendReply(false);
+        } else
+            conn->close();
     }
     else {
-        ServiceConnection(conn.get());
-        conn->close();
+        // Park the connection until its first request is in
+        conn->Start();
     }
 }
 
@@ -789,9 +1072,17 @@ void StartRPCThreads()
         return;
     }
 
+    // One thread runs the io_service, which accepts the connections and reads their requests.
+    // Complete requests are serviced by the worker threads.
+    rpc_worker_count = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
+    rpc_server_timeout = std::max((int)GetArg("-rpcservertimeout", DEFAULT_RPC_SERVER_TIMEOUT), 1);
+    int nWorkQueueDepth = std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORK_QUEUE), 1);
+    LogPrintf("RPC server: %d worker threads, work queue depth %d\n", rpc_worker_count, nWorkQueueDepth);
+    rpc_work_queue = new RPCWorkQueue(nWorkQueueDepth);
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    for (int i = 0; i < rpc_worker_count; i++)
+        rpc_worker_group->create_thread(boost::bind(&RPCWorkQueue::Run, rpc_work_queue));
     fRPCRunning = true;
 }
 
@@ -834,12 +1125,16 @@ void StopRPCThreads()
     }
     deadlineTimers.clear();
 
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
     rpc_io_service->stop();
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
     delete rpc_dummy_work; rpc_dummy_work = NULL;
     delete rpc_worker_group; rpc_worker_group = NULL;
+    delete rpc_work_queue; rpc_work_queue = NULL;
+    rpc_worker_count = 0;
     delete rpc_ssl_context; rpc_ssl_context = NULL;
     delete rpc_io_service; rpc_io_service = NULL;
 }
@@ -1035,41 +1330,23 @@ static bool HTTPReq_JSONRPC(AcceptedConnection *conn,
     return true;
 }
 
-void ServiceConnection(AcceptedConnection *conn)
+/** Service a request read in full from conn, returns false if the connection is to be closed after the reply */
+static bool ServiceRequest(AcceptedConnection *conn,
+                           string& strURI,
+                           string& strRequest,
+                           map<string, string>& mapHeaders,
+                           bool fRun)
 {
-    bool fRun = true;
-    while (fRun && !ShutdownRequested())
-    {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
-
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
-
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
-
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
+    // Process via JSON-RPC API
+    if (strURI == "/")
+        return HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun);
 
-        // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
+    // Process via HTTP REST API
+    if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false))
+        return HTTPReq_REST(conn, strURI, mapHeaders, fRun);
 
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
-    }
+    conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+    return false;
 }
 
 json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_spirit::Array &params) const
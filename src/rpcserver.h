@@ -22,6 +22,13 @@
 class CBlockIndex;
 class CNetAddr;
 
+static const int DEFAULT_RPC_THREADS = 4;
+//! The most complete requests that wait for an RPC worker thread before new ones are refused
+static const int DEFAULT_RPC_WORK_QUEUE = 16;
+//! Seconds a client gets to send a complete request, also how long an idle keep-alive connection is kept open
+static const int DEFAULT_RPC_SERVER_TIMEOUT = 30;
+
+/** A client connection, the reply to the request being serviced is written to stream() */
 class AcceptedConnection
 {
 public:
@@ -150,6 +157,7 @@ extern json_spirit::Value addnode(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getaddednodeinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value sendalert(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnettotals(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getnetmsgstats(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHelp); // in rpcdump.cpp
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
@@ -206,6 +214,7 @@ extern json_spirit::Value validateaddress(const json_spirit::Array& params, bool
 extern json_spirit::Value getinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getwalletinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockchaininfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getsyncinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getnetworkinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value setmocktime(const json_spirit::Array& params, bool fHelp);
 
@@ -250,6 +259,7 @@ extern json_spirit::Value service(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value node(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value update(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getstakepointers(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getstakingstatus(const json_spirit::Array& params, bool fHelp);
 
 // in rest.cpp
 extern bool HTTPReq_REST(AcceptedConnection *conn,
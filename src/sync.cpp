@@ -8,9 +8,28 @@
 #include "utilstrencodings.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include <boost/foreach.hpp>
 #include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+// Time each thread spent waiting for cs_main, which the message statistics report by command
+static boost::thread_specific_ptr<int64_t> ptrMainLockWait;
+
+void RecordLockWait(const char* pszName, int64_t nWaitStart)
+{
+    if (strcmp(pszName, "cs_main") != 0)
+        return;
+    if (!ptrMainLockWait.get())
+        ptrMainLockWait.reset(new int64_t(0));
+    *ptrMainLockWait += GetTimeMicros() - nWaitStart;
+}
+
+int64_t GetMainLockWaitTime()
+{
+    return ptrMainLockWait.get() ? *ptrMainLockWait : 0;
+}
 
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
@@ -363,7 +363,7 @@ void CSystemnodePayments::CheckAndRemove()
             LogPrint("snpayments", "CSystemnodePayments::CleanPaymentList - Removing old Systemnode payment - block %d\n", winner.nBlockHeight);
             systemnodeSync.mapSeenSyncSNW.erase((*it).first);
             mapSystemnodePayeeVotes.erase(it++);
-            mapSystemnodeBlocks.erase(winner.nBlockHeight);
+            RemoveBlockPayees(winner.nBlockHeight);
         } else {
             ++it;
         }
@@ -508,11 +508,62 @@ bool CSystemnodePayments::AddWinningSystemnode(CSystemnodePaymentWinner& winnerI
 
     int n = 1;
     if(IsReferenceNode(winnerIn.vinSystemnode)) n = 100;
-    mapSystemnodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, n);
+    {
+        LOCK(cs_mapSystemnodeBlocks);
+        CSystemnodeBlockPayees& blockPayees = mapSystemnodeBlocks[winnerIn.nBlockHeight];
+        blockPayees.AddPayee(winnerIn.payee, n);
+        if(blockPayees.HasPayeeWithVotes(winnerIn.payee, 2))
+            mapPayeeHeights[winnerIn.payee].insert(winnerIn.nBlockHeight);
+    }
 
     return true;
 }
 
+void CSystemnodePayments::IndexPayeeHeights()
+{
+    LOCK(cs_mapSystemnodeBlocks);
+
+    mapPayeeHeights.clear();
+    BOOST_FOREACH(PAIRTYPE(const int, CSystemnodeBlockPayees)& blockPayees, mapSystemnodeBlocks) {
+        BOOST_FOREACH(CSystemnodePayee& payee, blockPayees.second.vecPayments) {
+            if(payee.nVotes >= 2)
+                mapPayeeHeights[payee.scriptPubKey].insert(blockPayees.first);
+        }
+    }
+}
+
+void CSystemnodePayments::RemoveBlockPayees(int nBlockHeight)
+{
+    AssertLockHeld(cs_mapSystemnodeBlocks);
+
+    std::map<int, CSystemnodeBlockPayees>::iterator it = mapSystemnodeBlocks.find(nBlockHeight);
+    if(it == mapSystemnodeBlocks.end()) return;
+
+    BOOST_FOREACH(CSystemnodePayee& payee, it->second.vecPayments) {
+        std::map<CScript, std::set<int> >::iterator itHeights = mapPayeeHeights.find(payee.scriptPubKey);
+        if(itHeights == mapPayeeHeights.end()) continue;
+        itHeights->second.erase(nBlockHeight);
+        if(itHeights->second.empty())
+            mapPayeeHeights.erase(itHeights);
+    }
+    mapSystemnodeBlocks.erase(it);
+}
+
+int CSystemnodePayments::GetLastPaidHeight(const CScript& payee, int nMaxHeight, int nMinHeight)
+{
+    LOCK(cs_mapSystemnodeBlocks);
+
+    std::map<CScript, std::set<int> >::const_iterator it = mapPayeeHeights.find(payee);
+    if(it == mapPayeeHeights.end()) return 0;
+
+    // the first height above nMaxHeight, the one before it is the last payment up to nMaxHeight
+    std::set<int>::const_iterator itHeight = it->second.upper_bound(nMaxHeight);
+    if(itHeight == it->second.begin()) return 0;
+    --itHeight;
+
+    return *itHeight >= nMinHeight ? *itHeight : 0;
+}
+
 void CSystemnodePaymentWinner::Relay()
 {
     CInv inv(MSG_SYSTEMNODE_WINNER, GetHash());
@@ -10,6 +10,8 @@
 #include "systemnode.h"
 #include <boost/lexical_cast.hpp>
 
+#include <set>
+
 using namespace std;
 
 extern CCriticalSection cs_vecSNPayments;
@@ -196,6 +198,11 @@ private:
     int nSyncedFromPeer;
     int nLastBlockHeight;
 
+    // heights at which each payee has at least 2 votes, the payments GetLastPaid counts
+    std::map<CScript, std::set<int> > mapPayeeHeights;
+    void IndexPayeeHeights();
+    void RemoveBlockPayees(int nBlockHeight);
+
 public:
     std::map<uint256, CSystemnodePaymentWinner> mapSystemnodePayeeVotes;
     std::map<int, CSystemnodeBlockPayees> mapSystemnodeBlocks;
@@ -211,6 +218,7 @@ public:
         LOCK2(cs_mapSystemnodeBlocks, cs_mapSystemnodePayeeVotes);
         mapSystemnodeBlocks.clear();
         mapSystemnodePayeeVotes.clear();
+        mapPayeeHeights.clear();
     }
 
     bool ProcessBlock(int nBlockHeight);
@@ -220,6 +228,8 @@ public:
     void CheckAndRemove();
     bool IsTransactionValid(const CAmount& nValueCreated, const CTransaction& txNew, int nBlockHeight);
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
+    /** The last height from nMinHeight to nMaxHeight at which payee has at least 2 votes, 0 if none */
+    int GetLastPaidHeight(const CScript& payee, int nMaxHeight, int nMinHeight);
     bool IsScheduled(CSystemnode& sn, int nNotBlockHeight);
     bool CanVote(COutPoint outSystemnode, int nBlockHeight);
     std::string GetRequiredPaymentsString(int nBlockHeight);
@@ -232,6 +242,8 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         READWRITE(mapSystemnodePayeeVotes);
         READWRITE(mapSystemnodeBlocks);
+        if (ser_action.ForRead())
+            IndexPayeeHeights();
     }
 };
 
@@ -7,6 +7,7 @@
 #include "systemnode-sync.h"
 #include "activesystemnode.h"
 #include "legacysigner.h"
+#include "collateraltracker.h"
 #include "util.h"
 #include "sync.h"
 #include "addrman.h"
@@ -229,7 +230,7 @@ arith_uint256 CSystemnode::CalculateScore(int64_t nBlockHeight) const
         return arith_uint256();
 
     // Find the block hash where tx got SYSTEMNODE_MIN_CONFIRMATIONS
-    CBlockIndex *pblockIndex = chainActive[GetInputHeight(vin) + SYSTEMNODE_MIN_CONFIRMATIONS - 1];
+    CBlockIndex *pblockIndex = chainActive[collateralTracker.GetHeight(vin) + SYSTEMNODE_MIN_CONFIRMATIONS - 1];
     if (!pblockIndex)
         return arith_uint256();
     uint256 collateralMinConfBlockHash = pblockIndex->GetBlockHash();
@@ -291,20 +292,12 @@ void CSystemnode::Check(bool forceCheck)
     }
 
     if(!unitTest){
-        CValidationState state;
-        CMutableTransaction tx = CMutableTransaction();
-        CTxOut vout = CTxOut((SYSTEMNODE_COLLATERAL - 0.01)*COIN, legacySigner.collateralPubKey);
-        tx.vin.push_back(vin);
-        tx.vout.push_back(vout);
+        bool fSpent = false;
+        if(!collateralTracker.IsSpent(vin, SYSTEMNODE_COLLATERAL, fSpent)) return;
 
-        {
-            TRY_LOCK(cs_main, lockMain);
-            if(!lockMain) return;
-
-            if(!AcceptableInputs(mempool, state, CTransaction(tx), false, NULL)){
-                activeState = SYSTEMNODE_VIN_SPENT;
-                return;
-            }
+        if(fSpent){
+            activeState = SYSTEMNODE_VIN_SPENT;
+            return;
         }
     }
     activeState = SYSTEMNODE_ENABLED; // OK
@@ -344,66 +337,16 @@ int64_t CSystemnode::GetLastPaid() const
     // use a deterministic offset to break a tie -- 2.5 minutes
     int64_t nOffset = UintToArith256(hash).GetCompact(false) % 150; 
 
-    if (chainActive.Tip() == NULL) return false;
-
-    const CBlockIndex *BlockReading = chainActive.Tip();
-
     int nMnCount = snodeman.CountEnabled()*1.25;
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nMnCount){
-            return 0;
-        }
-        n++;
-
-        if(systemnodePayments.mapSystemnodeBlocks.count(BlockReading->nHeight)){
-            /*
-                Search for this payee, with at least 2 votes. This will aid in consensus allowing the network 
-                to converge on the same payees quickly, then keep the same schedule.
-            */
-            if(systemnodePayments.mapSystemnodeBlocks[BlockReading->nHeight].HasPayeeWithVotes(snpayee, 2)){
-                return BlockReading->nTime + nOffset;
-            }
-        }
 
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
-    }
-
-    return 0;
-}
-
-// Find all blocks where SN received reward within defined block depth
-// Used for generating stakepointers
-bool CSystemnode::GetRecentPaymentBlocks(std::vector<const CBlockIndex*>& vPaymentBlocks, bool limitMostRecent) const
-{
-    vPaymentBlocks.clear();
-
-    int nMinimumValidBlockHeight = chainActive.Height() - Params().ValidStakePointerDuration();
-    if (nMinimumValidBlockHeight < 1)
-        nMinimumValidBlockHeight = 1;
-
-    CBlockIndex* pindex = chainActive[nMinimumValidBlockHeight];
-
-    CScript snpayee;
-    snpayee = GetScriptForDestination(pubkey.GetID());
-
-    bool fBlockFound = false;
-    while (chainActive.Next(pindex)) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
-            continue;
-
-        if (block.vtx[0].vout.size() > 2 && block.vtx[0].vout[2].scriptPubKey == snpayee) {
-            vPaymentBlocks.emplace_back(pindex);
-            fBlockFound = true;
-            if (limitMostRecent)
-                return fBlockFound;
-        }
-        pindex = chainActive.Next(pindex);
-    }
+    /*
+        Search the last nMnCount blocks for this payee, with at least 2 votes. This will aid in consensus allowing
+        the network to converge on the same payees quickly, then keep the same schedule.
+    */
+    int nHeight = systemnodePayments.GetLastPaidHeight(snpayee, pindexPrev->nHeight, std::max(pindexPrev->nHeight - nMnCount + 1, 1));
+    if(nHeight == 0) return 0;
 
-    return fBlockFound;
+    return chainActive[nHeight]->nTime + nOffset;
 }
 
 //
@@ -533,6 +476,7 @@ bool CSystemnodeBroadcast::CheckAndUpdate(int& nDos) const
         //take the newest entry
         LogPrintf("snb - Got updated entry for %s\n", addr.ToString());
         if(psn->UpdateFromNewBroadcast((*this))){
+            snodeman.InvalidateIndex();
             psn->Check();
             if(psn->IsEnabled()) Relay();
         }
@@ -237,8 +237,6 @@ public:
         return strStatus;
     }
     int64_t GetLastPaid() const;
-
-    bool GetRecentPaymentBlocks(std::vector<const CBlockIndex*>& vPaymentBlocks, bool limitMostRecent = false) const;
 };
 
 //
@@ -6,6 +6,7 @@
 #include "systemnode-sync.h"
 #include "masternodeman.h"
 #include "legacysigner.h"
+#include "collateraltracker.h"
 #include "util.h"
 #include "addrman.h"
 #include "spork.h"
@@ -263,40 +264,28 @@ bool CSystemnodeMan::CheckSnbAndUpdateSystemnodeList(CSystemnodeBroadcast snb, i
     return true;
 }
 
-CSystemnode *CSystemnodeMan::Find(const CTxIn &vin)
+CSystemnode *CSystemnodeMan::Find(const CScript &payee)
 {
     LOCK(cs);
+    return index.Find(vSystemnodes, payee);
+}
 
-    BOOST_FOREACH(CSystemnode& sn, vSystemnodes)
-    {
-        if(sn.vin.prevout == vin.prevout)
-            return &sn;
-    }
-    return NULL;
+CSystemnode *CSystemnodeMan::Find(const CTxIn &vin)
+{
+    LOCK(cs);
+    return index.Find(vSystemnodes, vin.prevout);
 }
 
 CSystemnode *CSystemnodeMan::Find(const CPubKey &pubKeySystemnode)
 {
     LOCK(cs);
-
-    BOOST_FOREACH(CSystemnode& mn, vSystemnodes)
-    {
-        if(mn.pubkey2 == pubKeySystemnode)
-            return &mn;
-    }
-    return NULL;
+    return index.Find(vSystemnodes, pubKeySystemnode);
 }
 
 CSystemnode *CSystemnodeMan::Find(const CService& addr)
 {
     LOCK(cs);
-
-    BOOST_FOREACH(CSystemnode& sn, vSystemnodes)
-    {
-        if(sn.addr == addr)
-            return &sn;
-    }
-    return NULL;
+    return index.Find(vSystemnodes, addr);
 }
 
 // 
@@ -377,6 +366,7 @@ bool CSystemnodeMan::Add(CSystemnode &sn)
     {
         LogPrint("systemnode", "CSystemnodeMan: Adding new Systemnode %s - %i now\n", sn.addr.ToString(), size() + 1);
         vSystemnodes.push_back(sn);
+        index.SetDirty();
         return true;
     }
 
@@ -395,8 +385,8 @@ void CSystemnodeMan::UpdateSystemnodeList(CSystemnodeBroadcast snb) {
     {
         CSystemnode sn(snb);
         Add(sn);
-    } else {
-        psn->UpdateFromNewBroadcast(snb);
+    } else if(psn->UpdateFromNewBroadcast(snb)) {
+        InvalidateIndex();
     }
 }
 
@@ -408,7 +398,9 @@ void CSystemnodeMan::Remove(CTxIn vin)
     while(it != vSystemnodes.end()){
         if((*it).vin == vin){
             LogPrint("systemnode", "CSystemnodeMan: Removing Systemnode %s - %i now\n", (*it).addr.ToString(), size() - 1);
+            collateralTracker.Forget((*it).vin.prevout);
             vSystemnodes.erase(it);
+            index.SetDirty();
             break;
         }
         ++it;
@@ -463,10 +455,19 @@ std::string CSystemnodeMan::ToString() const
     return info.str();
 }
 
+void CSystemnodeMan::InvalidateIndex()
+{
+    LOCK(cs);
+    index.SetDirty();
+}
+
 void CSystemnodeMan::Clear()
 {
     LOCK(cs);
+    BOOST_FOREACH(const CSystemnode& sn, vSystemnodes)
+        collateralTracker.Forget(sn.vin.prevout);
     vSystemnodes.clear();
+    index.SetDirty();
     mAskedUsForSystemnodeList.clear();
     mWeAskedForSystemnodeList.clear();
     mWeAskedForSystemnodeListEntry.clear();
@@ -577,7 +578,9 @@ void CSystemnodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            collateralTracker.Forget((*it).vin.prevout);
             it = vSystemnodes.erase(it);
+            index.SetDirty();
         } else {
             ++it;
         }
@@ -12,6 +12,7 @@
 #include "base58.h"
 #include "main.h"
 #include "systemnode.h"
+#include "masternode-index.h"
 
 #define SYSTEMNODES_DUMP_SECONDS               (15*60)
 #define SYSTEMNODES_DSEG_SECONDS               (3*60*60)
@@ -33,6 +34,8 @@ private:
 
     // map to hold all SNs
     std::vector<CSystemnode> vSystemnodes;
+    // hashed lookups into vSystemnodes
+    CMasternodeIndex<CSystemnode> index;
     // who's asked for the Systemnode list and the last time
     std::map<CNetAddr, int64_t> mAskedUsForSystemnodeList;
     // who we asked for the Systemnode list and the last time
@@ -52,6 +55,8 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
         LOCK(cs);
         READWRITE(vSystemnodes);
+        if (ser_action.ForRead())
+            index.SetDirty();
         READWRITE(mAskedUsForSystemnodeList);
         READWRITE(mWeAskedForSystemnodeList);
         READWRITE(mWeAskedForSystemnodeListEntry);
@@ -83,6 +88,7 @@ public:
     void DsegUpdate(CNode* pnode);
 
     /// Find an entry
+    CSystemnode* Find(const CScript &payee);
     CSystemnode* Find(const CTxIn& vin);
     CSystemnode* Find(const CPubKey& pubKeySystemnode);
     CSystemnode* Find(const CService& addr);
@@ -109,6 +115,9 @@ public:
 
     void Remove(CTxIn vin);
 
+    /// Must be called whenever the address or pubkey of a listed Systemnode changes
+    void InvalidateIndex();
+
     /// Update systemnode list and maps using provided CSystemnodeBroadcast
     void UpdateSystemnodeList(CSystemnodeBroadcast snb);
 
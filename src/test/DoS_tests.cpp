@@ -8,6 +8,9 @@
 
 
 
+#include "blockencodings.h"
+#include "chainparams.h"
+#include "crypto/common.h"
 #include "keystore.h"
 #include "main.h"
 #include "net.h"
@@ -115,6 +118,165 @@ CTransaction RandomOrphan()
     return it->second.tx;
 }
 
+// Hands a message to pnode's message handler the way it comes in from the network
+void ProcessNetworkMessage(CNode& node, const std::string& strCommand, const CDataStream& ssPayload)
+{
+    CMessageHeader hdr(Params().MessageStart(), strCommand.c_str(), ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    hdr.nChecksum = ReadLE32(hash.begin());
+    CDataStream ssMessage(SER_NETWORK, PROTOCOL_VERSION);
+    ssMessage << hdr;
+    ssMessage.write(&ssPayload[0], ssPayload.size());
+    LOCK(node.cs_vRecvMsg);
+    BOOST_REQUIRE(node.ReceiveMsgBytes(&ssMessage[0], ssMessage.size()));
+    ProcessMessages(&node);
+}
+
+int GetMisbehavior(const CNode& node)
+{
+    CNodeStateStats stats;
+    BOOST_REQUIRE(GetNodeStateStats(node.GetId(), stats));
+    return stats.nMisbehavior;
+}
+
+CBlockIndex* GetGenesisIndex()
+{
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(Params().GenesisBlock().GetHash());
+    BOOST_REQUIRE(mi != mapBlockIndex.end());
+    // Other tests leave their own chains behind
+    chainActive.SetTip(mi->second);
+    return mi->second;
+}
+
+// A block with only a coinbase on top of pindexPrev that doesn't meet its proof of work
+CBlock MakeBlockWithoutWork(const CBlockIndex* pindexPrev)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 1;
+
+    CBlock block;
+    block.nVersion.SetBaseVersion(CBlockHeader::CURRENT_VERSION, Params().AuxpowChainId());
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = pindexPrev->GetBlockTime() + 10 * 60;
+    block.nBits = pindexPrev->nBits;
+    block.vtx.push_back(coinbase);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    while (CheckProofOfWork(block.GetHash(), block.nBits))
+        block.nNonce++;
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(DoS_cmpctblock)
+{
+    CBlockIndex* pindexGenesis = GetGenesisIndex();
+    CBlock block = MakeBlockWithoutWork(pindexGenesis);
+    CDataStream ssCmpctBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssCmpctBlock << CBlockHeaderAndShortTxIDs(block);
+
+    CNode dummyNode(INVALID_SOCKET, CAddress(ip(0xa0b0c003)), "", true);
+    dummyNode.nVersion = PROTOCOL_VERSION;
+
+    // Compact blocks we didn't ask for from a peer that never negotiated them are ignored
+    ProcessNetworkMessage(dummyNode, "cmpctblock", ssCmpctBlock);
+    BOOST_CHECK_EQUAL(GetMisbehavior(dummyNode), 0);
+    BOOST_CHECK(!mapBlockIndex.count(block.GetHash()));
+    BOOST_CHECK(dummyNode.vSendMsg.empty());
+
+    // Nor from one that negotiated them, unless we picked it to announce new blocks that way
+    CDataStream ssSendCmpct(SER_NETWORK, PROTOCOL_VERSION);
+    ssSendCmpct << false << (uint64_t)1;
+    ProcessNetworkMessage(dummyNode, "sendcmpct", ssSendCmpct);
+    BOOST_CHECK(dummyNode.fSupportsCompactBlocks);
+    ProcessNetworkMessage(dummyNode, "cmpctblock", ssCmpctBlock);
+    BOOST_CHECK_EQUAL(GetMisbehavior(dummyNode), 0);
+    BOOST_CHECK(!mapBlockIndex.count(block.GetHash()));
+    BOOST_CHECK(dummyNode.vSendMsg.empty());
+
+    // Once we asked the peer for it, the header's proof of work is checked before anything else. Without a socket
+    // the first message queued for the peer fails to go out and disconnects it, the later ones stay queued behind it.
+    SendMessages(&dummyNode, false);
+    dummyNode.fDisconnect = false;
+    dummyNode.AskForBlock(CInv(MSG_BLOCK, block.GetHash()));
+    SendMessages(&dummyNode, false);
+    BOOST_CHECK(!dummyNode.fDisconnect);
+    size_t nSendMsg = dummyNode.vSendMsg.size();
+    ProcessNetworkMessage(dummyNode, "cmpctblock", ssCmpctBlock);
+    BOOST_CHECK_EQUAL(GetMisbehavior(dummyNode), 50);
+    BOOST_CHECK(!mapBlockIndex.count(block.GetHash()));
+    BOOST_CHECK_EQUAL(dummyNode.vSendMsg.size(), nSendMsg);
+}
+
+// A headers message the way getheaders is answered
+CDataStream HeadersMessage(const CBlockHeader& header)
+{
+    CDataStream ssHeaders(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeaders << std::vector<CBlock>(1, CBlock(header));
+    return ssHeaders;
+}
+
+BOOST_AUTO_TEST_CASE(DoS_headers)
+{
+    CBlockIndex* pindexGenesis = GetGenesisIndex();
+    bool fHeadersFirstBefore = fHeadersFirst;
+    CBlockHeader header = MakeBlockWithoutWork(pindexGenesis).GetBlockHeader();
+
+    // Headers are ignored outside of headers-first mode
+    fHeadersFirst = false;
+    CNode dummyNode1(INVALID_SOCKET, CAddress(ip(0xa0b0c004)), "", true);
+    dummyNode1.nVersion = PROTOCOL_VERSION;
+    ProcessNetworkMessage(dummyNode1, "headers", HeadersMessage(header));
+    BOOST_CHECK_EQUAL(GetMisbehavior(dummyNode1), 0);
+    BOOST_CHECK(!mapBlockIndex.count(header.GetHash()));
+
+    // A PoW header has to meet its proof of work before it goes into the block index
+    fHeadersFirst = true;
+    ProcessNetworkMessage(dummyNode1, "headers", HeadersMessage(header));
+    BOOST_CHECK_EQUAL(GetMisbehavior(dummyNode1), 50);
+    BOOST_CHECK(!mapBlockIndex.count(header.GetHash()));
+
+    // So does one claiming to be MN-PoS below the PoS start height
+    header.nVersion.SetProofOfStake(true);
+    CNode dummyNode2(INVALID_SOCKET, CAddress(ip(0xa0b0c005)), "", true);
+    dummyNode2.nVersion = PROTOCOL_VERSION;
+    ProcessNetworkMessage(dummyNode2, "headers", HeadersMessage(header));
+    BOOST_CHECK_EQUAL(GetMisbehavior(dummyNode2), 50);
+    BOOST_CHECK(!mapBlockIndex.count(header.GetHash()));
+
+    // A header that meets it is accepted, at minimum difficulty so it can be mined here
+    arith_uint256 bnProofOfWorkLimit = Params().ProofOfWorkLimit();
+    ModifiableParams()->setProofOfWorkLimit(~arith_uint256(0) >> 1);
+    ModifiableParams()->setAllowMinDifficultyBlocks(true);
+    header.nVersion.SetProofOfStake(false);
+    header.nBits = GetNextWorkRequired(pindexGenesis, &header);
+    while (!CheckProofOfWork(header.GetHash(), header.nBits))
+        header.nNonce++;
+    CBlockIndex* pindexBestHeaderBefore = pindexBestHeader;
+    CNode dummyNode3(INVALID_SOCKET, CAddress(ip(0xa0b0c006)), "", true);
+    dummyNode3.nVersion = PROTOCOL_VERSION;
+    ProcessNetworkMessage(dummyNode3, "headers", HeadersMessage(header));
+    BOOST_CHECK_EQUAL(GetMisbehavior(dummyNode3), 0);
+    BOOST_REQUIRE(mapBlockIndex.count(header.GetHash()));
+
+    // Write the new entry out of the dirty set before it is taken out of the block index again
+    FlushStateToDisk();
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(header.GetHash());
+        CBlockIndex* pindex = mi->second;
+        mapBlockIndex.erase(mi);
+        delete pindex;
+    }
+    pindexBestHeader = pindexBestHeaderBefore;
+    ModifiableParams()->setAllowMinDifficultyBlocks(false);
+    ModifiableParams()->setProofOfWorkLimit(bnProofOfWorkLimit);
+    fHeadersFirst = fHeadersFirstBefore;
+}
+
 /*
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans, * boost::unit_test::disabled())
 {
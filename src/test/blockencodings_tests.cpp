@@ -0,0 +1,193 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockencodings.h"
+
+#include "random.h"
+#include "streams.h"
+#include "txmempool.h"
+#include "version.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+CTransaction MakeTx(int n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), n);
+    tx.vin[0].scriptSig << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey << OP_TRUE;
+    tx.vout[0].nValue = 1000 + n;
+    return tx;
+}
+
+/** A block with a coinbase and nTxs other transactions, with a coinstake and block signature if fProofOfStake */
+CBlock BuildBlock(int nTxs, bool fProofOfStake)
+{
+    CBlock block;
+    block.nVersion.SetGenesisVersion(1);
+    block.nVersion.SetProofOfStake(fProofOfStake);
+    block.nTime = 1600000000;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << 42 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42;
+    block.vtx.push_back(coinbase);
+
+    if (fProofOfStake) {
+        CMutableTransaction coinstake;
+        coinstake.vin.resize(1);
+        coinstake.vin[0].scriptSig = CScript() << OP_PROOFOFSTAKE << OP_1;
+        coinstake.vout.resize(1);
+        coinstake.vout[0].nValue = 10;
+        block.vtx.push_back(coinstake);
+        block.vchBlockSig = std::vector<unsigned char>(71, 0x42);
+        block.stakePointer.hashBlock = GetRandHash();
+        block.stakePointer.txid = GetRandHash();
+        block.stakePointer.nPos = 3;
+    }
+
+    for (int i = 0; i < nTxs; i++)
+        block.vtx.push_back(MakeTx(i));
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Send the compact block over the wire and put it together again against pool, returns the missing tx indexes */
+std::vector<uint16_t> Receive(const CBlock& block, CTxMemPool& pool, PartiallyDownloadedBlock& partialBlock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CBlockHeaderAndShortTxIDs(block);
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    stream >> cmpctblock;
+    BOOST_CHECK(stream.empty());
+    BOOST_CHECK_EQUAL(cmpctblock.header.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+
+    BOOST_REQUIRE(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+    std::vector<uint16_t> vMissing;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        if (!partialBlock.IsTxAvailable(i))
+            vMissing.push_back(i);
+    }
+    return vMissing;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(blockencodings_tests)
+
+BOOST_AUTO_TEST_CASE(blockencodings_mempool_reconstruction)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlock(10, false);
+    // Everything but the coinbase and transactions 3 and 7 is in the mempool
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        if (i != 3 && i != 7)
+            pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0.0, 1));
+    }
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    std::vector<uint16_t> vMissing = Receive(block, pool, partialBlock);
+    BOOST_REQUIRE_EQUAL(vMissing.size(), 2U);
+    BOOST_CHECK_EQUAL(vMissing[0], 3);
+    BOOST_CHECK_EQUAL(vMissing[1], 7);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 8U);
+
+    // The getblocktxn request and its answer survive the differential encoding
+    BlockTransactionsRequest req;
+    req.blockhash = block.GetHash();
+    req.indexes = vMissing;
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req;
+    BlockTransactionsRequest req2;
+    stream >> req2;
+    BOOST_CHECK(req2.blockhash == req.blockhash);
+    BOOST_CHECK(req2.indexes == req.indexes);
+
+    BlockTransactions resp(req2);
+    for (size_t i = 0; i < req2.indexes.size(); i++)
+        resp.txn[i] = block.vtx[req2.indexes[i]];
+    stream << resp;
+    BlockTransactions resp2;
+    stream >> resp2;
+
+    // Too few transactions is the peer's fault
+    PartiallyDownloadedBlock partialShort(&pool);
+    Receive(block, pool, partialShort);
+    CBlock blockShort;
+    BOOST_CHECK(partialShort.FillBlock(blockShort, std::vector<CTransaction>(1, resp2.txn[0])) == READ_STATUS_INVALID);
+
+    CBlock block2;
+    BOOST_REQUIRE(partialBlock.FillBlock(block2, resp2.txn) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block2.GetHash().ToString(), block.GetHash().ToString());
+    BOOST_CHECK_EQUAL(block2.BuildMerkleTree().ToString(), block.hashMerkleRoot.ToString());
+
+    // The wrong transaction, as a short id collision would give, fails the merkle root check
+    PartiallyDownloadedBlock partialWrong(&pool);
+    Receive(block, pool, partialWrong);
+    std::vector<CTransaction> vWrong = resp2.txn;
+    vWrong[1] = MakeTx(100);
+    CBlock block3;
+    BOOST_CHECK(partialWrong.FillBlock(block3, vWrong) == READ_STATUS_FAILED);
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_proof_of_stake)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlock(4, true);
+    BOOST_REQUIRE(block.IsProofOfStake());
+    for (size_t i = 2; i < block.vtx.size(); i++)
+        pool.addUnchecked(block.vtx[i].GetHash(), CTxMemPoolEntry(block.vtx[i], 0, 0, 0.0, 1));
+
+    // The coinbase and coinstake come along with the compact block, the rest is in the mempool
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(Receive(block, pool, partialBlock).empty());
+
+    CBlock block2;
+    BOOST_REQUIRE(partialBlock.FillBlock(block2, std::vector<CTransaction>()) == READ_STATUS_OK);
+    BOOST_CHECK(block2.IsProofOfStake());
+    BOOST_CHECK(block2.vchBlockSig == block.vchBlockSig);
+    BOOST_CHECK(block2.stakePointer.hashBlock == block.stakePointer.hashBlock);
+    BOOST_CHECK(block2.stakePointer.txid == block.stakePointer.txid);
+    BOOST_CHECK_EQUAL(block2.stakePointer.nPos, block.stakePointer.nPos);
+
+    // Byte for byte the block that was sent
+    CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+    ss1 << block;
+    ss2 << block2;
+    BOOST_CHECK(ss1.str() == ss2.str());
+}
+
+BOOST_AUTO_TEST_CASE(blockencodings_invalid)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // A header without any transactions
+    CBlockHeaderAndShortTxIDs cmpctEmpty;
+    cmpctEmpty.header.nBits = 0x207fffff;
+    PartiallyDownloadedBlock partialEmpty(&pool);
+    BOOST_CHECK(partialEmpty.InitData(cmpctEmpty) == READ_STATUS_INVALID);
+
+    // A prefilled transaction past the end of the block
+    CBlock block = BuildBlock(2, false);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block.GetBlockHeader() << GetRand(std::numeric_limits<uint64_t>::max());
+    WriteCompactSize(stream, 0); // no short ids
+    WriteCompactSize(stream, 1); // one prefilled transaction
+    WriteCompactSize(stream, 5); // at index 5
+    stream << block.vtx[0] << false;
+    CBlockHeaderAndShortTxIDs cmpctPastEnd;
+    stream >> cmpctPastEnd;
+    PartiallyDownloadedBlock partialPastEnd(&pool);
+    BOOST_CHECK(partialPastEnd.InitData(cmpctPastEnd) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,7 +4,10 @@
 
 #include "coins.h"
 #include "random.h"
+#include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
+#include "utiltime.h"
 
 #include <vector>
 #include <map>
@@ -76,6 +79,72 @@ public:
 
 };
 
+// Gives access to the database, so records can be written in the old per-txid format
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+    void WriteLegacyCoins(const uint256& txid, const CCoins& coins)
+    {
+        db.Write(std::make_pair('c', txid), coins);
+    }
+
+    bool HaveLegacyCoins(const uint256& txid)
+    {
+        return db.Exists(std::make_pair('c', txid));
+    }
+
+    void WriteVersion(int nVersion)
+    {
+        db.Write('V', nVersion);
+    }
+
+    bool ReadVersion(int& nVersion)
+    {
+        return db.Read('V', nVersion);
+    }
+
+    void EraseVersion()
+    {
+        db.Erase('V');
+    }
+
+    // What BatchWrite() did before per-output records: rewrite the whole CCoins of every changed transaction
+    size_t BatchWriteLegacy(CCoinsMap& mapCoins)
+    {
+        size_t nBytes = 0;
+        CLevelDBBatch batch;
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            if (it->second.coins.IsPruned())
+                batch.Erase(std::make_pair('c', it->first));
+            else
+                batch.Write(std::make_pair('c', it->first), it->second.coins);
+            nBytes += ::GetSerializeSize(it->second.coins, SER_DISK, CLIENT_VERSION);
+        }
+        db.WriteBatch(batch);
+        mapCoins.clear();
+        return nBytes;
+    }
+};
+
+CCoins RandomWideCoins(unsigned int nOutputs)
+{
+    CCoins coins;
+    coins.nVersion = 1;
+    coins.nHeight = insecure_rand() % 100000;
+    coins.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        coins.vout[i].nValue = (insecure_rand() % 1000000) + 1;
+        uint160 hash;
+        GetRandBytes(hash.begin(), hash.size());
+        coins.vout[i].scriptPubKey = GetScriptForDestination(CKeyID(hash));
+    }
+    return coins;
+}
+
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -196,4 +265,219 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(missed_an_entry);
 }
 
+BOOST_AUTO_TEST_CASE(coins_db_per_output_records)
+{
+    CCoinsViewDBTest db;
+    uint256 txid = GetRandHash();
+    CCoins coins = RandomWideCoins(300);
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+    CCoins stored;
+    BOOST_CHECK(db.HaveCoins(txid));
+    BOOST_CHECK(db.GetCoins(txid, stored));
+    BOOST_CHECK(stored == coins);
+
+    // Spend outputs in the middle and at the end
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            BOOST_CHECK(modifier->Spend(7));
+            BOOST_CHECK(modifier->Spend(299));
+            BOOST_CHECK(modifier->Spend(298));
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(coins.Spend(7) && coins.Spend(299) && coins.Spend(298));
+    BOOST_CHECK(db.GetCoins(txid, stored));
+    BOOST_CHECK(stored == coins);
+    BOOST_CHECK_EQUAL(stored.vout.size(), 298);
+
+    // The same transaction confirmed at another height after a reorg
+    coins.nHeight++;
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetCoins(txid, stored));
+    BOOST_CHECK(stored == coins);
+
+    // Spending everything removes the transaction
+    {
+        CCoinsViewCache cache(&db);
+        {
+            CCoinsModifier modifier = cache.ModifyCoins(txid);
+            while (!modifier->vout.empty())
+                modifier->Spend(modifier->vout.size() - 1);
+            BOOST_CHECK(modifier->IsPruned());
+        }
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(!db.HaveCoins(txid));
+    BOOST_CHECK(!db.GetCoins(txid, stored));
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_upgrade)
+{
+    CCoinsViewDBTest db;
+    std::map<uint256, CCoins> mapLegacy;
+    for (int i = 0; i < 50; i++) {
+        CCoins coins = RandomWideCoins(1 + insecure_rand() % 20);
+        coins.fBlockReward = i % 5 == 0;
+        for (unsigned int n = 0; n + 1 < coins.vout.size(); n++) {
+            if (insecure_rand() % 3 == 0)
+                coins.Spend(n);
+        }
+        uint256 txid = GetRandHash();
+        db.WriteLegacyCoins(txid, coins);
+        mapLegacy[txid] = coins;
+    }
+
+    BOOST_CHECK(db.Upgrade());
+    for (std::map<uint256, CCoins>::const_iterator it = mapLegacy.begin(); it != mapLegacy.end(); ++it) {
+        CCoins stored;
+        BOOST_CHECK(!db.HaveLegacyCoins(it->first));
+        BOOST_CHECK(db.GetCoins(it->first, stored));
+        BOOST_CHECK(stored == it->second);
+    }
+    int nVersion = 0;
+    BOOST_CHECK(db.ReadVersion(nVersion));
+    BOOST_CHECK_EQUAL(nVersion, 1);
+    // Nothing left to do the second time
+    BOOST_CHECK(db.Upgrade());
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_version)
+{
+    // A new database gets the current version
+    CCoinsViewDBTest db;
+    BOOST_CHECK(db.Upgrade());
+    int nVersion = 0;
+    BOOST_CHECK(db.ReadVersion(nVersion));
+    BOOST_CHECK_EQUAL(nVersion, 1);
+
+    uint256 txid = GetRandHash();
+    CCoins coins = RandomWideCoins(3);
+    {
+        CCoinsViewCache cache(&db);
+        *cache.ModifyCoins(txid) = coins;
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.Upgrade());
+
+    // Another version, or records without a version, are refused
+    db.WriteVersion(2);
+    BOOST_CHECK(!db.Upgrade());
+    db.EraseVersion();
+    BOOST_CHECK(!db.Upgrade());
+    db.WriteVersion(1);
+    BOOST_CHECK(db.Upgrade());
+
+    CCoins stored;
+    BOOST_CHECK(db.GetCoins(txid, stored));
+    BOOST_CHECK(stored == coins);
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_background_flush)
+{
+    CCoinsViewDBTest db;
+    db.StartBackgroundFlush();
+
+    std::map<uint256, CCoins> mapExpected;
+    for (int f = 0; f < 20; f++) {
+        CCoinsViewCache cache(&db);
+        // Spend from the previous flushes, which may still be in flight
+        for (std::map<uint256, CCoins>::iterator it = mapExpected.begin(); it != mapExpected.end(); ++it) {
+            if (insecure_rand() % 4 != 0 || it->second.IsPruned())
+                continue;
+            CCoinsModifier modifier = cache.ModifyCoins(it->first);
+            BOOST_CHECK(*modifier == it->second);
+            unsigned int n = insecure_rand() % modifier->vout.size();
+            BOOST_CHECK(modifier->Spend(n) == it->second.Spend(n));
+        }
+        for (int i = 0; i < 20; i++) {
+            uint256 txid = GetRandHash();
+            mapExpected[txid] = RandomWideCoins(1 + insecure_rand() % 10);
+            *cache.ModifyCoins(txid) = mapExpected[txid];
+        }
+        uint256 hashBlock = GetRandHash();
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    }
+
+    BOOST_CHECK(db.WaitForFlush());
+    for (std::map<uint256, CCoins>::const_iterator it = mapExpected.begin(); it != mapExpected.end(); ++it) {
+        CCoins stored;
+        BOOST_CHECK_EQUAL(db.GetCoins(it->first, stored), !it->second.IsPruned());
+        if (!it->second.IsPruned())
+            BOOST_CHECK(stored == it->second);
+    }
+}
+
+// Spend one output of every wide transaction per flush, once with per-output records and once
+// rewriting whole per-txid records as before
+BOOST_AUTO_TEST_CASE(coins_db_spend_throughput)
+{
+    const unsigned int nTx = 100;
+    const unsigned int nOutputs = 200;
+    const unsigned int nFlushes = 10;
+
+    CCoinsViewDBTest dbOutputs;
+    CCoinsViewDBTest dbLegacy;
+    std::vector<uint256> vTxid;
+    {
+        CCoinsViewCache cache(&dbOutputs);
+        CCoinsMap mapLegacy;
+        for (unsigned int i = 0; i < nTx; i++) {
+            vTxid.push_back(GetRandHash());
+            CCoins coins = RandomWideCoins(nOutputs);
+            *cache.ModifyCoins(vTxid[i]) = coins;
+            CCoinsCacheEntry& entry = mapLegacy[vTxid[i]];
+            entry.coins = coins;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+        }
+        BOOST_CHECK(cache.Flush());
+        dbLegacy.BatchWriteLegacy(mapLegacy);
+    }
+
+    int64_t nTimeOutputs = 0;
+    int64_t nTimeLegacy = 0;
+    size_t nBytesLegacy = 0;
+    for (unsigned int f = 0; f < nFlushes; f++) {
+        CCoinsViewCache cache(&dbOutputs);
+        CCoinsMap mapLegacy;
+        for (unsigned int i = 0; i < nTx; i++) {
+            CCoinsModifier modifier = cache.ModifyCoins(vTxid[i]);
+            BOOST_CHECK(modifier->Spend(f));
+            CCoinsCacheEntry& entry = mapLegacy[vTxid[i]];
+            entry.coins = *modifier;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+        }
+
+        int64_t nStart = GetTimeMicros();
+        BOOST_CHECK(cache.Flush());
+        nTimeOutputs += GetTimeMicros() - nStart;
+
+        nStart = GetTimeMicros();
+        nBytesLegacy += dbLegacy.BatchWriteLegacy(mapLegacy);
+        nTimeLegacy += GetTimeMicros() - nStart;
+    }
+
+    for (unsigned int i = 0; i < nTx; i++) {
+        CCoins coins;
+        BOOST_CHECK(dbOutputs.GetCoins(vTxid[i], coins));
+        BOOST_CHECK_EQUAL(coins.vout.size(), nOutputs);
+        BOOST_CHECK(coins.vout[0].IsNull() && coins.vout[nFlushes - 1].IsNull() && !coins.vout[nFlushes].IsNull());
+    }
+
+    // The per-output format only erases one record per transaction and flush
+    BOOST_TEST_MESSAGE(strprintf("%u flushes spending one output of %u transactions with %u outputs: %.2fms per-output (%u records erased), %.2fms per-txid (%u kB rewritten)",
+                                 nFlushes, nTx, nOutputs, nTimeOutputs * 0.001, nFlushes * nTx, nTimeLegacy * 0.001, nBytesLegacy / 1000));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
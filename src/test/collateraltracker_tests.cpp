@@ -0,0 +1,142 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "collateraltracker.h"
+
+#include "coins.h"
+#include "legacysigner.h"
+#include "masternode.h"
+#include "masternodeman.h"
+#include "random.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+void SetCoinsHeight(const CTransaction& tx, int nHeight)
+{
+    CCoinsModifier coins = pcoinsTip->ModifyCoins(tx.GetHash());
+    coins->FromTx(tx, nHeight);
+}
+
+/** A transaction paying nValue to OP_TRUE, put into the UTXO set at nHeight */
+CTransaction AddCollateral(CAmount nValue, int nHeight)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    SetCoinsHeight(tx, nHeight);
+    return tx;
+}
+
+CTransaction Spend(const COutPoint& outpoint)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = outpoint;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1;
+    return tx;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(collateraltracker_tests)
+
+BOOST_AUTO_TEST_CASE(collateral_spent_cache)
+{
+    LOCK(cs_main);
+    CCollateralTracker tracker;
+    bool fSpent = false;
+
+    // Missing from the UTXO set is a definite spend and remembered
+    CTxIn vinMissing(COutPoint(GetRandHash(), 0));
+    BOOST_CHECK(tracker.IsSpent(vinMissing, MASTERNODE_COLLATERAL, fSpent));
+    BOOST_CHECK(fSpent);
+    BOOST_CHECK_EQUAL(tracker.size(), 1);
+
+    // A collateral that is refused for another reason, here a too small amount, is not remembered as spent
+    CTransaction txSmall = AddCollateral(COIN, 10);
+    CTxIn vinSmall(COutPoint(txSmall.GetHash(), 0));
+    BOOST_CHECK(tracker.IsSpent(vinSmall, MASTERNODE_COLLATERAL, fSpent));
+    BOOST_CHECK(fSpent);
+    BOOST_CHECK_EQUAL(tracker.size(), 1);
+
+    CTransaction txCollateral = AddCollateral(MASTERNODE_COLLATERAL * COIN, 10);
+    CTxIn vin(COutPoint(txCollateral.GetHash(), 0));
+    BOOST_CHECK(tracker.IsSpent(vin, MASTERNODE_COLLATERAL, fSpent));
+    BOOST_CHECK(!fSpent);
+    BOOST_CHECK_EQUAL(tracker.size(), 2);
+
+    // A block spending it marks it spent without a lookup, the UTXO set here still has it
+    RegisterValidationInterface(&tracker);
+    CBlock block;
+    SyncWithWallets(Spend(vin.prevout), &block);
+    BOOST_CHECK(tracker.IsSpent(vin, MASTERNODE_COLLATERAL, fSpent));
+    BOOST_CHECK(fSpent);
+
+    // The block is disconnected again, so the collateral is looked up again
+    SyncWithWallets(Spend(vin.prevout), NULL);
+    BOOST_CHECK(tracker.IsSpent(vin, MASTERNODE_COLLATERAL, fSpent));
+    BOOST_CHECK(!fSpent);
+    UnregisterValidationInterface(&tracker);
+
+    tracker.Forget(vin.prevout);
+    BOOST_CHECK_EQUAL(tracker.size(), 1);
+    tracker.Clear();
+    BOOST_CHECK_EQUAL(tracker.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(collateral_height)
+{
+    LOCK(cs_main);
+    CCollateralTracker tracker;
+
+    BOOST_CHECK_EQUAL(tracker.GetHeight(CTxIn(COutPoint(GetRandHash(), 0))), -1);
+    BOOST_CHECK_EQUAL(tracker.size(), 0);
+
+    CTransaction txCollateral = AddCollateral(MASTERNODE_COLLATERAL * COIN, 10);
+    CTxIn vin(COutPoint(txCollateral.GetHash(), 0));
+    BOOST_CHECK_EQUAL(tracker.GetHeight(vin), 10);
+    BOOST_CHECK_EQUAL(tracker.size(), 1);
+
+    // Remembered, a later change of the UTXO set is not looked at
+    SetCoinsHeight(txCollateral, 12);
+    BOOST_CHECK_EQUAL(tracker.GetHeight(vin), 10);
+
+    // Until the collateral transaction itself is disconnected in a reorg
+    RegisterValidationInterface(&tracker);
+    SyncWithWallets(txCollateral, NULL);
+    UnregisterValidationInterface(&tracker);
+    BOOST_CHECK_EQUAL(tracker.GetHeight(vin), 12);
+}
+
+BOOST_AUTO_TEST_CASE(collateral_forgotten_with_masternode)
+{
+    LOCK(cs_main);
+    mnodeman.Clear();
+    int nTracked = collateralTracker.size();
+
+    std::vector<CTxIn> vins;
+    for (int i = 0; i < 3; i++) {
+        CTransaction txCollateral = AddCollateral(MASTERNODE_COLLATERAL * COIN, 10 + i);
+        CMasternode mn;
+        mn.vin = CTxIn(COutPoint(txCollateral.GetHash(), 0));
+        mn.addr = CService(strprintf("10.0.0.%d", i + 1), 9340);
+        BOOST_CHECK(mnodeman.Add(mn));
+        BOOST_CHECK_EQUAL(collateralTracker.GetHeight(mn.vin), 10 + i);
+        vins.push_back(mn.vin);
+    }
+    BOOST_CHECK_EQUAL(collateralTracker.size(), nTracked + 3);
+
+    mnodeman.Remove(vins[0]);
+    BOOST_CHECK_EQUAL(collateralTracker.size(), nTracked + 2);
+
+    mnodeman.Clear();
+    BOOST_CHECK_EQUAL(collateralTracker.size(), nTracked);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
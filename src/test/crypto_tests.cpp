@@ -2,6 +2,7 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/common.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -130,6 +131,52 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Every batch size, so the 8-way, 4-way and single buffer paths all run and follow each other
+    for (int i = 0; i <= 32; i++) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; j++)
+            in[j] = insecure_rand() & 0xff;
+        for (int j = 0; j < i; j++) {
+            unsigned char hash[32];
+            CSHA256().Write(in + 64 * j, 64).Finalize(hash);
+            CSHA256().Write(hash, 32).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256dmidstate)
+{
+    // Messages of one to three blocks, finished from the state before their last block
+    for (int i = 0; i <= 32; i++) {
+        unsigned char in[192 * 32], last[64 * 32];
+        uint32_t midstates[8 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < i; j++) {
+            size_t nLen = 64 * (j % 3) + (j * 13) % 56;
+            for (size_t k = 0; k < nLen; k++)
+                in[192 * j + k] = insecure_rand() & 0xff;
+            unsigned char hash[32];
+            CSHA256().Write(in + 192 * j, nLen).Finalize(hash);
+            CSHA256().Write(hash, 32).Finalize(out1 + 32 * j);
+
+            size_t nFull = nLen - nLen % 64;
+            CSHA256().Write(in + 192 * j, nFull).GetMidstate(midstates + 8 * j);
+            unsigned char* block = last + 64 * j;
+            memset(block, 0, 64);
+            memcpy(block, in + 192 * j + nFull, nLen - nFull);
+            block[nLen - nFull] = 0x80;
+            WriteBE64(block + 56, nLen * 8);
+        }
+        SHA256DMidstate(out2, midstates, last, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
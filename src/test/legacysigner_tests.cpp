@@ -0,0 +1,141 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "legacysigner.h"
+
+#include "key.h"
+#include "net.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+std::vector<CSignedMessage> SignMessages(int nCount)
+{
+    CKey key;
+    key.MakeNewKey(true);
+
+    std::vector<CSignedMessage> vMessages;
+    for (int i = 0; i < nCount; i++) {
+        std::string strMessage = strprintf("message %d", i);
+        std::vector<unsigned char> vchSig;
+        std::string strError;
+        BOOST_REQUIRE(legacySigner.SignMessage(strMessage, strError, vchSig, key));
+        vMessages.push_back(CSignedMessage(key.GetPubKey(), vchSig, strMessage));
+    }
+    return vMessages;
+}
+
+// Push all messages and wait for their handlers, which record the results in the order they ran
+void VerifyQueued(CNode* pnode, const std::vector<CSignedMessage>& vMessages, std::vector<std::pair<size_t, bool> >& vResults)
+{
+    for (size_t i = 0; i < vMessages.size(); i++) {
+        legacySignerQueue.Push(pnode, vMessages[i], [&vResults, i](CNode* pfrom, bool fValid) {
+            vResults.push_back(std::make_pair(i, fValid));
+        });
+    }
+    while (legacySignerQueue.size() > 0) {
+        if (legacySignerQueue.ProcessVerified() == 0)
+            MilliSleep(1);
+    }
+}
+}
+
+BOOST_AUTO_TEST_SUITE(legacysigner_tests)
+
+BOOST_AUTO_TEST_CASE(legacysigner_queue)
+{
+    CNode dummyNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 9340)), "", true);
+    std::vector<CSignedMessage> vMessages = SignMessages(200);
+    for (size_t i = 0; i < vMessages.size(); i += 7)
+        vMessages[i].strMessage += " changed";
+
+    // Without workers the handlers run right away
+    std::vector<std::pair<size_t, bool> > vResults;
+    VerifyQueued(&dummyNode, vMessages, vResults);
+    BOOST_CHECK_EQUAL(vResults.size(), vMessages.size());
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++)
+        threadGroup.create_thread(&ThreadLegacySignerQueue);
+
+    std::vector<std::pair<size_t, bool> > vQueuedResults;
+    VerifyQueued(&dummyNode, vMessages, vQueuedResults);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Same results, in the order the messages were pushed
+    BOOST_CHECK(vQueuedResults == vResults);
+    for (size_t i = 0; i < vResults.size(); i++) {
+        BOOST_CHECK_EQUAL(vResults[i].first, i);
+        BOOST_CHECK_EQUAL(vResults[i].second, i % 7 != 0);
+    }
+    BOOST_CHECK_EQUAL(dummyNode.GetRefCount(), 0);
+}
+
+// Messages per second verified on the message handler thread and through the queue
+BOOST_AUTO_TEST_CASE(legacysigner_queue_throughput)
+{
+    CNode dummyNode(INVALID_SOCKET, CAddress(CService("127.0.0.1", 9340)), "", true);
+    std::vector<CSignedMessage> vMessages = SignMessages(2000);
+    // Different messages for the second run, verified signatures are cached
+    std::vector<CSignedMessage> vQueuedMessages = SignMessages(2000);
+    std::vector<std::pair<size_t, bool> > vResults;
+
+    int64_t nStart = GetTimeMicros();
+    VerifyQueued(&dummyNode, vMessages, vResults);
+    int64_t nSerial = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+
+    int nThreads = std::max(2, (int)boost::thread::hardware_concurrency());
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(&ThreadLegacySignerQueue);
+    // let the workers start up
+    MilliSleep(50);
+
+    vResults.clear();
+    nStart = GetTimeMicros();
+    VerifyQueued(&dummyNode, vQueuedMessages, vResults);
+    int64_t nQueued = std::max<int64_t>(GetTimeMicros() - nStart, 1);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    BOOST_CHECK_EQUAL(vResults.size(), vQueuedMessages.size());
+    BOOST_TEST_MESSAGE(strprintf("legacysigner_queue_throughput: %d msg/s serial, %d msg/s with %d workers",
+        vMessages.size() * 1000000 / nSerial, vMessages.size() * 1000000 / nQueued, nThreads));
+}
+
+BOOST_AUTO_TEST_CASE(legacysigner_cache)
+{
+    std::vector<CSignedMessage> vMessages = SignMessages(2);
+    const CSignedMessage& msg = vMessages[0];
+    std::string strError;
+
+    CLegacySignerCacheStats before = legacySigner.GetCacheStats();
+    BOOST_CHECK(legacySigner.VerifyMessage(msg.pubkey, msg.vchSig, msg.strMessage, strError));
+    BOOST_CHECK(legacySigner.VerifyMessage(msg.pubkey, msg.vchSig, msg.strMessage, strError));
+    CLegacySignerCacheStats after = legacySigner.GetCacheStats();
+    BOOST_CHECK_EQUAL(after.nMisses, before.nMisses + 1);
+    BOOST_CHECK_EQUAL(after.nHits, before.nHits + 1);
+    BOOST_CHECK_EQUAL(after.nEntries, before.nEntries + 1);
+
+    // A cached signature is still checked against the expected key
+    CKey key;
+    key.MakeNewKey(true);
+    BOOST_CHECK(!legacySigner.VerifyMessage(key.GetPubKey(), msg.vchSig, msg.strMessage, strError));
+    BOOST_CHECK_EQUAL(legacySigner.GetCacheStats().nHits, after.nHits + 1);
+
+    // Failed verifications are not cached
+    BOOST_CHECK(!legacySigner.VerifyMessage(msg.pubkey, vMessages[1].vchSig, msg.strMessage, strError));
+    BOOST_CHECK(!legacySigner.VerifyMessage(msg.pubkey, vMessages[1].vchSig, msg.strMessage, strError));
+    BOOST_CHECK_EQUAL(legacySigner.GetCacheStats().nMisses, after.nMisses + 2);
+    BOOST_CHECK_EQUAL(legacySigner.GetCacheStats().nEntries, after.nEntries);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,77 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+
+#include "random.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(lrucache_tests)
+
+BOOST_AUTO_TEST_CASE(lrucache_evicts_least_recently_used)
+{
+    lrucache<int, int> cache(3);
+    cache.insert(1, 10);
+    cache.insert(2, 20);
+    cache.insert(3, 30);
+
+    // Touching 1 makes 2 the eviction candidate
+    int value = 0;
+    BOOST_CHECK(cache.get(1, value));
+    BOOST_CHECK_EQUAL(value, 10);
+    cache.insert(4, 40);
+    BOOST_CHECK_EQUAL(cache.size(), 3U);
+    BOOST_CHECK(!cache.count(2));
+    BOOST_CHECK(cache.count(1) && cache.count(3) && cache.count(4));
+
+    // Replacing keeps the size and refreshes the element
+    cache.insert(3, 31);
+    cache.insert(5, 50);
+    BOOST_CHECK(!cache.count(1));
+    BOOST_CHECK(cache.get(3, value));
+    BOOST_CHECK_EQUAL(value, 31);
+
+    cache.erase(3);
+    BOOST_CHECK(!cache.get(3, value));
+    BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+    cache.max_size(1);
+    BOOST_CHECK_EQUAL(cache.size(), 1U);
+    BOOST_CHECK(cache.count(5));
+
+    cache.max_size(0);
+    cache.insert(6, 60);
+    BOOST_CHECK(cache.empty());
+}
+
+// Random operations against a map, as long as nothing is evicted the cache behaves like one
+BOOST_AUTO_TEST_CASE(lrucache_like_map)
+{
+    lrucache<int, int> cache(1000);
+    std::map<int, int> map;
+    for (int i = 0; i < 10000; i++) {
+        int key = insecure_rand() % 500;
+        switch (insecure_rand() % 3) {
+        case 0:
+            cache.insert(key, i);
+            map[key] = i;
+            break;
+        case 1:
+            cache.erase(key);
+            map.erase(key);
+            break;
+        default:
+            int value = -1;
+            BOOST_CHECK_EQUAL(cache.get(key, value), map.count(key) == 1);
+            if (map.count(key))
+                BOOST_CHECK_EQUAL(value, map[key]);
+        }
+        BOOST_CHECK_EQUAL(cache.size(), map.size());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,9 @@
 #include "primitives/transaction.h"
 #include "main.h"
 
+#include "chainparams.h"
+#include "hash.h"
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_AUTO_TEST_SUITE(main_tests)
@@ -23,4 +26,80 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test, * boost::unit_test::disabled())
     BOOST_CHECK(nSum == 1350824726649000ULL);
 }
 */
+
+BOOST_AUTO_TEST_CASE(main_block_message_cache)
+{
+    // Store a block in a file of its own, the other tests don't leave a usable chain behind
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos(9999, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex index(block, false);
+    index.phashBlock = &hashBlock;
+    index.nFile = pos.nFile;
+    index.nDataPos = pos.nPos;
+    index.nStatus |= BLOCK_HAVE_DATA;
+    CBlockIndex* pindex = &index;
+
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+
+    // The raw bytes on disk are the network serialization of the block
+    std::vector<char> vBlock;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vBlock, pindex));
+    BOOST_CHECK(vBlock == std::vector<char>(ssBlock.begin(), ssBlock.end()));
+
+    // A block message is the same as the one PushMessage("block", block) would send
+    SetBlockMessageCacheSize(DEFAULT_BLOCK_MESSAGE_CACHE_SIZE);
+    std::shared_ptr<const CSerializeData> pmessage;
+    BOOST_REQUIRE(GetBlockMessage(pindex, pmessage));
+    BOOST_REQUIRE_EQUAL(pmessage->size(), CMessageHeader::HEADER_SIZE + vBlock.size());
+    CDataStream ssMessage(pmessage->begin(), pmessage->end(), SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr(Params().MessageStart());
+    ssMessage >> hdr;
+    BOOST_CHECK(hdr.IsValid(Params().MessageStart()));
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), "block");
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, vBlock.size());
+    uint256 hash = Hash(vBlock.begin(), vBlock.end());
+    BOOST_CHECK_EQUAL(hdr.nChecksum, *(unsigned int*)&hash);
+    BOOST_CHECK(std::vector<char>(ssMessage.begin(), ssMessage.end()) == vBlock);
+
+    // Asking again is served from the cache, unless it is disabled
+    std::shared_ptr<const CSerializeData> pcached;
+    BOOST_REQUIRE(GetBlockMessage(pindex, pcached));
+    BOOST_CHECK(pcached == pmessage);
+    SetBlockMessageCacheSize(0);
+    BOOST_REQUIRE(GetBlockMessage(pindex, pcached));
+    BOOST_CHECK(pcached != pmessage);
+    BOOST_CHECK(*pcached == *pmessage);
+    SetBlockMessageCacheSize(DEFAULT_BLOCK_MESSAGE_CACHE_SIZE);
+
+    // Data that isn't the indexed block is refused
+    CBlockIndex indexWrong(*pindex);
+    indexWrong.nDataPos += 1;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vBlock, &indexWrong));
+    BOOST_CHECK(vBlock.empty());
+}
+
+BOOST_AUTO_TEST_CASE(main_rolling_rate)
+{
+    CRollingRate rate(60);
+    BOOST_CHECK_EQUAL(rate.GetRate(1000), 0.0);
+
+    rate.Add(1000, 100);
+    rate.Add(1000, 50);
+    BOOST_CHECK_EQUAL(rate.GetRate(1000), 150.0);
+
+    // Until the window is full only the time since the first value counts
+    rate.Add(1009, 50);
+    BOOST_CHECK_EQUAL(rate.GetRate(1010), 20.0);
+    BOOST_CHECK_EQUAL(rate.GetRate(1040), 200.0 / 40);
+
+    // Values drop out when they fall out of the window
+    BOOST_CHECK_CLOSE(rate.GetRate(1060), 50.0 / 60, 0.0001);
+    BOOST_CHECK_EQUAL(rate.GetRate(1069), 0.0);
+    rate.Add(1100, 120);
+    BOOST_CHECK_EQUAL(rate.GetRate(1100), 2.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "masternode-index.h"
+
+#include "key.h"
+#include "random.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+struct CTestNode
+{
+    CTxIn vin;
+    CService addr;
+    CPubKey pubkey;
+    CPubKey pubkey2;
+
+    explicit CTestNode(int i) : vin(GetRandHash(), i), addr(strprintf("10.0.0.%d", i), 9340)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        pubkey = key.GetPubKey();
+        key.MakeNewKey(true);
+        pubkey2 = key.GetPubKey();
+    }
+};
+}
+
+BOOST_AUTO_TEST_SUITE(masternode_index_tests)
+
+BOOST_AUTO_TEST_CASE(masternode_index_find)
+{
+    std::vector<CTestNode> vNodes;
+    for (int i = 1; i <= 10; i++)
+        vNodes.push_back(CTestNode(i));
+    CMasternodeIndex<CTestNode> index;
+
+    for (size_t i = 0; i < vNodes.size(); i++) {
+        BOOST_CHECK(index.Find(vNodes, vNodes[i].vin.prevout) == &vNodes[i]);
+        BOOST_CHECK(index.Find(vNodes, vNodes[i].pubkey2) == &vNodes[i]);
+        BOOST_CHECK(index.Find(vNodes, vNodes[i].addr) == &vNodes[i]);
+        BOOST_CHECK(index.Find(vNodes, GetScriptForDestination(vNodes[i].pubkey.GetID())) == &vNodes[i]);
+    }
+    BOOST_CHECK(index.Find(vNodes, COutPoint(GetRandHash(), 0)) == NULL);
+    BOOST_CHECK(index.Find(vNodes, vNodes[0].pubkey) == NULL);
+    BOOST_CHECK(index.Find(vNodes, CService("10.0.0.99", 9340)) == NULL);
+    // Only the P2PKH script of the collateral key is a payee
+    BOOST_CHECK(index.Find(vNodes, CScript() << ToByteVector(vNodes[0].pubkey) << OP_CHECKSIG) == NULL);
+
+    // Removing an entry moves the others around
+    vNodes.erase(vNodes.begin());
+    index.SetDirty();
+    for (size_t i = 0; i < vNodes.size(); i++)
+        BOOST_CHECK(index.Find(vNodes, vNodes[i].addr) == &vNodes[i]);
+
+    // Unreported changes are caught when a hit no longer matches
+    std::swap(vNodes[0], vNodes[1]);
+    BOOST_CHECK(index.Find(vNodes, vNodes[0].vin.prevout) == &vNodes[0]);
+    BOOST_CHECK(index.Find(vNodes, vNodes[1].pubkey2) == &vNodes[1]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "key.h"
+#include "keystore.h"
 #include "main.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
 #include "txmempool.h"
 #include "util.h"
+#include "utiltime.h"
 
 #include <boost/test/unit_test.hpp>
 #include <list>
@@ -99,4 +105,184 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+
+    // Chain of three transactions, the child pays the highest fee
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(1);
+    txGrandChild.vin[0].scriptSig = CScript() << OP_11;
+    txGrandChild.vin[0].prevout = COutPoint(txChild.GetHash(), 0);
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 8 * COIN;
+
+    // An unrelated transaction paying a fee rate between the parent and the package
+    CMutableTransaction txOther = txParent;
+    txOther.vin[0].scriptSig = CScript() << OP_12;
+
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 1000, 0, 0.0, 1));
+    pool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 100000, 0, 0.0, 1));
+    pool.addUnchecked(txGrandChild.GetHash(), CTxMemPoolEntry(txGrandChild, 2000, 0, 0.0, 1));
+    pool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 20000, 0, 0.0, 1));
+
+    CTxMemPool::txiter itParent = pool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter itChild = pool.mapTx.find(txChild.GetHash());
+    CTxMemPool::txiter itGrandChild = pool.mapTx.find(txGrandChild.GetHash());
+    size_t nTxSize = itParent->GetTxSize();
+
+    BOOST_CHECK_EQUAL(itParent->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetSizeWithAncestors(), 3 * nTxSize);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 103000);
+    BOOST_CHECK(pool.GetMemPoolParents(itChild).count(itParent));
+    BOOST_CHECK(pool.GetMemPoolChildren(itChild).count(itGrandChild));
+
+    // The parent and child package beats the unrelated transaction, the parent alone does not
+    std::vector<uint256> sortedOrder;
+    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator it = pool.mapTx.get<ancestor_score>().begin();
+    for (; it != pool.mapTx.get<ancestor_score>().end(); ++it)
+        sortedOrder.push_back(it->GetTx().GetHash());
+    BOOST_REQUIRE_EQUAL(sortedOrder.size(), 4);
+    BOOST_CHECK(sortedOrder[0] == txChild.GetHash());
+    BOOST_CHECK(sortedOrder[1] == txGrandChild.GetHash());
+    BOOST_CHECK(sortedOrder[2] == txOther.GetHash());
+    BOOST_CHECK(sortedOrder[3] == txParent.GetHash());
+
+    // Prioritising the parent raises the package fees of its descendants
+    pool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, 500);
+    BOOST_CHECK_EQUAL(itParent->GetModifiedFee(), 1500);
+    BOOST_CHECK_EQUAL(itChild->GetModFeesWithAncestors(), 101500);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 103500);
+
+    // Mining the parent leaves the descendants with smaller packages
+    std::list<CTransaction> removed;
+    pool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 1);
+    BOOST_CHECK_EQUAL(itChild->GetSizeWithAncestors(), nTxSize);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 102000);
+    BOOST_CHECK(pool.GetMemPoolParents(itChild).empty());
+
+    // Putting the parent back, as after a reorg, links it to the children again
+    pool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 1000, 0, 0.0, 1));
+    itParent = pool.mapTx.find(txParent.GetHash());
+    BOOST_CHECK_EQUAL(itParent->GetModifiedFee(), 1500);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 2);
+    BOOST_CHECK_EQUAL(itGrandChild->GetCountWithAncestors(), 3);
+    BOOST_CHECK_EQUAL(itGrandChild->GetModFeesWithAncestors(), 103500);
+    BOOST_CHECK(pool.GetMemPoolChildren(itParent).count(itChild));
+
+    removed.clear();
+    pool.remove(txParent, removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 3);
+    BOOST_CHECK_EQUAL(pool.size(), 1);
+    pool.ClearPrioritisation(txParent.GetHash());
+}
+
+// Creates a transaction spending nInputs fresh P2PKH coins added to pcoinsTip
+static CMutableTransaction CreateMultiInputTx(CBasicKeyStore& keystore, const CKey& key, int nInputs)
+{
+    CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+    CMutableTransaction tx;
+    tx.vin.resize(nInputs);
+    for (int i = 0; i < nInputs; i++)
+    {
+        uint256 hash = GetRandHash();
+        CCoinsModifier coins = pcoinsTip->ModifyCoins(hash);
+        coins->fBlockReward = false;
+        coins->nVersion = 1;
+        coins->nHeight = 0;
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 1 * COIN;
+        coins->vout[0].scriptPubKey = scriptPubKey;
+        tx.vin[i].prevout = COutPoint(hash, 0);
+    }
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nInputs * COIN - COIN / 100;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    for (int i = 0; i < nInputs; i++)
+        BOOST_CHECK(SignSignature(keystore, scriptPubKey, tx, i));
+    return tx;
+}
+
+// Accepts nTx fresh nInputs-input transactions, returns the time spent in microseconds
+static int64_t AcceptMultiInputTxs(int nTx, int nInputs)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    std::vector<CMutableTransaction> txs;
+    for (int i = 0; i < nTx; i++)
+        txs.push_back(CreateMultiInputTx(keystore, key, nInputs));
+
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nTx; i++)
+    {
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, CTransaction(txs[i]), false, NULL));
+    }
+    int64_t nTime = GetTimeMicros() - nStart;
+
+    BOOST_CHECK_EQUAL(mempool.size(), nTx);
+    mempool.clear();
+    return nTime;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAcceptMultiInputBench)
+{
+    LOCK(cs_main);
+    const int nTx = 20;
+    const int nInputs = 50;
+    const int nThreads = nMempoolScriptCheckThreads;
+
+    nMempoolScriptCheckThreads = 0;
+    int64_t nSerial = AcceptMultiInputTxs(nTx, nInputs);
+    nMempoolScriptCheckThreads = nThreads;
+    int64_t nParallel = AcceptMultiInputTxs(nTx, nInputs);
+
+    BOOST_TEST_MESSAGE(strprintf("Accepted %d transactions with %d inputs: %.2fms serial, %.2fms with %d threads",
+                                 nTx, nInputs, nSerial * 0.001, nParallel * 0.001, nThreads));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolAcceptParallelInvalidSignature)
+{
+    LOCK(cs_main);
+    BOOST_REQUIRE(nMempoolScriptCheckThreads > 0);
+
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+    CMutableTransaction tx = CreateMultiInputTx(keystore, key, 10);
+
+    // Swap two signatures: every input is signed, but two of them fail to verify
+    std::swap(tx.vin[3].scriptSig, tx.vin[7].scriptSig);
+
+    CValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(mempool, state, CTransaction(tx), false, NULL));
+    BOOST_CHECK(state.GetRejectReason().find("mandatory-script-verify-flag-failed") == 0);
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
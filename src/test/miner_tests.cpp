@@ -5,11 +5,47 @@
 #include "main.h"
 #include "miner.h"
 #include "pubkey.h"
+#include "random.h"
+#include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
 
 #include <boost/test/unit_test.hpp>
 
+namespace
+{
+/** A transaction spending a new OP_TRUE output of the UTXO set, paying nFee */
+CTransaction MakeFundedTx(CAmount nFee)
+{
+    CMutableTransaction txFunding;
+    txFunding.vin.resize(1);
+    txFunding.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFunding.vout.resize(1);
+    txFunding.vout[0].nValue = COIN;
+    txFunding.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    CCoinsModifier coins = pcoinsTip->ModifyCoins(txFunding.GetHash());
+    coins->FromTx(txFunding, 0);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFunding.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN - nFee;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+void AddToMempool(const CTransaction& tx, CAmount nFee)
+{
+    mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, GetTime(), 0.0, 1));
+}
+
+bool HasTx(const CBlockTemplateCache& cache, const CTransaction& tx)
+{
+    return std::find(cache.vtx.begin(), cache.vtx.end(), tx) != cache.vtx.end();
+}
+}
+
 BOOST_AUTO_TEST_SUITE(miner_tests)
 
 static
@@ -265,4 +301,116 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity, * boost::unit_test::disabled())
     Checkpoints::fEnabled = true;
 }
 */
+
+BOOST_AUTO_TEST_CASE(block_template_cache)
+{
+    LOCK2(cs_main, mempool.cs);
+    // Other suites leave their own blocks behind as the tip, start from the genesis block
+    BlockMap::iterator mi = mapBlockIndex.find(Params().GenesisBlock().GetHash());
+    BOOST_REQUIRE(mi != mapBlockIndex.end());
+    CBlockIndex* pindexTipOrig = chainActive.Tip();
+    chainActive.SetTip(mi->second);
+    // The funding coins go into a view on top of the coins tip, which is put back at the end
+    CCoinsViewCache* pcoinsTipOrig = pcoinsTip;
+    CCoinsViewCache coinsTest(pcoinsTipOrig);
+    pcoinsTip = &coinsTest;
+    mempool.clear();
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+
+    CBlockTemplateCache cache;
+    CTransaction tx1 = MakeFundedTx(100000);
+    AddToMempool(tx1, 100000);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime);
+    BOOST_CHECK_EQUAL(cache.vtx.size(), 1);
+    BOOST_CHECK(HasTx(cache, tx1));
+    BOOST_CHECK_EQUAL(cache.nFees, 100000);
+
+    // Nothing changed, the selection is reused
+    SetMockTime(nTime + 1);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime);
+    BOOST_CHECK_EQUAL(cache.vtx.size(), 1);
+
+    // A new arrival is appended without a rebuild
+    CTransaction tx2 = MakeFundedTx(200000);
+    AddToMempool(tx2, 200000);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime);
+    BOOST_CHECK_EQUAL(cache.vtx.size(), 2);
+    BOOST_CHECK(HasTx(cache, tx2));
+    BOOST_CHECK_EQUAL(cache.nFees, 300000);
+
+    // A new arrival which can not be included is left out, still without a rebuild
+    CMutableTransaction txMissingInput = MakeFundedTx(100000);
+    txMissingInput.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    AddToMempool(txMissingInput, 100000);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime);
+    BOOST_CHECK_EQUAL(cache.vtx.size(), 2);
+    std::list<CTransaction> removed;
+    mempool.remove(txMissingInput, removed);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime);
+
+    // A selected transaction leaving the mempool forces a rebuild
+    SetMockTime(nTime + 2);
+    mempool.remove(tx1, removed);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime + 2);
+    BOOST_CHECK_EQUAL(cache.vtx.size(), 1);
+    BOOST_CHECK(!HasTx(cache, tx1));
+    BOOST_CHECK_EQUAL(cache.nFees, 200000);
+
+    // So does prioritisation, which is not notified
+    SetMockTime(nTime + 3);
+    mempool.PrioritiseTransaction(tx2.GetHash(), tx2.GetHash().ToString(), 0, 1000);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime + 3);
+
+    // And other block size limits
+    SetMockTime(nTime + 4);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE - 1, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime + 4);
+
+    // A new tip
+    SetMockTime(nTime + 5);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    uint256 hash = GetRandHash();
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    index.pprev = pindexPrev;
+    index.nHeight = pindexPrev->nHeight + 1;
+    chainActive.SetTip(&index);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE - 1, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime + 5);
+
+    // Or the old one after it was disconnected again
+    SetMockTime(nTime + 6);
+    chainActive.SetTip(pindexPrev);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE - 1, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime + 6);
+
+    // A stale selection is rebuilt to pick up transactions which became final
+    SetMockTime(nTime + 6 + BLOCK_TEMPLATE_REBUILD_INTERVAL - 1);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE - 1, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime + 6);
+    SetMockTime(nTime + 6 + BLOCK_TEMPLATE_REBUILD_INTERVAL);
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE - 1, 0, 0);
+    BOOST_CHECK_EQUAL(cache.GetTimeRebuilt(), nTime + 6 + BLOCK_TEMPLATE_REBUILD_INTERVAL);
+    BOOST_CHECK_EQUAL(cache.vtx.size(), 1);
+    BOOST_CHECK(HasTx(cache, tx2));
+
+    // clear() notifies the removal of every entry, which empties the selection
+    mempool.clear();
+    cache.Update(DEFAULT_BLOCK_MAX_SIZE - 1, 0, 0);
+    BOOST_CHECK_EQUAL(cache.vtx.size(), 0);
+    BOOST_CHECK_EQUAL(cache.nFees, 0);
+
+    SetMockTime(0);
+    pcoinsTip = pcoinsTipOrig;
+    chainActive.SetTip(pindexTipOrig);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,174 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+CCriticalSection cs_processed;
+// Commands in the order they were processed, by peer
+std::map<NodeId, std::vector<std::string> > mapProcessed;
+int nProcessing = 0;
+int nMaxProcessing = 0;
+
+// Stands in for main's ProcessMessages, takes one message at a time and is slow at it
+bool ProcessSlowly(CNode* pfrom)
+{
+    if (pfrom->vRecvMsg.empty() || !pfrom->vRecvMsg.front().complete())
+        return true;
+    {
+        LOCK(cs_processed);
+        nMaxProcessing = std::max(nMaxProcessing, ++nProcessing);
+    }
+    MilliSleep(2);
+    {
+        LOCK(cs_processed);
+        nProcessing--;
+        mapProcessed[pfrom->id].push_back(pfrom->vRecvMsg.front().hdr.GetCommand());
+    }
+    pfrom->vRecvMsg.pop_front();
+    return true;
+}
+
+bool SendNothing(CNode* pto, bool fSendTrickle)
+{
+    return true;
+}
+
+void ReceiveMessage(CNode* pnode, const std::string& strCommand)
+{
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << CMessageHeader(Params().MessageStart(), strCommand.c_str(), 0);
+    LOCK(pnode->cs_vRecvMsg);
+    BOOST_REQUIRE(pnode->ReceiveMsgBytes(&ssHeader[0], ssHeader.size()));
+}
+
+size_t CountProcessed()
+{
+    size_t nCount = 0;
+    LOCK(cs_processed);
+    BOOST_FOREACH(const PAIRTYPE(NodeId, std::vector<std::string>)& item, mapProcessed)
+        nCount += item.second.size();
+    return nCount;
+}
+
+/** Have nThreads message handler threads process nMessages messages from each of nPeers peers, returns the time it took in microseconds */
+int64_t ProcessPeers(int nThreads, int nPeers, int nMessages)
+{
+    {
+        LOCK(cs_processed);
+        mapProcessed.clear();
+        nMaxProcessing = 0;
+    }
+
+    std::vector<CNode*> vPeers;
+    for (int i = 0; i < nPeers; i++) {
+        CNode* pnode = new CNode(INVALID_SOCKET, CAddress(CService(strprintf("10.0.0.%d", i + 1), 9340)), "", true);
+        for (int j = 0; j < nMessages; j++)
+            ReceiveMessage(pnode, strprintf("msg%d", j));
+        vPeers.push_back(pnode);
+    }
+    {
+        LOCK(cs_vNodes);
+        vNodes.insert(vNodes.end(), vPeers.begin(), vPeers.end());
+    }
+
+    int64_t nStart = GetTimeMicros();
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&ThreadMessageHandler, i, nThreads));
+    int64_t nEnd = GetTime() + 60;
+    while (CountProcessed() < (size_t)(nPeers * nMessages) && GetTime() < nEnd)
+        MilliSleep(1);
+    int64_t nTime = GetTimeMicros() - nStart;
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vPeers)
+            vNodes.erase(std::remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+    }
+    BOOST_FOREACH(CNode* pnode, vPeers) {
+        BOOST_CHECK_EQUAL(pnode->GetRefCount(), 0);
+        // Every peer got its messages processed in the order they were received
+        LOCK(cs_processed);
+        const std::vector<std::string>& vCommands = mapProcessed[pnode->id];
+        BOOST_CHECK_EQUAL(vCommands.size(), (size_t)nMessages);
+        for (size_t j = 0; j < vCommands.size(); j++)
+            BOOST_CHECK_EQUAL(vCommands[j], strprintf("msg%d", j));
+        delete pnode;
+    }
+    return nTime;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(msghandler_tests)
+
+BOOST_AUTO_TEST_CASE(msghandler_parallel_peers)
+{
+    UnregisterNodeSignals(GetNodeSignals());
+    GetNodeSignals().ProcessMessages.connect(&ProcessSlowly);
+    GetNodeSignals().SendMessages.connect(&SendNothing);
+
+    int64_t nSerial = ProcessPeers(1, 8, 20);
+    BOOST_CHECK_EQUAL(nMaxProcessing, 1);
+
+    int64_t nParallel = ProcessPeers(4, 8, 20);
+    // Different peers got processed at the same time
+    BOOST_CHECK(nMaxProcessing > 1);
+    BOOST_CHECK(nMaxProcessing <= 4);
+    BOOST_TEST_MESSAGE(strprintf("msghandler_parallel_peers: 160 slow messages in %dms on 1 thread, %dms on 4 threads", nSerial / 1000, nParallel / 1000));
+
+    GetNodeSignals().ProcessMessages.disconnect(&ProcessSlowly);
+    GetNodeSignals().SendMessages.disconnect(&SendNothing);
+    RegisterNodeSignals(GetNodeSignals());
+}
+
+BOOST_AUTO_TEST_CASE(msghandler_message_stats)
+{
+    std::map<std::string, CMessageStats> mapBefore = CNode::GetMessageStats();
+    CNode::RecordMessageStats("teststats", 100, 30, 0);
+    CNode::RecordMessageStats("teststats", 50, 10, 5);
+    CMessageStats stats = CNode::GetMessageStats()["teststats"];
+    BOOST_CHECK_EQUAL(stats.nCount, mapBefore["teststats"].nCount + 2);
+    BOOST_CHECK_EQUAL(stats.nBytes, mapBefore["teststats"].nBytes + 150);
+    BOOST_CHECK_EQUAL(stats.nTime, mapBefore["teststats"].nTime + 40);
+    BOOST_CHECK(stats.nMaxTime >= 30);
+    BOOST_CHECK_EQUAL(stats.nLockWait, mapBefore["teststats"].nLockWait + 5);
+
+    // Made up commands can't grow the statistics without bound
+    for (unsigned int i = 0; i < 2 * MAX_MSG_TIME_COMMANDS; i++)
+        CNode::RecordMessageStats(strprintf("madeup%d", i), 1, 1, 0);
+    std::map<std::string, CMessageStats> mapStats = CNode::GetMessageStats();
+    BOOST_CHECK(mapStats.size() <= MAX_MSG_TIME_COMMANDS + 1);
+    BOOST_CHECK(mapStats.count("*other*"));
+}
+
+BOOST_AUTO_TEST_CASE(msghandler_main_lock_wait)
+{
+    int64_t nWaitBefore = GetMainLockWaitTime();
+    boost::thread threadHolder;
+    {
+        LOCK(cs_main);
+        threadHolder = boost::thread([]() {
+            LOCK(cs_main);
+            // only this thread's waits count
+            BOOST_CHECK(GetMainLockWaitTime() >= 20000);
+        });
+        MilliSleep(50);
+    }
+    threadHolder.join();
+    BOOST_CHECK_EQUAL(GetMainLockWaitTime(), nWaitBefore);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
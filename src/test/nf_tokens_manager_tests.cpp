@@ -0,0 +1,198 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "random.h"
+#include "platform/platform-db.h"
+#include "platform/nf-token/nf-tokens-manager.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace Platform;
+
+namespace
+{
+struct NfTokensManagerSetup
+{
+    CBlockIndex blockIndex;
+    std::unique_ptr<CScopedDBTransaction> dbTx;
+
+    explicit NfTokensManagerSetup(PlatformOpt optSetting)
+    {
+        PlatformDb::DestroyInstance();
+        PlatformDb::CreateInstance(1 << 20, optSetting, true, true);
+        NfTokensManager::DestroyInstance();
+
+        // Disk indexes are resolved through mapBlockIndex
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(GetRandHash(), &blockIndex)).first;
+        blockIndex.phashBlock = &mi->first;
+        blockIndex.nHeight = 101;
+
+        dbTx = PlatformDb::Instance().BeginTransaction();
+        NfTokensManager::Instance().OnNewProtocolRegistered(25);
+        ConnectBlock();
+    }
+
+    ~NfTokensManagerSetup()
+    {
+        dbTx.reset();
+        NfTokensManager::DestroyInstance();
+        PlatformDb::DestroyInstance();
+        LOCK(cs_main);
+        mapBlockIndex.erase(blockIndex.GetBlockHash());
+    }
+
+    NfToken MakeNfToken(const CKeyID & ownerId, uint64_t protocolId = 25)
+    {
+        NfToken nfToken;
+        nfToken.tokenProtocolId = protocolId;
+        nfToken.tokenId = GetRandHash();
+        nfToken.tokenOwnerKeyId = ownerId;
+        nfToken.metadataAdminKeyId = RandomKeyId();
+        return nfToken;
+    }
+
+    bool AddNfToken(const NfToken & nfToken)
+    {
+        // Registrations are told apart by their transaction hash
+        CMutableTransaction tx;
+        tx.nLockTime = GetRand(std::numeric_limits<uint32_t>::max());
+        return NfTokensManager::Instance().AddNfToken(nfToken, CTransaction(tx), &blockIndex);
+    }
+
+    /// Commit the database records written so far, like at the end of a block
+    void ConnectBlock()
+    {
+        dbTx->Commit();
+        NfTokensManager::Instance().UpdateBlockTip(&blockIndex);
+        dbTx = PlatformDb::Instance().BeginTransaction();
+    }
+
+    static CKeyID RandomKeyId()
+    {
+        CKeyID keyId;
+        GetRandBytes(keyId.begin(), keyId.size());
+        return keyId;
+    }
+};
+}
+
+BOOST_AUTO_TEST_SUITE(nf_tokens_manager_tests)
+
+BOOST_AUTO_TEST_CASE(nf_tokens_snapshot_isolation)
+{
+    NfTokensManagerSetup setup(PlatformOpt::OptSpeed);
+    NfTokensManager & manager = NfTokensManager::Instance();
+
+    CKeyID ownerId = setup.RandomKeyId();
+    NfToken nfToken = setup.MakeNfToken(ownerId);
+    BOOST_CHECK(setup.AddNfToken(nfToken));
+
+    // Not visible to owner queries before the tip is published
+    BOOST_CHECK(manager.OwnerOf(25, nfToken.tokenId).IsNull());
+    BOOST_CHECK_EQUAL(manager.BalanceOf(ownerId), 0);
+    BOOST_CHECK_EQUAL(manager.TotalSupply(), 0);
+    BOOST_CHECK(manager.Contains(25, nfToken.tokenId));
+
+    setup.ConnectBlock();
+    BOOST_CHECK(manager.OwnerOf(25, nfToken.tokenId) == ownerId);
+    BOOST_CHECK_EQUAL(manager.BalanceOf(ownerId), 1);
+    BOOST_CHECK_EQUAL(manager.BalanceOf(25, ownerId), 1);
+    BOOST_CHECK_EQUAL(manager.TotalSupply(), 1);
+    BOOST_CHECK_EQUAL(manager.TotalSupply(25), 1);
+
+    // Changes made after the publication leave the published view alone
+    NfToken nfToken2 = setup.MakeNfToken(ownerId);
+    BOOST_CHECK(setup.AddNfToken(nfToken2));
+    BOOST_CHECK(manager.Delete(25, nfToken.tokenId));
+    BOOST_CHECK(manager.OwnerOf(25, nfToken.tokenId) == ownerId);
+    BOOST_CHECK(manager.OwnerOf(25, nfToken2.tokenId).IsNull());
+    std::vector<uint256> tokenIds = manager.NfTokenIdsOf(ownerId);
+    BOOST_CHECK_EQUAL(tokenIds.size(), 1);
+    BOOST_CHECK(tokenIds[0] == nfToken.tokenId);
+
+    setup.ConnectBlock();
+    BOOST_CHECK(manager.OwnerOf(25, nfToken.tokenId).IsNull());
+    BOOST_CHECK(manager.OwnerOf(25, nfToken2.tokenId) == ownerId);
+    tokenIds = manager.NfTokenIdsOf(25, ownerId);
+    BOOST_CHECK_EQUAL(tokenIds.size(), 1);
+    BOOST_CHECK(tokenIds[0] == nfToken2.tokenId);
+    BOOST_CHECK_EQUAL(manager.NfTokensOf(ownerId).size(), 1);
+    BOOST_CHECK_EQUAL(manager.TotalSupply(), 1);
+
+    // An owner without tokens is dropped
+    BOOST_CHECK(manager.Delete(25, nfToken2.tokenId));
+    setup.ConnectBlock();
+    BOOST_CHECK_EQUAL(manager.BalanceOf(ownerId), 0);
+    BOOST_CHECK(manager.NfTokenIdsOf(ownerId).empty());
+}
+
+BOOST_AUTO_TEST_CASE(nf_tokens_snapshot_many_owners)
+{
+    NfTokensManagerSetup setup(PlatformOpt::OptSpeed);
+    NfTokensManager & manager = NfTokensManager::Instance();
+
+    std::vector<CKeyID> owners;
+    for (int i = 0; i < 50; i++)
+        owners.push_back(setup.RandomKeyId());
+
+    std::map<uint256, CKeyID> tokenOwners;
+    std::map<CKeyID, std::size_t> balances;
+    for (int block = 0; block < 5; block++) {
+        for (int i = 0; i < 200; i++) {
+            const CKeyID & ownerId = owners[insecure_rand() % owners.size()];
+            NfToken nfToken = setup.MakeNfToken(ownerId);
+            BOOST_CHECK(setup.AddNfToken(nfToken));
+            tokenOwners[nfToken.tokenId] = ownerId;
+            ++balances[ownerId];
+        }
+        setup.ConnectBlock();
+    }
+
+    BOOST_CHECK_EQUAL(manager.TotalSupply(25), tokenOwners.size());
+    for (const auto & tokenOwner : tokenOwners)
+        BOOST_CHECK(manager.OwnerOf(25, tokenOwner.first) == tokenOwner.second);
+    for (const auto & balance : balances) {
+        BOOST_CHECK_EQUAL(manager.BalanceOf(balance.first), balance.second);
+        BOOST_CHECK_EQUAL(manager.BalanceOf(25, balance.first), balance.second);
+        BOOST_CHECK_EQUAL(manager.BalanceOf(26, balance.first), 0);
+        BOOST_CHECK_EQUAL(manager.NfTokenIdsOf(balance.first).size(), balance.second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(nf_tokens_optimize_ram)
+{
+    NfTokensManagerSetup setup(PlatformOpt::OptRam);
+    NfTokensManager & manager = NfTokensManager::Instance();
+
+    CKeyID ownerId = setup.RandomKeyId();
+    NfToken nfToken = setup.MakeNfToken(ownerId);
+    NfToken nfToken2 = setup.MakeNfToken(ownerId);
+    BOOST_CHECK(setup.AddNfToken(nfToken));
+    BOOST_CHECK(setup.AddNfToken(nfToken2));
+    BOOST_CHECK(!setup.AddNfToken(nfToken));
+    setup.ConnectBlock();
+
+    // Served from the platform database
+    BOOST_CHECK(manager.OwnerOf(25, nfToken.tokenId) == ownerId);
+    BOOST_CHECK(manager.OwnerOf(25, GetRandHash()).IsNull());
+    BOOST_CHECK_EQUAL(manager.BalanceOf(ownerId), 2);
+    BOOST_CHECK_EQUAL(manager.BalanceOf(25, ownerId), 2);
+    BOOST_CHECK_EQUAL(manager.NfTokenIdsOf(ownerId).size(), 2);
+    BOOST_CHECK_EQUAL(manager.NfTokenIdsOf(25, ownerId).size(), 2);
+    BOOST_CHECK_EQUAL(manager.TotalSupply(25), 2);
+    BOOST_CHECK_THROW(manager.NfTokensOf(ownerId), std::runtime_error);
+
+    BOOST_CHECK(manager.Delete(25, nfToken.tokenId));
+    setup.ConnectBlock();
+    BOOST_CHECK(manager.OwnerOf(25, nfToken.tokenId).IsNull());
+    BOOST_CHECK_EQUAL(manager.BalanceOf(ownerId), 1);
+    std::vector<uint256> tokenIds = manager.NfTokenIdsOf(ownerId);
+    BOOST_CHECK_EQUAL(tokenIds.size(), 1);
+    BOOST_CHECK(tokenIds[0] == nfToken2.tokenId);
+    BOOST_CHECK_EQUAL(manager.TotalSupply(25), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
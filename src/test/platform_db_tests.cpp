@@ -0,0 +1,225 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "random.h"
+#include "platform/platform-db.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace Platform;
+
+namespace
+{
+struct PlatformDbSetup
+{
+    std::vector<std::unique_ptr<CBlockIndex> > blocks;
+    const uint64_t protocolA = 25;
+    const uint64_t protocolB = 26;
+
+    PlatformDbSetup()
+    {
+        PlatformDb::DestroyInstance();
+        PlatformDb::CreateInstance(1 << 20, PlatformOpt::OptRam, true, true);
+    }
+
+    ~PlatformDbSetup()
+    {
+        PlatformDb::DestroyInstance();
+        LOCK(cs_main);
+        for (const auto & block : blocks)
+            mapBlockIndex.erase(block->GetBlockHash());
+    }
+
+    CBlockIndex * AddBlock(int height)
+    {
+        blocks.emplace_back(new CBlockIndex());
+        CBlockIndex * pindex = blocks.back().get();
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(GetRandHash(), pindex)).first;
+        pindex->phashBlock = &mi->first;
+        pindex->nHeight = height;
+        return pindex;
+    }
+
+    static void ForgetBlock(const CBlockIndex * pindex)
+    {
+        LOCK(cs_main);
+        mapBlockIndex.erase(pindex->GetBlockHash());
+    }
+
+    static NfTokenDiskIndex MakeDiskIndex(const CBlockIndex * pindex, uint64_t protocolId, const CKeyID & ownerId)
+    {
+        auto nfToken = std::make_shared<NfToken>();
+        nfToken->tokenProtocolId = protocolId;
+        nfToken->tokenId = GetRandHash();
+        nfToken->tokenOwnerKeyId = ownerId;
+        nfToken->metadataAdminKeyId = RandomKeyId();
+        return NfTokenDiskIndex(pindex->GetBlockHash(), pindex, GetRandHash(), nfToken);
+    }
+
+    /// Write NFT records like a connected block does
+    static void WriteBlock(const std::vector<NfTokenDiskIndex> & nftDiskIndexes)
+    {
+        auto dbTx = PlatformDb::Instance().BeginTransaction();
+        for (const auto & nftDiskIndex : nftDiskIndexes)
+            PlatformDb::Instance().WriteNftDiskIndex(nftDiskIndex);
+        dbTx->Commit();
+    }
+
+    static std::vector<std::pair<uint64_t, uint256> > OwnerIndex(const CKeyID & ownerId, uint64_t protocolId = NfToken::UNKNOWN_TOKEN_PROTOCOL)
+    {
+        std::vector<std::pair<uint64_t, uint256> > result;
+        PlatformDb::Instance().ProcessNftOwnerIndex(ownerId, protocolId, [&](uint64_t nftProtocolId, const uint256 & tokenId) -> bool
+        {
+            result.emplace_back(nftProtocolId, tokenId);
+            return true;
+        });
+        return result;
+    }
+
+    static std::pair<uint64_t, uint256> Entry(const NfTokenDiskIndex & nftDiskIndex)
+    {
+        return std::make_pair(nftDiskIndex.NfTokenPtr()->tokenProtocolId, nftDiskIndex.NfTokenPtr()->tokenId);
+    }
+
+    static CKeyID RandomKeyId()
+    {
+        CKeyID keyId;
+        GetRandBytes(keyId.begin(), keyId.size());
+        return keyId;
+    }
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(platform_db_tests, PlatformDbSetup)
+
+BOOST_AUTO_TEST_CASE(nft_owner_index)
+{
+    PlatformDb & db = PlatformDb::Instance();
+    CKeyID owner = RandomKeyId();
+    CKeyID otherOwner = RandomKeyId();
+    CBlockIndex * block10 = AddBlock(10);
+    CBlockIndex * block20 = AddBlock(20);
+
+    NfTokenDiskIndex a20 = MakeDiskIndex(block20, protocolA, owner);
+    NfTokenDiskIndex b10 = MakeDiskIndex(block10, protocolB, owner);
+    NfTokenDiskIndex a10 = MakeDiskIndex(block10, protocolA, owner);
+    NfTokenDiskIndex other = MakeDiskIndex(block10, protocolA, otherOwner);
+    WriteBlock({a20, b10, a10, other});
+
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner), 3);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolA), 2);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolB), 1);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(otherOwner), 1);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(RandomKeyId()), 0);
+
+    // Grouped by protocol, ordered by height
+    auto entries = OwnerIndex(owner);
+    BOOST_REQUIRE_EQUAL(entries.size(), 3);
+    BOOST_CHECK(entries[0] == Entry(a10));
+    BOOST_CHECK(entries[1] == Entry(a20));
+    BOOST_CHECK(entries[2] == Entry(b10));
+    entries = OwnerIndex(owner, protocolB);
+    BOOST_REQUIRE_EQUAL(entries.size(), 1);
+    BOOST_CHECK(entries[0] == Entry(b10));
+    BOOST_CHECK(OwnerIndex(owner, 27).empty());
+
+    // Handlers stop the iteration
+    std::size_t processed = 0;
+    db.ProcessNftOwnerIndex(owner, NfToken::UNKNOWN_TOKEN_PROTOCOL, [&](uint64_t, const uint256 &) -> bool
+    {
+        return ++processed < 2;
+    });
+    BOOST_CHECK_EQUAL(processed, 2);
+
+    // Rewriting a record does not count it twice
+    WriteBlock({a20});
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolA), 2);
+
+    // Uncommitted changes are not visible
+    auto dbTx = db.BeginTransaction();
+    db.EraseNftDiskIndex(protocolA, a20.NfTokenPtr()->tokenId);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolA), 2);
+    BOOST_CHECK_EQUAL(OwnerIndex(owner, protocolA).size(), 2);
+    dbTx->Commit();
+    dbTx.reset();
+
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner), 2);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolA), 1);
+    entries = OwnerIndex(owner, protocolA);
+    BOOST_REQUIRE_EQUAL(entries.size(), 1);
+    BOOST_CHECK(entries[0] == Entry(a10));
+}
+
+BOOST_AUTO_TEST_CASE(nft_owner_index_erase_unknown_block)
+{
+    PlatformDb & db = PlatformDb::Instance();
+    CKeyID owner = RandomKeyId();
+    CBlockIndex * block10 = AddBlock(10);
+    CBlockIndex * block20 = AddBlock(20);
+
+    NfTokenDiskIndex a10 = MakeDiskIndex(block10, protocolA, owner);
+    NfTokenDiskIndex a20 = MakeDiskIndex(block20, protocolA, owner);
+    WriteBlock({a10, a20});
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner), 2);
+
+    // Without its block the record can not be read anymore, its owner index entry is still removed
+    ForgetBlock(block20);
+    BOOST_CHECK(db.ReadNftIndex(protocolA, a20.NfTokenPtr()->tokenId).IsNull());
+    auto dbTx = db.BeginTransaction();
+    db.EraseNftDiskIndex(protocolA, a20.NfTokenPtr()->tokenId);
+    dbTx->Commit();
+    dbTx.reset();
+
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner), 1);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolA), 1);
+    auto entries = OwnerIndex(owner);
+    BOOST_REQUIRE_EQUAL(entries.size(), 1);
+    BOOST_CHECK(entries[0] == Entry(a10));
+}
+
+BOOST_AUTO_TEST_CASE(nft_owner_index_build)
+{
+    PlatformDb & db = PlatformDb::Instance();
+    CKeyID owner = RandomKeyId();
+    CKeyID otherOwner = RandomKeyId();
+    CBlockIndex * block10 = AddBlock(10);
+    CBlockIndex * block20 = AddBlock(20);
+
+    // Records written before the owner index existed
+    std::vector<NfTokenDiskIndex> nftDiskIndexes = {
+        MakeDiskIndex(block20, protocolA, owner),
+        MakeDiskIndex(block10, protocolA, owner),
+        MakeDiskIndex(block10, protocolB, owner),
+        MakeDiskIndex(block20, protocolB, otherOwner),
+    };
+    for (const auto & nftDiskIndex : nftDiskIndexes)
+    {
+        const NfToken & nfToken = *nftDiskIndex.NfTokenPtr();
+        db.GetRawDB().Write(std::make_tuple(PlatformDb::DB_NFT, nfToken.tokenProtocolId, nfToken.tokenId), nftDiskIndex);
+    }
+    BOOST_CHECK(!db.IsNftOwnerIndexBuilt());
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner), 0);
+    BOOST_CHECK(OwnerIndex(owner).empty());
+
+    db.BuildNftOwnerIndex();
+    BOOST_CHECK(db.IsNftOwnerIndexBuilt());
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner), 3);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolA), 2);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(owner, protocolB), 1);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(otherOwner), 1);
+    BOOST_CHECK_EQUAL(db.ReadNftOwnerBalance(otherOwner, protocolA), 0);
+
+    auto entries = OwnerIndex(owner);
+    BOOST_REQUIRE_EQUAL(entries.size(), 3);
+    BOOST_CHECK(entries[0] == Entry(nftDiskIndexes[1]));
+    BOOST_CHECK(entries[1] == Entry(nftDiskIndexes[0]));
+    BOOST_CHECK(entries[2] == Entry(nftDiskIndexes[2]));
+    entries = OwnerIndex(otherOwner, protocolB);
+    BOOST_REQUIRE_EQUAL(entries.size(), 1);
+    BOOST_CHECK(entries[0] == Entry(nftDiskIndexes[3]));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "masternode.h"
+#include "masternodeman.h"
+#include "masternode-payments.h"
 #include "keystore.h"
+#include "clientversion.h"
+#include "streams.h"
 #include <boost/test/unit_test.hpp>
 
 namespace
@@ -47,6 +51,14 @@ namespace
 
     }
 
+    void AddVote(CMasternodePayments& payments, int nHeight, const CScript& payee, int nVoter)
+    {
+        CMasternodePaymentWinner winner(CTxIn(COutPoint(ArithToUint256(nVoter), 0)));
+        winner.nBlockHeight = nHeight;
+        winner.AddPayee(payee);
+        BOOST_CHECK(payments.AddWinningMasternode(winner));
+    }
+
     struct CalculateScoreFixture
     {
         const CMasternode mn;
@@ -144,4 +156,88 @@ BOOST_FIXTURE_TEST_SUITE(CalculateScore, CalculateScoreFixture)
         }
     }
 
+    BOOST_AUTO_TEST_CASE(RankCache)
+    {
+        mnodeman.Clear();
+        for (int i = 1; i <= 5; ++i)
+            mnodeman.Add(CreateMasternode(CTxIn(COutPoint(ArithToUint256(i), 1 * COIN))));
+
+        const int64_t nHeight = 500;
+        std::vector<CMasternode> masternodes = mnodeman.GetFullMasternodeVector();
+        BOOST_CHECK_EQUAL(masternodes.size(), 5);
+
+        // Ranks must follow the scores and be served identically from the cache
+        std::set<int> ranks;
+        for (size_t i = 0; i < masternodes.size(); ++i)
+        {
+            int rank = mnodeman.GetMasternodeRank(masternodes[i].vin, nHeight, 0, false);
+            BOOST_CHECK_EQUAL(rank, mnodeman.GetMasternodeRank(masternodes[i].vin, nHeight, 0, false));
+            ranks.insert(rank);
+
+            CMasternode* pmn = mnodeman.GetMasternodeByRank(rank, nHeight, 0, false);
+            BOOST_REQUIRE(pmn != NULL);
+            BOOST_CHECK(pmn->vin == masternodes[i].vin);
+
+            for (size_t j = 0; j < masternodes.size(); ++j)
+            {
+                int otherRank = mnodeman.GetMasternodeRank(masternodes[j].vin, nHeight, 0, false);
+                if (otherRank > rank)
+                    BOOST_CHECK(masternodes[i].CalculateScore(nHeight).GetCompact(false) >= masternodes[j].CalculateScore(nHeight).GetCompact(false));
+            }
+        }
+        BOOST_CHECK_EQUAL(ranks.size(), 5);
+        BOOST_CHECK_EQUAL(*ranks.begin(), 1);
+        BOOST_CHECK_EQUAL(*ranks.rbegin(), 5);
+
+        // Adding and removing masternodes must invalidate cached ranks
+        CTxIn vinNew(COutPoint(ArithToUint256(6), 1 * COIN));
+        BOOST_CHECK_EQUAL(mnodeman.GetMasternodeRank(vinNew, nHeight, 0, false), -1);
+        mnodeman.Add(CreateMasternode(vinNew));
+        BOOST_CHECK(mnodeman.GetMasternodeRank(vinNew, nHeight, 0, false) != -1);
+        BOOST_CHECK(mnodeman.GetMasternodeByRank(6, nHeight, 0, false) != NULL);
+        mnodeman.Remove(vinNew);
+        BOOST_CHECK_EQUAL(mnodeman.GetMasternodeRank(vinNew, nHeight, 0, false), -1);
+        BOOST_CHECK(mnodeman.GetMasternodeByRank(6, nHeight, 0, false) == NULL);
+
+        // Unknown heights are not ranked
+        BOOST_CHECK_EQUAL(mnodeman.GetMasternodeRank(masternodes[0].vin, 1001, 0, false), -1);
+
+        mnodeman.Clear();
+    }
+
+    BOOST_AUTO_TEST_CASE(LastPaidHeight)
+    {
+        CMasternodePayments payments;
+        CScript payee = CScript() << OP_1;
+        CScript payeeOther = CScript() << OP_2;
+
+        // A payment counts from its second vote on
+        AddVote(payments, 990, payee, 1);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 1000, 900), 0);
+        AddVote(payments, 990, payee, 2);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 1000, 900), 990);
+        AddVote(payments, 998, payee, 1);
+        AddVote(payments, 998, payee, 2);
+        AddVote(payments, 999, payeeOther, 1);
+        AddVote(payments, 999, payeeOther, 2);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 1000, 900), 998);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeOther, 1000, 900), 999);
+
+        // Only the blocks from nMinHeight up to the tip count, so a lower tip skips the later payments
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 997, 900), 990);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 997, 991), 0);
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payeeOther, 998, 900), 0);
+
+        // The index is rebuilt when the votes are loaded from disk
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        stream << payments;
+        CMasternodePayments paymentsLoaded;
+        stream >> paymentsLoaded;
+        BOOST_CHECK_EQUAL(paymentsLoaded.GetLastPaidHeight(payee, 1000, 900), 998);
+        BOOST_CHECK_EQUAL(paymentsLoaded.GetLastPaidHeight(payeeOther, 1000, 900), 999);
+
+        payments.Clear();
+        BOOST_CHECK_EQUAL(payments.GetLastPaidHeight(payee, 1000, 900), 0);
+    }
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+// Copyright (c) 2014-2020 Crown Core developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "net.h"
+
+#include "chainparams.h"
+#include "protocol.h"
+#include "random.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+namespace
+{
+SOCKET ConnectLoopbackPeer(const CService& addrListen)
+{
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addrListen.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+        return INVALID_SOCKET;
+    SOCKET hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (hSocket == INVALID_SOCKET)
+        return INVALID_SOCKET;
+    // don't hang the tests if the handler stops servicing the connection
+    struct timeval timeout;
+    timeout.tv_sec = 10;
+    timeout.tv_usec = 0;
+    setsockopt(hSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    if (connect(hSocket, (struct sockaddr*)&sockaddr, len) == SOCKET_ERROR) {
+        CloseSocket(hSocket);
+        return INVALID_SOCKET;
+    }
+    return hSocket;
+}
+
+// Poll until fDone returns true, at most nTimeout seconds
+bool WaitFor(std::function<bool()> fDone, int nTimeout)
+{
+    int64_t nEnd = GetTime() + nTimeout;
+    while (!fDone()) {
+        if (GetTime() > nEnd)
+            return false;
+        MilliSleep(10);
+    }
+    return true;
+}
+
+size_t CountNodesWithMessage()
+{
+    size_t nCount = 0;
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes) {
+        LOCK(pnode->cs_vRecvMsg);
+        if (!pnode->vRecvMsg.empty() && pnode->vRecvMsg.front().complete())
+            nCount++;
+    }
+    return nCount;
+}
+
+size_t CountNodes()
+{
+    LOCK(cs_vNodes);
+    return vNodes.size();
+}
+
+/**
+ * Connect nPeers loopback peers to the socket handler, have each of them send a message
+ * and receive one, then disconnect them all. Returns the time it took in microseconds.
+ */
+int64_t RunLoopbackPeers(const CService& addrListen, int nPeers)
+{
+    int64_t nStart = GetTimeMicros();
+    boost::thread threadSocketHandler(&ThreadSocketHandler);
+
+    std::vector<SOCKET> vSockets;
+    for (int i = 0; i < nPeers; i++) {
+        SOCKET hSocket = ConnectLoopbackPeer(addrListen);
+        BOOST_REQUIRE(hSocket != INVALID_SOCKET);
+        vSockets.push_back(hSocket);
+    }
+    BOOST_CHECK(WaitFor([&]() { return CountNodes() == (size_t)nPeers; }, 60));
+
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << CMessageHeader(Params().MessageStart(), "verack", 0);
+    BOOST_FOREACH(SOCKET hSocket, vSockets)
+        BOOST_REQUIRE_EQUAL(send(hSocket, &ssHeader[0], ssHeader.size(), MSG_NOSIGNAL), (ssize_t)ssHeader.size());
+    BOOST_CHECK(WaitFor([&]() { return CountNodesWithMessage() == (size_t)nPeers; }, 60));
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            pnode->PushMessage("verack");
+    }
+    BOOST_FOREACH(SOCKET hSocket, vSockets) {
+        char pchBuf[24];
+        size_t nRecv = 0;
+        while (nRecv < sizeof(pchBuf)) {
+            ssize_t nBytes = recv(hSocket, pchBuf + nRecv, sizeof(pchBuf) - nRecv, 0);
+            if (nBytes <= 0)
+                break;
+            nRecv += nBytes;
+        }
+        BOOST_CHECK_EQUAL(nRecv, sizeof(pchBuf));
+        BOOST_CHECK(memcmp(pchBuf, Params().MessageStart(), MESSAGE_START_SIZE) == 0);
+    }
+
+    BOOST_FOREACH(SOCKET hSocket, vSockets)
+        CloseSocket(hSocket);
+    BOOST_CHECK(WaitFor([&]() { return CountNodes() == 0; }, 60));
+
+    threadSocketHandler.interrupt();
+    threadSocketHandler.join();
+    return GetTimeMicros() - nStart;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(socketevents_tests)
+
+BOOST_AUTO_TEST_CASE(socketevents_loopback_peers)
+{
+    CService addrListen;
+    std::string strError;
+    for (int i = 0; i < 10 && addrListen.GetPort() == 0; i++) {
+        CService addr("127.0.0.1", 20000 + (int)GetRand(40000));
+        if (BindListenPort(addr, strError))
+            addrListen = addr;
+    }
+    BOOST_REQUIRE(addrListen.GetPort() != 0);
+
+    int nMaxConnectionsSaved = nMaxConnections;
+    bool fSocketEventsEpollSaved = fSocketEventsEpoll;
+
+    // Both ends of every connection live in this process
+    int nSelectPeers = 200;
+    nMaxConnections = nSelectPeers + 100;
+    fSocketEventsEpoll = false;
+    int64_t nSelect = RunLoopbackPeers(addrListen, nSelectPeers);
+    BOOST_TEST_MESSAGE(strprintf("socketevents_loopback_peers: %d peers with select in %dms", nSelectPeers, nSelect / 1000));
+
+#ifdef HAVE_SYS_EPOLL_H
+    // More connections than select() can handle, if the descriptor limit allows it
+    int nEpollPeers = std::min(1500, (RaiseFileDescriptorLimit(4000) - 100) / 2);
+    nMaxConnections = nEpollPeers + 100;
+    fSocketEventsEpoll = true;
+    int64_t nEpoll = RunLoopbackPeers(addrListen, nEpollPeers);
+    BOOST_TEST_MESSAGE(strprintf("socketevents_loopback_peers: %d peers with epoll in %dms", nEpollPeers, nEpoll / 1000));
+#endif
+
+    nMaxConnections = nMaxConnectionsSaved;
+    fSocketEventsEpoll = fSocketEventsEpollSaved;
+    CloseListenSockets();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,12 @@
 #include "amount.h"
 #include "arith_uint256.h"
 #include "key.h"
+#include "tinyformat.h"
 #include "utiltime.h"
 #include "primitives/block.h"
 
 #include "mn-pos/kernel.h"
+#include "mn-pos/paymentindex.h"
 #include "mn-pos/stakeminer.h"
 #include "mn-pos/stakevalidation.h"
 
@@ -43,6 +45,83 @@ BOOST_AUTO_TEST_CASE(stakeminer)
     BOOST_CHECK_MESSAGE(kernel.IsValidProof(nTarget), "did not find a valid kernel");
 }
 
+//Kernels of eight stake pointers of one masternode
+static KernelSearch MakeKernelSearch()
+{
+    KernelSearch search;
+    for (unsigned int i = 0; i < 8; i++) {
+        std::pair<uint256, unsigned int> outpoint = std::make_pair(ArithToUint256(arith_uint256(1000 + i)), 1);
+        search.AddKernel(Kernel(outpoint, 10000, ArithToUint256(arith_uint256(123456 + i)), 100000 + i, 0));
+    }
+    return search;
+}
+
+BOOST_AUTO_TEST_CASE(kernel_search)
+{
+    arith_uint256 aTarget;
+    aTarget = ~aTarget;
+    aTarget >>= 20;
+    uint256 nTarget = ArithToUint256(aTarget);
+
+    //The earliest stake time that is valid for any of the kernels, found one kernel at a time
+    KernelSearch search = MakeKernelSearch();
+    uint32_t nTimeStart = 1600000000;
+    uint64_t nTimeExpected = 0;
+    size_t nExpected = 0;
+    for (uint32_t nTime = nTimeStart; nTime < nTimeStart + 100000 && !nTimeExpected; nTime++) {
+        for (size_t i = 0; i < search.GetKernelCount(); i++) {
+            Kernel kernel = search.GetKernel(i);
+            kernel.SetStakeTime(nTime);
+            if (kernel.IsValidProof(nTarget)) {
+                nTimeExpected = nTime;
+                nExpected = i;
+                break;
+            }
+        }
+    }
+    BOOST_REQUIRE_MESSAGE(nTimeExpected, "no kernel found one at a time");
+
+    size_t nFound;
+    BOOST_CHECK(!search.Search(nTimeStart, nTimeExpected - 1, nTarget, nFound));
+    BOOST_REQUIRE(search.Search(nTimeStart, nTimeStart + 100000, nTarget, nFound));
+    BOOST_CHECK_EQUAL(nFound, nExpected);
+    BOOST_CHECK_EQUAL(search.GetKernel(nFound).GetTime(), nTimeExpected);
+    BOOST_CHECK(search.GetKernel(nFound).IsValidProof(nTarget));
+
+    //The single kernel search agrees
+    Kernel kernel = search.GetKernel(nExpected);
+    BOOST_CHECK(SearchTimeSpan(kernel, nTimeStart, nTimeExpected, nTarget));
+    BOOST_CHECK_EQUAL(kernel.GetTime(), nTimeExpected);
+}
+
+BOOST_AUTO_TEST_CASE(kernel_search_speed)
+{
+    //A target nothing meets, so every stake time of every kernel is hashed
+    uint256 nTarget;
+    const uint32_t nTimeStart = 1600000000;
+    const uint32_t nTimes = 10000;
+
+    KernelSearch search = MakeKernelSearch();
+    int64_t nStart = GetTimeMicros();
+    for (size_t i = 0; i < search.GetKernelCount(); i++) {
+        Kernel kernel = search.GetKernel(i);
+        for (uint32_t nTime = nTimeStart; nTime < nTimeStart + nTimes; nTime++) {
+            kernel.SetStakeTime(nTime);
+            BOOST_REQUIRE(!kernel.IsValidProof(nTarget));
+        }
+    }
+    int64_t nTimeSingle = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+    size_t nFound;
+    nStart = GetTimeMicros();
+    BOOST_CHECK(!search.Search(nTimeStart, nTimeStart + nTimes - 1, nTarget, nFound));
+    int64_t nTimeSearch = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    BOOST_CHECK_EQUAL(search.GetHashCount(), search.GetKernelCount() * nTimes);
+
+    BOOST_TEST_MESSAGE(strprintf("kernel hashes/sec: one at a time %.0f, kernel search %.0f",
+                                 search.GetHashCount() * 1000000.0 / nTimeSingle, search.GetHashCount() * 1000000.0 / nTimeSearch));
+}
+
 BOOST_AUTO_TEST_CASE(proof_validity)
 {
     uint64_t nAmount = 10000 * COIN; //10,000 coins is the amount for a masternode
@@ -139,4 +218,62 @@ BOOST_AUTO_TEST_CASE(block_signature)
     BOOST_CHECK_MESSAGE(!CheckBlockSignature(block, keyMasternode.GetPubKey()), "Validated signature that was not valid");
 }
 
+//Block at nHeight whose coinbase pays the masternode and systemnode
+static CBlock PaymentBlock(int nHeight, const CScript& scriptMN, const CScript& scriptSN)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(CTxIn(COutPoint(), CScript() << nHeight << OP_0));
+    tx.vout.emplace_back(CTxOut(0, CScript()));
+    tx.vout.emplace_back(CTxOut(1, scriptMN));
+    tx.vout.emplace_back(CTxOut(1, scriptSN));
+    CBlock block;
+    block.nTime = nHeight;
+    block.vtx.emplace_back(tx);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(payment_index)
+{
+    CScript scriptA = CScript() << OP_1;
+    CScript scriptB = CScript() << OP_2;
+    CScript scriptC = CScript() << OP_3;
+
+    //A is paid as masternode at every height, B as systemnode at even heights and C at odd ones
+    PaymentIndex index;
+    BOOST_CHECK_EQUAL(index.GetHeight(), -1);
+    for (int i = 1; i <= 10; i++)
+        index.AddBlock(PaymentBlock(i, scriptA, i % 2 ? scriptC : scriptB), i);
+    BOOST_CHECK_EQUAL(index.GetHeight(), 10);
+    BOOST_CHECK_EQUAL(index.GetPaymentCount(), 20U);
+
+    std::vector<StakePayment> vPayments = index.GetPayments(scriptA, 1, 1);
+    BOOST_CHECK_EQUAL(vPayments.size(), 10U);
+    BOOST_CHECK(index.GetPayments(scriptA, 2, 1).empty());
+    vPayments = index.GetPayments(scriptB, 2, 5);
+    BOOST_REQUIRE_EQUAL(vPayments.size(), 3U);
+    BOOST_CHECK_EQUAL(vPayments[0].nHeight, 6);
+    BOOST_CHECK_EQUAL(vPayments[0].nPos, 2U);
+    CBlock block6 = PaymentBlock(6, scriptA, scriptB);
+    BOOST_CHECK(vPayments[0].hashBlock == block6.GetHash());
+    BOOST_CHECK(vPayments[0].txid == block6.vtx[0].GetHash());
+
+    //Disconnecting the tip takes its payments out
+    index.RemoveBlock(10);
+    index.RemoveBlock(9);
+    BOOST_CHECK_EQUAL(index.GetHeight(), 8);
+    BOOST_CHECK_EQUAL(index.GetPayments(scriptA, 1, 1).size(), 8U);
+    BOOST_CHECK_EQUAL(index.GetPayments(scriptB, 2, 1).size(), 4U);
+    BOOST_CHECK_EQUAL(index.GetPayments(scriptC, 2, 1).size(), 4U);
+
+    //Old payments are pruned, a payee without any left is dropped
+    index.EraseBeforeHeight(8);
+    BOOST_CHECK_EQUAL(index.GetPaymentCount(), 2U);
+    BOOST_CHECK(index.GetPayments(scriptC, 2, 1).empty());
+    BOOST_CHECK_EQUAL(index.GetPayments(scriptB, 2, 1).size(), 1U);
+
+    index.Clear();
+    BOOST_CHECK_EQUAL(index.GetHeight(), -1);
+    BOOST_CHECK(index.GetPayments(scriptA, 1, 1).empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #define BOOST_TEST_MODULE Crown Test Suite
 
+#include "crypto/sha256.h"
 #include "key.h"
 #include "main.h"
 #include "random.h"
@@ -33,6 +34,7 @@ struct TestingSetup {
     boost::thread_group threadGroup;
 
     TestingSetup() {
+        SHA256AutoDetect();
         ECC_Start();
         SetupEnvironment();
         fPrintToDebugLog = false; // don't want to write to debug.log file
@@ -58,6 +60,9 @@ struct TestingSetup {
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        nMempoolScriptCheckThreads = 3;
+        for (int i=0; i < nMempoolScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadMempoolScriptCheck);
         RegisterNodeSignals(GetNodeSignals());
     }
     ~TestingSetup()
@@ -5,38 +5,199 @@
 
 #include "txdb.h"
 
+#include "compressor.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
 
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
 
-void static BatchWriteCoins(CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins) {
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
+//! Number of transactions converted per database write when upgrading the coin database
+static const size_t COINS_UPGRADE_BATCH_SIZE = 10000;
+
+//! Format of the coin database records, stored under 'V'. Older versions had no version record.
+static const int COINS_DB_VERSION = 1;
+
+/**
+ * The chainstate keeps a summary per transaction with unspent outputs and one record per unspent output:
+ *   'S' txid           -> VARINT(nHeight * 2 + fBlockReward) VARINT(nVersion) bitmask of the unspent outputs
+ *   'C' txid VARINT(n) -> CTxOutCompressor(vout[n])
+ * Both are read by their exact key, so lookups of missing transactions are answered by the bloom filter.
+ * Spending a single output of a wide transaction erases that output's record and rewrites the small summary.
+ * Older versions stored a whole CCoins per txid under 'c'.
+ */
+struct CCoinsOutputKey
+{
+    uint256 txid;
+    uint32_t n;
+
+    CCoinsOutputKey() : n(0) {}
+    CCoinsOutputKey(const uint256& txidIn, uint32_t nIn) : txid(txidIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        char chType = 'C';
+        READWRITE(chType);
+        READWRITE(txid);
+        READWRITE(VARINT(n));
+    }
+};
+
+struct CCoinsSummary
+{
+    bool fBlockReward;
+    int nHeight;
+    int nVersion;
+    //! Bit n is set when output n has a record
+    std::vector<unsigned char> vAvail;
+
+    CCoinsSummary() : fBlockReward(false), nHeight(0), nVersion(0) {}
+    explicit CCoinsSummary(const CCoins& coins) : fBlockReward(coins.fBlockReward), nHeight(coins.nHeight), nVersion(coins.nVersion) {
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull())
+                SetAvailable(i);
+        }
+    }
+
+    unsigned int GetOutputCount() const { return vAvail.size() * 8; }
+    bool IsAvailable(unsigned int n) const { return n / 8 < vAvail.size() && (vAvail[n / 8] & (1 << (n % 8))); }
+    void SetAvailable(unsigned int n) {
+        if (vAvail.size() <= n / 8)
+            vAvail.resize(n / 8 + 1, 0);
+        vAvail[n / 8] |= 1 << (n % 8);
+    }
+    bool IsEmpty() const { return vAvail.empty(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn) {
+        unsigned int nCode = nHeight * 2 + (fBlockReward ? 1 : 0);
+        READWRITE(VARINT(nCode));
+        nHeight = nCode / 2;
+        fBlockReward = nCode & 1;
+        READWRITE(VARINT(nVersion));
+        READWRITE(vAvail);
+    }
+};
+
+/** Assemble the CCoins of a transaction from its summary, returns false if it has no unspent outputs */
+bool static ReadCoinsOutputs(const CLevelDBWrapper& db, const uint256& txid, const CCoinsSummary& summary, CCoins& coins)
+{
+    coins.Clear();
+    if (summary.IsEmpty())
+        return false;
+    coins.fBlockReward = summary.fBlockReward;
+    coins.nHeight = summary.nHeight;
+    coins.nVersion = summary.nVersion;
+    for (unsigned int i = 0; i < summary.GetOutputCount(); i++) {
+        if (!summary.IsAvailable(i))
+            continue;
+        if (coins.vout.size() <= i)
+            coins.vout.resize(i + 1);
+        CTxOutCompressor txoutCompressor(coins.vout[i]);
+        if (!db.Read(CCoinsOutputKey(txid, i), txoutCompressor))
+            throw std::runtime_error(strprintf("output %s:%u is missing from the coin database", txid.ToString(), i));
+    }
+    return true;
+}
+
+/**
+ * Queue the difference between the stored outputs of a transaction and its new state, fStored is
+ * false for entries which are known not to be in the database. Returns the number of output records touched.
+ */
+unsigned int static BatchWriteCoins(const CLevelDBWrapper& db, CLevelDBBatch &batch, const uint256 &hash, const CCoins &coins, bool fStored) {
+    // The outputs of a transaction never change, only the summary has to be rewritten when a reorg
+    // moved the transaction to another height
+    CCoinsSummary stored;
+    if (fStored)
+        db.Read(make_pair('S', hash), stored);
+
+    CCoinsSummary summary(coins);
+    unsigned int nTouched = 0;
+    for (unsigned int i = 0; i < std::max(stored.GetOutputCount(), summary.GetOutputCount()); i++) {
+        if (stored.IsAvailable(i) && !summary.IsAvailable(i)) {
+            batch.Erase(CCoinsOutputKey(hash, i));
+            nTouched++;
+        } else if (!stored.IsAvailable(i) && summary.IsAvailable(i)) {
+            CTxOut txout = coins.vout[i];
+            batch.Write(CCoinsOutputKey(hash, i), CTxOutCompressor(txout));
+            nTouched++;
+        }
+    }
+
+    if (summary.IsEmpty()) {
+        if (fStored)
+            batch.Erase(make_pair('S', hash));
+    } else if (nTouched > 0 || stored.nHeight != summary.nHeight || stored.fBlockReward != summary.fBlockReward || stored.nVersion != summary.nVersion) {
+        batch.Write(make_pair('S', hash), summary);
+    }
+    return nTouched;
 }
 
 void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash) {
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe),
+    fFlushPending(false), fFlushFailed(false), fFlushStop(false) {
+}
+
+CCoinsViewDB::~CCoinsViewDB() {
+    // The flusher writes the pending snapshot before it exits
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        fFlushStop = true;
+    }
+    condFlush.notify_all();
+    if (threadFlush.joinable())
+        threadFlush.join();
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair('c', txid), coins);
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        if (fFlushPending) {
+            CCoinsMap::const_iterator it = mapFlushing.find(txid);
+            if (it != mapFlushing.end()) {
+                if (it->second.coins.IsPruned())
+                    return false;
+                coins = it->second.coins;
+                return true;
+            }
+        }
+    }
+    CCoinsSummary summary;
+    if (!db.Read(make_pair('S', txid), summary))
+        return false;
+    return ReadCoinsOutputs(db, txid, summary, coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair('c', txid));
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        if (fFlushPending) {
+            CCoinsMap::const_iterator it = mapFlushing.find(txid);
+            if (it != mapFlushing.end())
+                return !it->second.coins.IsPruned();
+        }
+    }
+    return db.Exists(make_pair('S', txid));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        if (fFlushPending && !hashFlushing.IsNull())
+            return hashFlushing;
+    }
     uint256 hashBestChain;
     if (!db.Read('B', hashBestChain))
         return uint256();
@@ -44,25 +205,96 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (threadFlush.joinable()) {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        while (fFlushPending && !fFlushFailed)
+            condFlush.wait(lock);
+        if (fFlushFailed)
+            return false;
+        mapFlushing.swap(mapCoins);
+        mapCoins.clear();
+        hashFlushing = hashBlock;
+        fFlushPending = true;
+        condFlush.notify_all();
+        return true;
+    }
+    return WriteCoins(mapCoins, hashBlock, true);
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
+    size_t outputs = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            // A fresh entry was not in the database when it was fetched, so there is nothing to look up
+            outputs += BatchWriteCoins(db, batch, it->first, it->second.coins, !(it->second.flags & CCoinsCacheEntry::FRESH));
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            ++it;
+        }
     }
     if (!hashBlock.IsNull())
         BatchWriteHashBestChain(batch, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transactions (%u outputs, out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)outputs, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
+void CCoinsViewDB::StartBackgroundFlush() {
+    if (!threadFlush.joinable())
+        threadFlush = boost::thread(boost::bind(&CCoinsViewDB::ThreadFlush, this));
+}
+
+bool CCoinsViewDB::WaitForFlush() const {
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    while (fFlushPending && !fFlushFailed)
+        condFlush.wait(lock);
+    return !fFlushFailed;
+}
+
+void CCoinsViewDB::ThreadFlush() {
+    RenameThread("crown-coinsflush");
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(csFlush);
+            while ((!fFlushPending || fFlushFailed) && !fFlushStop)
+                condFlush.wait(lock);
+            if (!fFlushPending || fFlushFailed)
+                return;
+        }
+
+        // Readers only look entries up, the snapshot is left alone until it is on disk
+        int64_t nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = WriteCoins(mapFlushing, hashFlushing, false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint("coindb", "Background flush of %u transactions: %.2fms\n", (unsigned int)mapFlushing.size(), (GetTimeMicros() - nStart) * 0.001);
+
+        {
+            boost::unique_lock<boost::mutex> lock(csFlush);
+            if (fOk) {
+                mapFlushing.clear();
+                fFlushPending = false;
+            } else {
+                // Keep serving the snapshot, the next flush reports the failure
+                LogPrintf("%s: failed to write to coin database\n", __func__);
+                fFlushFailed = true;
+            }
+        }
+        condFlush.notify_all();
+    }
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -99,12 +331,36 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read('l', nFile);
 }
 
+// Hash the unspent outputs of a transaction the same way the per-txid format did
+void static ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const CCoins& coins, CAmount& nTotalAmount)
+{
+    ss << hash;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fBlockReward ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    stats.nTransactions++;
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            stats.nTransactionOutputs++;
+            ss << VARINT(i+1);
+            ss << out;
+            nTotalAmount += out.nValue;
+        }
+    }
+    ss << VARINT(0);
+}
+
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
+    if (!WaitForFlush())
+        return false;
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
     boost::scoped_ptr<leveldb::Iterator> pcursor(const_cast<CLevelDBWrapper*>(&db)->NewIterator());
-    pcursor->SeekToFirst();
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('S', uint256());
+    pcursor->Seek(ssKeySet.str());
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
     stats.hashBlock = GetBestBlock();
@@ -117,29 +373,21 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
             CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fBlockReward ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+            if (chType != 'S')
+                break;
+            uint256 txhash;
+            ssKey >> txhash;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoinsSummary summary;
+            ssValue >> summary;
+            CCoins coins;
+            if (ReadCoinsOutputs(db, txhash, summary, coins))
+                ApplyStats(stats, ss, txhash, coins, nTotalAmount);
+            stats.nSerializedSize += 32 + slValue.size();
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (!coins.vout[i].IsNull())
+                    stats.nSerializedSize += ::GetSerializeSize(CTxOutCompressor(coins.vout[i]), SER_DISK, CLIENT_VERSION);
             }
             pcursor->Next();
         } catch (std::exception &e) {
@@ -152,6 +400,83 @@ bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
     return true;
 }
 
+bool CCoinsViewDB::Upgrade() {
+    int nVersion = 0;
+    if (db.Read('V', nVersion)) {
+        if (nVersion != COINS_DB_VERSION)
+            return error("%s : the coin database has format %d, this version uses format %d, -reindex is needed", __func__, nVersion, COINS_DB_VERSION);
+        return true;
+    }
+
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('c', uint256());
+    pcursor->Seek(ssKeySet.str());
+    if (!pcursor->Valid() || pcursor->key().size() == 0 || pcursor->key().data()[0] != 'c') {
+        // Without a version record only an empty database is known not to need converting
+        pcursor->SeekToFirst();
+        for (; pcursor->Valid(); pcursor->Next()) {
+            char chType = pcursor->key().size() > 0 ? pcursor->key().data()[0] : 0;
+            if (chType == 'C' || chType == 'S')
+                return error("%s : the coin database has an unknown format, -reindex is needed", __func__);
+        }
+        return db.Write('V', COINS_DB_VERSION);
+    }
+
+    LogPrintf("Upgrading the coin database to per-output records...\n");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t nTransactions = 0;
+    size_t nOutputs = 0;
+    int nReportedProgress = 0;
+    CLevelDBBatch batch;
+    size_t nBatch = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            ssKey >> chType;
+            if (chType != 'c')
+                break;
+            uint256 txhash;
+            ssKey >> txhash;
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+            CCoins coins;
+            ssValue >> coins;
+
+            // Old and new records of a transaction go into the same batch, an interrupted upgrade continues where it stopped
+            nOutputs += BatchWriteCoins(db, batch, txhash, coins, false);
+            batch.Erase(make_pair('c', txhash));
+            nTransactions++;
+
+            if (++nBatch >= COINS_UPGRADE_BATCH_SIZE) {
+                if (!db.WriteBatch(batch))
+                    return error("%s : failed to write the upgraded records", __func__);
+                batch = CLevelDBBatch();
+                nBatch = 0;
+
+                // Transaction hashes are uniformly distributed, the first byte tells how far we are
+                int nProgress = (int)(*txhash.begin()) * 100 / 256;
+                if (nProgress > nReportedProgress) {
+                    uiInterface.ShowProgress(_("Upgrading UTXO database"), nProgress);
+                    nReportedProgress = nProgress;
+                }
+            }
+            pcursor->Next();
+        } catch (std::exception &e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    batch.Write('V', COINS_DB_VERSION);
+    if (!db.WriteBatch(batch))
+        return error("%s : failed to write the upgraded records", __func__);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Upgraded %u transactions with %u unspent outputs\n", (unsigned int)nTransactions, (unsigned int)nOutputs);
+    return true;
+}
+
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair('t', txid), pos);
 }
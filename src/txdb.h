@@ -8,12 +8,15 @@
 
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/thread.hpp>
+
 class CCoins;
 class uint256;
 
@@ -32,19 +35,49 @@ static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
+//! -dbbackgroundflush default
+static const bool DEFAULT_DB_BACKGROUND_FLUSH = false;
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
+
+    /**
+     * Background flushing: BatchWrite() swaps the flushed cache in as the pending snapshot and a
+     * flusher thread writes it to LevelDB, reads are answered from the snapshot until it is on
+     * disk. Only one snapshot is in flight, a flush arriving earlier waits for the previous one.
+     */
+    mutable CWaitableCriticalSection csFlush;
+    mutable CConditionVariable condFlush;
+    CCoinsMap mapFlushing;
+    uint256 hashFlushing;
+    bool fFlushPending;
+    bool fFlushFailed;
+    bool fFlushStop;
+    boost::thread threadFlush;
+
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase);
+    void ThreadFlush();
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+
+    //! Convert the per-txid records of older versions to per-output records, fails on a format which needs -reindex
+    bool Upgrade();
+
+    //! Hand the writes of BatchWrite() to a background thread from now on
+    void StartBackgroundFlush();
+    //! Wait until the pending snapshot is on disk, returns false if writing it failed
+    bool WaitForFlush() const;
 };
 
 /** Access to the block database (blocks/index/) */
@@ -9,7 +9,7 @@
 /**
  * network protocol versioning
  */
-static const int PROTOCOL_VERSION = 70058;
+static const int PROTOCOL_VERSION = 70059;
 static const int PROTOCOL_POS_START = 70057;
 
 //! initial proto version, to be increased after version/verack negotiation
@@ -57,4 +57,7 @@ static const int BIP0031_VERSION = 60000;
 //! "mempool" command, enhanced "getdata" behavior starts with this version
 static const int MEMPOOL_GD_VERSION = 60002;
 
+//! compact block relay ("sendcmpct", "cmpctblock", "getblocktxn" and "blocktxn") starts with this version
+static const int COMPACT_BLOCKS_VERSION = 70059;
+
 #endif // BITCOIN_VERSION_H
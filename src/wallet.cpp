@@ -13,6 +13,7 @@
 #include "masternode-budget.h"
 #include "masternodeconfig.h"
 #include "mn-pos/kernel.h"
+#include "mn-pos/paymentindex.h"
 #include "mn-pos/stakeminer.h"
 #include "instantx.h"
 #include "script/script.h"
@@ -1997,6 +1998,7 @@ bool CWallet::CreateCoinStake(const int nHeight, const uint32_t& nBits, const ui
     if (nTime < chainActive.Tip()->GetBlockTime())
         MilliSleep(5000);
 
+    int64_t nStart = GetTimeMicros();
     //! Maybe have a polymorphic base class for masternode and systemnode?
     if (fMasterNode) {
         CMasternode* activeStakingNode;
@@ -2004,10 +2006,6 @@ bool CWallet::CreateCoinStake(const int nHeight, const uint32_t& nBits, const ui
             LogPrintf("CreateCoinStake -- Couldn't find CMasternode object for active masternode\n");
             return false;
         }
-        if (!GetRecentStakePointers(vStakePointers)) {
-            LogPrintf("CreateCoinStake -- Couldn't find recent payment blocks for MN\n");
-            return false;
-        }
         pvinActiveNode = &activeStakingNode->vin;
         ppubkeyActiveNode = &activeStakingNode->pubkey;
         nActiveNodeInputHeight = chainActive.Height() - activeStakingNode->GetMasternodeInputAge();
@@ -2019,10 +2017,6 @@ bool CWallet::CreateCoinStake(const int nHeight, const uint32_t& nBits, const ui
             LogPrintf("CreateCoinStake -- Couldn't find CSystemnode object for active systemnode\n");
             return false;
         }
-        if (!GetRecentStakePointers(vStakePointers)) {
-            LogPrintf("CreateCoinStake -- Couldn't find recent payment blocks for SN\n");
-            return false;
-        }
         pvinActiveNode = &activeStakingNode->vin;
         ppubkeyActiveNode = &activeStakingNode->pubkey;
         nActiveNodeInputHeight = chainActive.Height() - activeStakingNode->GetSystemnodeInputAge();
@@ -2033,7 +2027,17 @@ bool CWallet::CreateCoinStake(const int nHeight, const uint32_t& nBits, const ui
         return false;
     }
 
-    //Create kernels for each valid stake pointer and see if any create a successful proof
+    bool fPointersFound = GetRecentStakePointers(vStakePointers);
+    int64_t nPointersFound = GetTimeMicros();
+    if (!fPointersFound) {
+        UpdateStakeAttemptStats(nStart, nPointersFound, 0);
+        LogPrintf("CreateCoinStake -- Couldn't find recent payment blocks for %s\n", fMasterNode ? "MN" : "SN");
+        return false;
+    }
+
+    //Create kernels for each valid stake pointer and search them all at once for a successful proof
+    KernelSearch search;
+    std::vector<StakePointer> vSearchPointers;
     for (auto pointer : vStakePointers) {
         if (!mapBlockIndex.count(pointer.hashBlock))
             continue;
@@ -2054,78 +2058,88 @@ bool CWallet::CreateCoinStake(const int nHeight, const uint32_t& nBits, const ui
             continue;
 
         auto pOutpoint = std::make_pair(pointer.txid, pointer.nPos);
-        Kernel kernel(pOutpoint, nAmountMN, nStakeModifier, pindex->GetBlockTime(), nTxNewTime);
-        uint256 nTarget = ArithToUint256(arith_uint256().SetCompact(nBits));
+        search.AddKernel(Kernel(pOutpoint, nAmountMN, nStakeModifier, pindex->GetBlockTime(), nTxNewTime));
+        vSearchPointers.emplace_back(pointer);
+    }
+
+    size_t nFound;
+    uint256 nTarget = ArithToUint256(arith_uint256().SetCompact(nBits));
+    if (!vSearchPointers.empty())
         nLastStakeAttempt = GetTime();
+    if (vSearchPointers.empty() || !search.Search(nTime, nTime + STAKE_SEARCH_INTERVAL, nTarget, nFound)) {
+        UpdateStakeAttemptStats(nStart, nPointersFound, vStakePointers.size());
+        return false;
+    }
 
-        if (!SearchTimeSpan(kernel, nTime, nTime + STAKE_SEARCH_INTERVAL, nTarget))
-            continue;
+    Kernel& kernel = search.GetKernel(nFound);
+    LogPrintf("%s: Found valid kernel for mn/sn collateral %s\n", __func__, pvinActiveNode->prevout.ToString());
+    LogPrintf("%s: %s\n", __func__, kernel.ToString());
 
-        LogPrintf("%s: Found valid kernel for mn/sn collateral %s\n", __func__, pvinActiveNode->prevout.ToString());
-        LogPrintf("%s: %s\n", __func__, kernel.ToString());
+    //Add stake payment to coinstake tx
+    CAmount nBlockReward = GetBlockValue(nHeight, 0); //Do not add fees until after they are packaged into the block
+    CScript scriptBlockReward = GetScriptForDestination(ppubkeyActiveNode->GetID());
+    CTxOut out(nBlockReward, scriptBlockReward);
+    txCoinStake.vout.emplace_back(out);
+    nTxNewTime = kernel.GetTime();
+    stakePointer = vSearchPointers[nFound];
 
-        //Add stake payment to coinstake tx
-        CAmount nBlockReward = GetBlockValue(nHeight, 0); //Do not add fees until after they are packaged into the block
-        CScript scriptBlockReward = GetScriptForDestination(ppubkeyActiveNode->GetID());
-        CTxOut out(nBlockReward, scriptBlockReward);
-        txCoinStake.vout.emplace_back(out);
-        nTxNewTime = kernel.GetTime();
-        stakePointer = pointer;
+    CTxIn txin;
+    txin.scriptSig << OP_PROOFOFSTAKE;
+    txCoinStake.vin.emplace_back(txin);
 
-        CTxIn txin;
-        txin.scriptSig << OP_PROOFOFSTAKE;
-        txCoinStake.vin.emplace_back(txin);
+    UpdateStakeAttemptStats(nStart, nPointersFound, vStakePointers.size());
+    return true;
+}
 
-        return true;
-    }
+void CWallet::UpdateStakeAttemptStats(int64_t nStart, int64_t nPointersFound, unsigned int nPointers)
+{
+    int64_t nNow = GetTimeMicros();
+    LogPrint("staking", "CreateCoinStake -- %u stake pointers in %.2fms, kernel search %.2fms\n", nPointers, (nPointersFound - nStart) * 0.001, (nNow - nPointersFound) * 0.001);
 
-    return false;
+    LOCK(cs_wallet);
+    stakeAttemptStats.nTime = GetTime();
+    stakeAttemptStats.nPointers = nPointers;
+    stakeAttemptStats.nPointerTime = nPointersFound - nStart;
+    stakeAttemptStats.nKernelTime = nNow - nPointersFound;
+    stakeAttemptStats.nAttempts++;
 }
 
 template<typename stakingnode>
 bool GetPointers(stakingnode* pstaker, std::vector<StakePointer>& vStakePointers, int nPaymentSlot)
 {
     bool found = false;
-    // get block index of last mn payment
-    std::vector<const CBlockIndex*> vBlocksLastPaid;
-    if (!pstaker->GetRecentPaymentBlocks(vBlocksLastPaid, false)) {
+    CScript scriptMNPubKey;
+    scriptMNPubKey = GetScriptForDestination(pstaker->pubkey.GetID());
+
+    // The payments to the node come from the payment index, so the blocks don't have to be read from disk
+    LOCK(cs_main);
+    int nBestHeight = chainActive.Height();
+    std::vector<StakePayment> vPayments;
+    if (!GetStakePayments(scriptMNPubKey, nPaymentSlot, nBestHeight - Params().ValidStakePointerDuration() + 1, vPayments)) {
         LogPrintf("GetRecentStakePointer -- Couldn't find last paid block\n");
         return false;
     }
 
-    int nBestHeight = chainActive.Height();
-    for (auto pindex : vBlocksLastPaid) {
-        if (budget.IsBudgetPaymentBlock(pindex->nHeight))
+    for (const StakePayment& payment : vPayments) {
+        if (budget.IsBudgetPaymentBlock(payment.nHeight))
             continue;
 
         // Pointer has to be at least deeper than the max reorg depth
-        if (nBestHeight - pindex->nHeight < Params().MaxReorganizationDepth())
+        if (nBestHeight - payment.nHeight < Params().MaxReorganizationDepth())
             continue;
 
-        CBlock blockLastPaid;
-        if (!ReadBlockFromDisk(blockLastPaid, pindex)) {
-            LogPrintf("GetRecentStakePointer -- Failed reading block from disk\n");
-            return false;
-        }
+        auto stakeSource = COutPoint(payment.txid, nPaymentSlot);
+        uint256 hashPointer = stakeSource.GetHash();
+        if (mapUsedStakePointers.count(hashPointer))
+            continue;
 
-        CScript scriptMNPubKey;
-        scriptMNPubKey = GetScriptForDestination(pstaker->pubkey.GetID());
-        for (CTransaction& tx : blockLastPaid.vtx) {
-            auto stakeSource = COutPoint(tx.GetHash(), nPaymentSlot);
-            uint256 hashPointer = stakeSource.GetHash();
-            if (mapUsedStakePointers.count(hashPointer))
-                continue;
-            if (tx.IsCoinBase() && tx.vout[nPaymentSlot].scriptPubKey == scriptMNPubKey) {
-                StakePointer stakePointer;
-                stakePointer.hashBlock = pindex->GetBlockHash();
-                stakePointer.txid = tx.GetHash();
-                stakePointer.nPos = nPaymentSlot;
-                stakePointer.pubKeyProofOfStake = pstaker->pubkey;
-                vStakePointers.emplace_back(stakePointer);
-                found = true;
-                continue;
-            }
-        }
+        StakePointer stakePointer;
+        stakePointer.hashBlock = payment.hashBlock;
+        stakePointer.txid = payment.txid;
+        stakePointer.nPos = nPaymentSlot;
+        stakePointer.pubKeyProofOfStake = pstaker->pubkey;
+        vStakePointers.emplace_back(stakePointer);
+        found = true;
     }
 
     return found;
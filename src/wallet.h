@@ -132,6 +132,18 @@ struct CRecipient
     {}
 };
 
+/** The last attempt to create a coinstake, times in microseconds */
+struct CStakeAttemptStats
+{
+    int64_t nTime;          //!< when the attempt was made
+    unsigned int nPointers; //!< stake pointers found
+    int64_t nPointerTime;   //!< finding the stake pointers
+    int64_t nKernelTime;    //!< searching their kernels
+    uint64_t nAttempts;     //!< attempts since startup
+
+    CStakeAttemptStats() : nTime(0), nPointers(0), nPointerTime(0), nKernelTime(0), nAttempts(0) {}
+};
+
 /** 
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -168,6 +180,7 @@ private:
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
     uint256 GenerateStakeModifier(const CBlockIndex* prewardBlockIndex) const;
+    void UpdateStakeAttemptStats(int64_t nStart, int64_t nPointersFound, unsigned int nPointers);
 
 public:
 //    bool SelectCoins(int64_t nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet, const CCoinControl *coinControl = NULL, AvailableCoinsType coin_type=ALL_COINS, bool useIX = true) const;
@@ -243,6 +256,8 @@ public:
 
     int64_t nTimeFirstKey;
 
+    CStakeAttemptStats stakeAttemptStats;
+
     const CWalletTx* GetWalletTx(const uint256& hash) const;
 
     //! check whether we are allowed to upgrade (or already support) to the named feature